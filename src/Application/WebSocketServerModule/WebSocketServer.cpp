@@ -9,6 +9,7 @@
 #include "CoreStringUtils.h"
 #include "LoggingFunctions.h"
 #include "Profiler.h"
+#include "FrameAPI.h"
 #include "UniqueIdGenerator.h"
 #include "OgreMaterialUtils.h"
 #include "WebSocketScriptTypeDefines.h"
@@ -17,6 +18,7 @@
 #include "Server.h"
 
 #include "kNet/DataDeserializer.h"
+#include "kNet/Clock.h"
 
 #include <websocketpp/frame.hpp>
 
@@ -24,7 +26,6 @@
 #include "IAssetStorage.h"
 #include "IAsset.h"
 
-#include <QMutexLocker>
 #include <QByteArray>
 #include <QStringList>
 #include <QVariant>
@@ -78,12 +79,97 @@ void ServerThread::run()
     }
 }
 
+// EventQueue
+
+EventQueue::EventQueue() :
+    slots_(0),
+    mask_(0),
+    dequeuePos_(0)
+{
+    Allocate(2);
+}
+
+EventQueue::~EventQueue()
+{
+    delete[] slots_;
+}
+
+void EventQueue::Allocate(uint capacity)
+{
+    uint size = 2;
+    while(size < capacity && size < 0x40000000)
+        size <<= 1;
+
+    delete[] slots_;
+    slots_ = new Slot[size];
+    mask_ = size - 1;
+    for(uint i = 0; i < size; ++i)
+        slots_[i].sequence = (int)i;
+    enqueuePos_ = 0;
+    dequeuePos_ = 0;
+}
+
+bool EventQueue::TryPush(SocketEvent::EventType type, const WebSocket::ConnectionPtr &connection, const char *data, size_t numBytes)
+{
+    Slot *slot = 0;
+    uint pos = (uint)(int)enqueuePos_;
+    for(;;)
+    {
+        slot = &slots_[pos & mask_];
+        const int diff = (int)((uint)slot->sequence.fetchAndAddAcquire(0) - pos);
+        if (diff == 0)
+        {
+            // The slot is free, try to claim it
+            if (enqueuePos_.testAndSetRelaxed((int)pos, (int)(pos + 1)))
+                break;
+        }
+        else if (diff < 0)
+            return false; // The slot still holds an event from the previous round, ie. the queue is full
+        pos = (uint)(int)enqueuePos_;
+    }
+
+    slot->event.type = type;
+    slot->event.connection = connection;
+    slot->event.data.assign(data, data + numBytes);
+    slot->sequence.fetchAndStoreRelease((int)(pos + 1));
+    return true;
+}
+
+SocketEvent *EventQueue::Front()
+{
+    Slot &slot = slots_[dequeuePos_ & mask_];
+    if ((uint)slot.sequence.fetchAndAddAcquire(0) != dequeuePos_ + 1)
+        return 0;
+    return &slot.event;
+}
+
+void EventQueue::PopFront()
+{
+    Slot &slot = slots_[dequeuePos_ & mask_];
+    slot.event.type = SocketEvent::None;
+    slot.event.connection.reset();
+    // Free the payload of a large frame, so that a burst of large frames does not keep its memory in every slot it went through
+    if (slot.event.data.capacity() > cMaxRetainedPayloadSize)
+        std::vector<char>().swap(slot.event.data);
+    slot.sequence.fetchAndStoreRelease((int)(dequeuePos_ + mask_ + 1));
+    ++dequeuePos_;
+}
+
+void EventQueue::Clear()
+{
+    while(Front())
+        PopFront();
+}
+
 // Server
 
 Server::Server(Framework *framework) :
     LC("[WebSocketServer]: "),
     framework_(framework),
-    port_(2345)
+    port_(2345),
+    highWaterMark_(0),
+    aboveHighWaterMark_(false),
+    dropWhenFull_(framework->HasCommandLineParameter("--wsDropWhenFull"))
 {
     // Port
     QStringList portParam = framework->CommandLineParameters("--port");
@@ -97,6 +183,58 @@ Server::Server(Framework *framework) :
             LogWarning(LC + "Failed to parse int from --port, using default port 2345.");
         }
     }
+
+    // Inbound event queue size
+    uint queueSize = 4096;
+    QStringList queueSizeParam = framework->CommandLineParameters("--wsEventQueueSize");
+    if (!queueSizeParam.isEmpty())
+    {
+        bool ok = false;
+        const uint size = queueSizeParam.first().toUInt(&ok);
+        if (ok && size > 0)
+            queueSize = size;
+        else
+            LogWarning(LC + "Failed to parse int from --wsEventQueueSize, using default size 4096.");
+    }
+    events_.Allocate(queueSize);
+    highWaterMark_ = events_.Capacity() * 3 / 4;
+
+    // Outbound buffer limit per client
+    QStringList sendBufferParam = framework->CommandLineParameters("--wsMaxSendBuffer");
+    if (!sendBufferParam.isEmpty())
+    {
+        bool ok = false;
+        const uint size = sendBufferParam.first().toUInt(&ok);
+        if (ok)
+            sendSettings_.maxBufferedBytes = size;
+        else
+            LogWarning(LC + "Failed to parse int from --wsMaxSendBuffer, using default size 4194304.");
+    }
+
+    // Compression of the frames to clients that support it
+    QStringList compressionParam = framework->CommandLineParameters("--wsCompressionLevel");
+    if (!compressionParam.isEmpty())
+    {
+        bool ok = false;
+        const int level = compressionParam.first().toInt(&ok);
+        if (ok && level >= 0 && level <= 9)
+            sendSettings_.compressionLevel = level;
+        else
+            LogWarning(LC + "--wsCompressionLevel must be between 0 and 9, using default level 6.");
+    }
+    QStringList compressionMinSizeParam = framework->CommandLineParameters("--wsCompressionMinSize");
+    if (!compressionMinSizeParam.isEmpty())
+    {
+        bool ok = false;
+        const uint size = compressionMinSizeParam.first().toUInt(&ok);
+        if (ok)
+            sendSettings_.compressionMinSize = size;
+        else
+            LogWarning(LC + "Failed to parse int from --wsCompressionMinSize, using default size 256.");
+    }
+
+    // Send the messages of the whole frame at once, after all modules have updated
+    connect(framework->Frame(), SIGNAL(PostFrameUpdate(float)), this, SLOT(FlushSends()));
     
     qRegisterMetaType<MsgEntityAction>("MsgEntityAction");
 }
@@ -139,29 +277,32 @@ void Server::Update(float frametime)
         }
     }
     
-    QList<SocketEvent*> processEvents;
+    const int dropped = droppedMessages_.fetchAndStoreRelaxed(0);
+    if (dropped > 0)
+        LogWarning(LC + QString("Event queue full, dropped %1 messages.").arg(dropped));
+
+    // Process the events that were pushed from the websocket thread(s) before this frame, in place
+    const uint numEvents = events_.Size();
+    if (numEvents >= highWaterMark_ && !aboveHighWaterMark_)
     {
-        QMutexLocker lockEvents(&mutexEvents_);
-        if (events_.size() == 0)
-            return;
-        // Make copy of current event queue for processing
-        processEvents = events_;
-        events_.clear();
+        LogWarning(LC + QString("Event queue above high-water mark, %1 of %2 slots in use.").arg(numEvents).arg(events_.Capacity()));
+        aboveHighWaterMark_ = true;
     }
+    else if (numEvents < highWaterMark_ / 2)
+        aboveHighWaterMark_ = false;
 
-    // Process events pushed from the websocket thread(s)
-    for (int i=0; i< processEvents.size(); ++i)
+    for(uint i = 0; i < numEvents; ++i)
     {
-        SocketEvent *event = processEvents[i];
+        SocketEvent *event = events_.Front();
         if (!event)
-            continue;
+            break;
 
         // User connected
         if (event->type == SocketEvent::Connected)
         {
             if (!UserConnection(event->connection))
             {
-                WebSocket::UserConnectionPtr userConnection(new WebSocket::UserConnection(event->connection));
+                WebSocket::UserConnectionPtr userConnection(new WebSocket::UserConnection(server_, event->connection));
                 connections_.push_back(userConnection);
 
                 // The connection does not yet have an ID assigned. Tundra server will assign on login
@@ -186,12 +327,14 @@ void Server::Update(float frametime)
             }
         }
         // Data message
-        else if (event->type == SocketEvent::Data && event->data.get())
+        else if (event->type == SocketEvent::Data && event->data.size() >= sizeof(u16))
         {
             WebSocket::UserConnectionPtr userConnection = UserConnection(event->connection);
             if (userConnection)
             {
-                kNet::DataDeserializer dd(event->data->GetData(), event->data->BytesFilled());
+                const char *data = &event->data[0];
+                const size_t numBytes = event->data.size();
+                kNet::DataDeserializer dd(data, numBytes);
                 u16 messageId = dd.Read<u16>();
 
                 // LoginMessage
@@ -225,21 +368,17 @@ void Server::Update(float frametime)
                     if (userConnection->properties["authenticated"].toBool() == true)
                     {
                         // Signal network message. As per kNet tradition the message ID is given separately in addition with the rest of the data
-                        emit NetworkMessageReceived(userConnection.get(), messageId, event->data->GetData() + sizeof(u16), event->data->BytesFilled() - sizeof(u16));
+                        emit NetworkMessageReceived(userConnection.get(), messageId, data + sizeof(u16), numBytes - sizeof(u16));
                         // Signal network message on the Tundra server so that it can be globally picked up
-                        tundraServer->EmitNetworkMessageReceived(userConnection.get(), 0, messageId, event->data->GetData() + sizeof(u16), event->data->BytesFilled() - sizeof(u16));
+                        tundraServer->EmitNetworkMessageReceived(userConnection.get(), 0, messageId, data + sizeof(u16), numBytes - sizeof(u16));
                     }
                 }
             }
             else
                 LogError(LC + "Received message from unauthorized connection, ignoring.");
-
-            event->data.reset();
         }
-        else
-            event->data.reset();
-        
-        SAFE_DELETE(event);
+
+        events_.PopFront();
     }
 }
 
@@ -266,6 +405,7 @@ WebSocket::UserConnectionPtr Server::UserConnection(ConnectionPtr connection)
 bool Server::Start()
 {
     Reset();
+    stopping_ = 0;
     
     try
     {
@@ -317,6 +457,7 @@ void Server::Stop()
     {
         if (server_)
         {
+            stopping_ = 1;
             server_->stop();
             thread_.wait();
             emit ServerStopped();
@@ -336,79 +477,48 @@ void Server::Stop()
 void Server::Reset()
 {
     connections_.clear();
+    events_.Clear();
 
     server_.reset();
 }
 
-void Server::OnConnected(ConnectionHandle connection)
+void Server::PushEvent(SocketEvent::EventType type, ConnectionPtr connection, const char *data, size_t numBytes)
 {
-    QMutexLocker lock(&mutexEvents_);
-
-    ConnectionPtr connectionPtr = server_->get_con_from_hdl(connection);
+    if (events_.TryPush(type, connection, data, numBytes))
+        return;
 
-    // Find existing events and remove them if we got duplicates 
-    // that were not synced to main thread yet.
-    QList<SocketEvent*> removeItems;
-    for (int i=0; i<events_.size(); ++i)
+    // The main thread has fallen behind. Data messages may be dropped, but connection state changes never are.
+    if (type == SocketEvent::Data && dropWhenFull_)
     {
-        // Remove any and all messages from this connection, 
-        // if there are any data messages for this connection.
-        // Which is not possible in theory.
-        SocketEvent *existing = events_[i];
-        if (existing->connection == connectionPtr)
-            removeItems << existing;
+        droppedMessages_.ref();
+        return;
     }
-    if (!removeItems.isEmpty())
+    // Stall this thread until there is room. This stops reading from the sockets, which applies backpressure to the clients.
+    while(!events_.TryPush(type, connection, data, numBytes))
     {
-        foreach(SocketEvent *existing, removeItems)
+        if ((int)stopping_)
         {
-            events_.removeAll(existing);
-            SAFE_DELETE(existing);
+            if (type == SocketEvent::Data)
+                droppedMessages_.ref();
+            return;
         }
-        removeItems.clear();
+        kNet::Clock::Sleep(1);
     }
+}
 
-    events_ << new SocketEvent(connectionPtr, SocketEvent::Connected);
-        
-    mutexEvents_.unlock();
+void Server::OnConnected(ConnectionHandle connection)
+{
+    PushEvent(SocketEvent::Connected, server_->get_con_from_hdl(connection));
 }
 
 void Server::OnDisconnected(ConnectionHandle connection)
 {
-    QMutexLocker lock(&mutexEvents_);
-
-    ConnectionPtr connectionPtr = server_->get_con_from_hdl(connection);
-
-    // Find existing events and remove them if we got duplicates 
-    // that were not synced to main thread yet.
-    QList<SocketEvent*> removeItems;
-    for (int i=0; i<events_.size(); ++i)
-    {
-        // Remove any and all messages from this connection, 
-        // no need to process he is disconnecting
-        SocketEvent *existing = events_[i];
-        if (existing->connection == connectionPtr)
-            removeItems << existing;
-    }
-    if (!removeItems.isEmpty())
-    {
-        foreach(SocketEvent *existing, removeItems)
-        {
-            events_.removeAll(existing);
-            SAFE_DELETE(existing);
-        }
-        removeItems.clear();
-    }
-
-    events_ << new SocketEvent(connectionPtr, SocketEvent::Disconnected);
+    // Events already queued for the connection are processed first, in order.
+    PushEvent(SocketEvent::Disconnected, server_->get_con_from_hdl(connection));
 }
 
 void Server::OnMessage(ConnectionHandle connection, MessagePtr data)
 {   
-    QMutexLocker lock(&mutexEvents_);
-
-    ConnectionPtr connectionPtr = server_->get_con_from_hdl(connection);
-
     if (data->get_opcode() == websocketpp::frame::opcode::TEXT)
     {
         QByteArray buffer = QString::fromStdString(data->get_payload()).toUtf8();
@@ -422,11 +532,7 @@ void Server::OnMessage(ConnectionHandle connection, MessagePtr data)
             LogError("[WebSocketServer]: Received 0 sized payload, ignoring");
             return;
         }
-        SocketEvent *event = new SocketEvent(connectionPtr, SocketEvent::Data);
-        event->data = DataSerializerPtr(new kNet::DataSerializer(payload.size()));
-        event->data->AddAlignedByteArray(&payload[0], payload.size());
-
-        events_ << event;
+        PushEvent(SocketEvent::Data, server_->get_con_from_hdl(connection), payload.data(), payload.size());
     }
 }
 
@@ -435,6 +541,14 @@ void Server::OnScriptEngineCreated(QScriptEngine *engine)
     RegisterWebSocketPluginMetaTypes(engine);
 }
 
+void Server::FlushSends()
+{
+    PROFILE(WebSocketServer_FlushSends);
+    for(UserConnectionList::iterator iter = connections_.begin(); iter != connections_.end(); ++iter)
+        if (*iter)
+            (*iter)->FlushSends(sendSettings_);
+}
+
 
 /// \todo Implement actual registering of http handlers, for now disabled
 /*
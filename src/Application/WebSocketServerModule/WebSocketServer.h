@@ -20,13 +20,15 @@
 #include <QStringList>
 #include <QFileInfo>
 #include <QDateTime>
-#include <QMutex>
+#include <QAtomicInt>
 
 #include <websocketpp/config/asio_no_tls.hpp>
 #include <websocketpp/server.hpp>
 #include "kNet/DataSerializer.h"
 #include "boost/weak_ptr.hpp"
 
+#include <vector>
+
 class QScriptEngine;
 
 namespace WebSocket
@@ -36,6 +38,7 @@ namespace WebSocket
     typedef boost::weak_ptr<websocketpp::server<websocketpp::config::asio>::connection_type> ConnectionWeakPtr;
     typedef websocketpp::connection_hdl ConnectionHandle;
     typedef websocketpp::server<websocketpp::config::asio>::message_ptr MessagePtr;
+    typedef websocketpp::config::asio::message_type MessageType;
     typedef shared_ptr<kNet::DataSerializer> DataSerializerPtr;
     
     // WebSocket events
@@ -50,11 +53,68 @@ namespace WebSocket
         };
 
         WebSocket::ConnectionPtr connection;
-        DataSerializerPtr data;
+        /// Payload of a Data event. Keeps its capacity when the event is reused, so that receiving does not allocate in the steady state.
+        /** A capacity above EventQueue::cMaxRetainedPayloadSize is freed when the event is released. */
+        std::vector<char> data;
         EventType type;
 
         SocketEvent() : type(None) {}
-        SocketEvent(WebSocket::ConnectionPtr connection_, EventType type_) : connection(connection_), type(type_) {}
+    };
+
+    /// Settings of the outbound path of the user connections.
+    struct SendSettings
+    {
+        size_t maxBufferedBytes; ///< Unsent bytes after which a client is considered stalled and disconnected, 0 for no limit.
+        int compressionLevel; ///< zlib compression level of the frames to clients with ProtocolCompressedFrames, 0 to disable.
+        size_t compressionMinSize; ///< Frames smaller than this are sent uncompressed.
+
+        SendSettings() : maxBufferedBytes(4 * 1024 * 1024), compressionLevel(6), compressionMinSize(256) {}
+    };
+
+    /// Bounded lock-free queue of socket events from the websocket thread(s) to the main thread.
+    /** Multiple producers, single consumer. A producer claims a slot with a compare-and-swap on the enqueue position and copies
+        the event into the slot's preallocated SocketEvent, then publishes it by advancing the slot's sequence number.
+        The main thread reads the events in place with Front() and hands the slots back with PopFront(). */
+    class EventQueue
+    {
+    public:
+        EventQueue();
+        ~EventQueue();
+
+        /// Allocates the given number of slots, rounded up to a power of two, discarding any queued events.
+        /** Must not be called while the websocket thread is running. */
+        void Allocate(uint capacity);
+
+        /// Queues an event. Can be called from any thread.
+        /** @return False if the queue is full. */
+        bool TryPush(SocketEvent::EventType type, const WebSocket::ConnectionPtr &connection, const char *data, size_t numBytes);
+
+        /// Returns the oldest queued event, or null if there is none. Main thread only.
+        SocketEvent *Front();
+        /// Releases the event returned by Front() for reuse. Main thread only.
+        void PopFront();
+        /// Discards all queued events. Main thread only.
+        void Clear();
+
+        /// Returns the number of slots.
+        uint Capacity() const { return mask_ + 1; }
+        /// Returns the number of queued events, including the ones being written by the producers.
+        uint Size() const { return (uint)(int)enqueuePos_ - dequeuePos_; }
+
+        /// Largest payload capacity a slot keeps for reuse, in bytes. The memory retained by the queue is at most this times the number of slots.
+        static const size_t cMaxRetainedPayloadSize = 4 * 1024;
+
+    private:
+        struct Slot
+        {
+            QAtomicInt sequence; ///< Equals the enqueue position when the slot is free, and the position + 1 when it holds an event.
+            SocketEvent event;
+        };
+
+        Slot *slots_;
+        uint mask_;
+        QAtomicInt enqueuePos_;
+        uint dequeuePos_;
     };
 
     /// Server run thread
@@ -99,6 +159,9 @@ namespace WebSocket
     private slots:
         void OnScriptEngineCreated(QScriptEngine *engine);
 
+        /// Hands the messages queued to the user connections during the frame over to the websocket thread.
+        void FlushSends();
+
     signals:
         /// The server has been started
         void ServerStarted();
@@ -112,6 +175,9 @@ namespace WebSocket
     protected:
         void Reset();
 
+        /// Queues an event for the main thread. Applies the queue full policy if the main thread has fallen behind.
+        void PushEvent(SocketEvent::EventType type, WebSocket::ConnectionPtr connection, const char *data = 0, size_t numBytes = 0);
+
         void OnConnected(WebSocket::ConnectionHandle connection);
         void OnDisconnected(WebSocket::ConnectionHandle connection);
         void OnMessage(WebSocket::ConnectionHandle connection, WebSocket::MessagePtr data);
@@ -131,7 +197,13 @@ namespace WebSocket
 
         ServerThread thread_;
 
-        QMutex mutexEvents_;
-        QList<SocketEvent*> events_;
+        // Events pushed from the websocket thread(s), processed in Update()
+        EventQueue events_;
+        uint highWaterMark_; ///< Queued event count above which Update() warns that the main thread is falling behind.
+        bool aboveHighWaterMark_;
+        bool dropWhenFull_; ///< Whether data messages are dropped when the event queue is full, instead of stalling the websocket thread.
+        QAtomicInt droppedMessages_;
+        QAtomicInt stopping_; ///< Set when stopping, so that a stalled websocket thread gives up.
+        SendSettings sendSettings_;
     };
 }
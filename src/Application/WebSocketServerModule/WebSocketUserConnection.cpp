@@ -1,6 +1,7 @@
 
 #include "WebSocketUserConnection.h"
 #include "LoggingFunctions.h"
+#include "TundraMessages.h"
 
 #include "kNet/DataDeserializer.h"
 #include "kNet/DataSerializer.h"
@@ -8,11 +9,72 @@
 #include <websocketpp/frame.hpp>
 
 #include <QTimer>
+#include <QByteArray>
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
 
 namespace WebSocket
 {
 
-UserConnection::UserConnection(ConnectionPtr connection_)
+namespace
+{
+
+// Replaces the frame with a CompressedMessage, if that is smaller
+void CompressFrame(std::string &payload, int level)
+{
+    QByteArray compressed = qCompress((const uchar*)payload.data(), (int)payload.size(), level);
+    if ((size_t)compressed.size() + sizeof(u16) >= payload.size())
+        return;
+    char header[sizeof(u16)];
+    kNet::DataSerializer headerDs(header, sizeof(header));
+    headerDs.Add<u16>((u16)cCompressedMessage);
+    payload.assign(header, sizeof(header));
+    payload.append(compressed.constData(), (size_t)compressed.size());
+}
+
+// Runs in the websocket thread. Passes the frames to websocketpp, unless the client has fallen too far behind
+void SendFrames(ConnectionWeakPtr connection, std::vector<MessagePtr> frames, int numBytes, shared_ptr<QAtomicInt> queuedBytes,
+    shared_ptr<QAtomicInt> bufferedBytes, SendSettings settings)
+{
+    queuedBytes->fetchAndAddRelaxed(-numBytes);
+    ConnectionPtr con = connection.lock();
+    if (!con)
+        return;
+    bufferedBytes->fetchAndStoreRelaxed((int)con->get_buffered_amount());
+    if (settings.maxBufferedBytes > 0 && con->get_buffered_amount() > settings.maxBufferedBytes)
+    {
+        LogWarning(QString("[WebSocketUserConnection]: Client has %1 unsent bytes, closing the connection.").arg(con->get_buffered_amount()));
+        con->close(websocketpp::close::status::policy_violation, "Send buffer full");
+        return;
+    }
+    for(size_t i = 0; i < frames.size(); ++i)
+    {
+        if (settings.compressionLevel > 0 && frames[i]->get_payload().size() >= settings.compressionMinSize)
+            CompressFrame(frames[i]->get_raw_payload(), settings.compressionLevel);
+        websocketpp::lib::error_code ec = con->send(frames[i]);
+        if (ec)
+            return;
+    }
+}
+
+// Runs in the websocket thread, after any frames queued before it
+void CloseConnection(ConnectionWeakPtr connection)
+{
+    ConnectionPtr con = connection.lock();
+    if (con)
+        con->close(websocketpp::close::status::normal, "ok");
+}
+
+}
+
+UserConnection::UserConnection(WebSocket::ServerPtr server, ConnectionPtr connection_) :
+    server_(server),
+    gathering_(false),
+    lastMessageId_(0),
+    queuedBytes_(new QAtomicInt(0)),
+    bufferedBytes_(new QAtomicInt(0))
 {
     webSocketConnection = ConnectionWeakPtr(connection_);
 }
@@ -23,13 +85,56 @@ UserConnection::~UserConnection()
     syncState.reset();
 }
 
+std::string &UserConnection::NewFrame(size_t reserve)
+{
+    frames_.push_back(MessagePtr(new MessageType(MessageType::con_msg_man_ptr(), websocketpp::frame::opcode::BINARY, reserve)));
+    return frames_.back()->get_raw_payload();
+}
+
 void UserConnection::Send(kNet::message_id_t id, const char* data, size_t numBytes, bool reliable, bool inOrder, unsigned long priority, unsigned long contentID)
 {
-    kNet::DataSerializer ds(numBytes + 2);
-    ds.Add<u16>(id);
+    if (webSocketConnection.expired())
+        return;
+
+    char header[2 * 5 + sizeof(u16)];
+    const bool canGather = protocolVersion >= ProtocolGatheredFrames;
+    if (canGather && !frames_.empty() && (gathering_ || lastMessageId_ != 0))
+    {
+        std::string &payload = frames_.back()->get_raw_payload();
+        if (!gathering_)
+        {
+            // Turn the lone message of the frame into the first entry of a BatchedSceneMessage
+            kNet::DataSerializer headerDs(header, sizeof(header));
+            headerDs.Add<u16>((u16)cBatchedSceneMessage);
+            if (lastMessageId_ != cBatchedSceneMessage)
+            {
+                headerDs.AddVLE<kNet::VLE8_16_32>(lastMessageId_);
+                headerDs.AddVLE<kNet::VLE8_16_32>((u32)(payload.size() - sizeof(u16)));
+            }
+            payload.replace(0, sizeof(u16), header, headerDs.BytesFilled());
+            gathering_ = true;
+        }
+        // The entries of a BatchedSceneMessage are spliced in as is
+        if (id != cBatchedSceneMessage)
+        {
+            kNet::DataSerializer headerDs(header, sizeof(header));
+            headerDs.AddVLE<kNet::VLE8_16_32>(id);
+            headerDs.AddVLE<kNet::VLE8_16_32>((u32)numBytes);
+            payload.append(header, headerDs.BytesFilled());
+        }
+        if (numBytes)
+            payload.append(data, numBytes);
+        return;
+    }
+
+    std::string &payload = NewFrame(numBytes + sizeof(u16));
+    kNet::DataSerializer headerDs(header, sizeof(header));
+    headerDs.Add<u16>((u16)id);
+    payload.append(header, headerDs.BytesFilled());
     if (numBytes)
-        ds.AddAlignedByteArray(data, numBytes);
-    Send(ds);
+        payload.append(data, numBytes);
+    gathering_ = false;
+    lastMessageId_ = canGather ? id : 0;
 }
 
 ConnectionPtr UserConnection::WebSocketConnection() const
@@ -43,14 +148,64 @@ void UserConnection::Send(const kNet::DataSerializer &data)
         return;
     if (data.BytesFilled() == 0)
         return;
-    
-    webSocketConnection.lock()->send(static_cast<void*>(data.GetData()), static_cast<uint64_t>(data.BytesFilled()));
+
+    // Sent as its own frame, not gathered with the other messages
+    NewFrame(data.BytesFilled()).append(data.GetData(), data.BytesFilled());
+    gathering_ = false;
+    lastMessageId_ = 0;
+}
+
+void UserConnection::FlushSends(const SendSettings &settings)
+{
+    sendSettings_ = settings;
+    gathering_ = false;
+    lastMessageId_ = 0;
+    if (frames_.empty())
+        return;
+    if (webSocketConnection.expired() || !server_)
+    {
+        frames_.clear();
+        return;
+    }
+
+    int numBytes = 0;
+    for(size_t i = 0; i < frames_.size(); ++i)
+        numBytes += (int)frames_[i]->get_payload().size();
+
+    // Frames waiting for the websocket thread count against the limit too, in case it is stalled
+    if (settings.maxBufferedBytes > 0 && (size_t)((int)*queuedBytes_ + numBytes) > settings.maxBufferedBytes)
+    {
+        LogWarning(QString("[WebSocketUserConnection]: Connection ID %1 is not keeping up, closing the connection.").arg(userID));
+        frames_.clear();
+        Disconnect();
+        return;
+    }
+
+    SendSettings sendSettings = settings;
+    if (protocolVersion < ProtocolCompressedFrames)
+        sendSettings.compressionLevel = 0;
+    queuedBytes_->fetchAndAddRelaxed(numBytes);
+    std::vector<MessagePtr> frames;
+    frames.swap(frames_);
+    server_->get_io_service().post(boost::bind(&SendFrames, webSocketConnection, frames, numBytes, queuedBytes_, bufferedBytes_, sendSettings));
+}
+
+UserConnectionStats UserConnection::Statistics() const
+{
+    UserConnectionStats stats;
+    stats.queuedBytes = (size_t)std::max((int)*queuedBytes_, 0) + (size_t)(int)*bufferedBytes_;
+    return stats;
 }
 
 void UserConnection::Disconnect()
 {
-    if (!webSocketConnection.expired())
-        webSocketConnection.lock()->close(websocketpp::close::status::normal, "ok");
+    if (webSocketConnection.expired() || !server_)
+        return;
+    // Close from the websocket thread, so that the frames queued so far are sent first
+    SendSettings settings = sendSettings_;
+    settings.maxBufferedBytes = 0;
+    FlushSends(settings);
+    server_->get_io_service().post(boost::bind(&CloseConnection, webSocketConnection));
 }
 
 void UserConnection::Close()
@@ -65,4 +220,4 @@ void UserConnection::DisconnectDelayed(int msec)
     QTimer::singleShot(msec, this, SLOT(Disconnect()));
 }
 
-}
\ No newline at end of file
+}
@@ -16,26 +16,44 @@
 #include <QHash>
 #include <QString>
 #include <QVariant>
+#include <QAtomicInt>
+
+#include <vector>
 
 namespace WebSocket
 {
+    /// WebSocket user connection.
+    /** Outbound messages are written directly into the payloads of websocketpp messages, which FlushSends() hands over to
+        the websocket thread once per frame. For clients with protocol version ProtocolGatheredFrames or newer, all messages
+        of a frame are gathered into a single BatchedSceneMessage frame; the entries of BatchedSceneMessages from the scene
+        sync are spliced in as is. For clients with ProtocolCompressedFrames, frames of at least SendSettings::compressionMinSize
+        bytes are sent as CompressedMessages when that makes them smaller. */
     class WEBSOCKET_SERVER_MODULE_API UserConnection : public ::UserConnection
     {
         Q_OBJECT
 
     public:
-        UserConnection(ConnectionPtr connection_);
+        UserConnection(WebSocket::ServerPtr server, ConnectionPtr connection_);
         ~UserConnection();
 
         virtual QString ConnectionType() const { return "websocket"; }
 
         ConnectionPtr WebSocketConnection() const;
 
+        /// Queue a raw WebSocket frame, which starts with the message ID, to be sent to the client.
         void Send(const kNet::DataSerializer &data);
 
         /// Queue a network message to be sent to the client. All implementations may not use the reliable, inOrder, priority and contentID parameters.
         virtual void Send(kNet::message_id_t id, const char* data, size_t numBytes, bool reliable, bool inOrder, unsigned long priority = 100, unsigned long contentID = 0);
 
+        /// Hands the queued frames over to the websocket thread for sending. Called by Server after each frame.
+        /** If the connection has more than settings.maxBufferedBytes waiting to be sent, the client is not keeping up and
+            is disconnected. Frames to clients with ProtocolCompressedFrames are compressed in the websocket thread. */
+        void FlushSends(const SendSettings &settings);
+
+        /// Returns the number of bytes queued for sending, including the send buffer of websocketpp as of the latest send.
+        virtual UserConnectionStats Statistics() const;
+
         ConnectionWeakPtr webSocketConnection;
 
     public slots:
@@ -43,7 +61,17 @@ namespace WebSocket
         virtual void Close();
 
         void DisconnectDelayed(int msec = 1000);
-        
-        
+
+    private:
+        /// Starts a new queued frame and returns its payload.
+        std::string &NewFrame(size_t reserve);
+
+        WebSocket::ServerPtr server_;
+        std::vector<WebSocket::MessagePtr> frames_; ///< Frames queued during this frame.
+        bool gathering_; ///< Whether the last queued frame is a BatchedSceneMessage that further messages can be appended to.
+        kNet::message_id_t lastMessageId_; ///< ID of the only message in the last queued frame, if it is not yet a BatchedSceneMessage.
+        shared_ptr<QAtomicInt> queuedBytes_; ///< Bytes handed over to the websocket thread but not yet to websocketpp.
+        shared_ptr<QAtomicInt> bufferedBytes_; ///< Bytes in the send buffer of websocketpp after the latest send, updated by the websocket thread.
+        SendSettings sendSettings_; ///< Settings of the latest FlushSends().
     };
 }
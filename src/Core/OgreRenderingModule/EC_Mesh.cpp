@@ -56,6 +56,7 @@ EC_Mesh::EC_Mesh(Scene* scene) :
 
     static AttributeMetadata materialMetadata;
     materialMetadata.elementType = "AssetReference";
+    materialMetadata.maxReplicationRate = 5.f;
     meshMaterial.SetMetadata(&materialMetadata);
 
     meshAsset = AssetRefListenerPtr(new AssetRefListener());
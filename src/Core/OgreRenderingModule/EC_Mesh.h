@@ -117,7 +117,7 @@ public:
     Q_PROPERTY(AssetReference skeletonRef READ getskeletonRef WRITE setskeletonRef);
     DEFINE_QPROPERTY_ATTRIBUTE(AssetReference, skeletonRef);
 
-    /// Mesh material asset reference list.
+    /// Mesh material asset reference list. The changes are replicated at most 5 times per second.
     Q_PROPERTY(AssetReferenceList meshMaterial READ getmeshMaterial WRITE setmeshMaterial);
     DEFINE_QPROPERTY_ATTRIBUTE(AssetReferenceList, meshMaterial);
 
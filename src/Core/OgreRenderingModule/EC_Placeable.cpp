@@ -179,6 +179,7 @@ EC_Placeable::EC_Placeable(Scene* scene) :
     boneAttachmentNode_(0),
     parentBone_(0),
     parentPlaceable_(0),
+    localToWorldDirty_(true),
     parentMesh_(0),
     attached_(false),
     INIT_ATTRIBUTE(transform, "Transform"),
@@ -198,6 +199,7 @@ EC_Placeable::EC_Placeable(Scene* scene) :
     if(!metadataInitialized)
     {
         transAttrData.interpolation = AttributeMetadata::Interpolate;
+        transAttrData.latestValueWins = true;
         nonDesignableAttrData.designable = false;
         metadataInitialized = true;
     }
@@ -223,6 +225,7 @@ EC_Placeable::~EC_Placeable()
     {
         if (sceneNode_)
             LogError("EC_Placeable: World has expired, skipping uninitialization!");
+        ClearParentPlaceableLinks();
         return;
     }
     
@@ -245,6 +248,8 @@ EC_Placeable::~EC_Placeable()
         sceneMgr->destroySceneNode(boneAttachmentNode_);
         boneAttachmentNode_ = 0;
     }
+    
+    ClearParentPlaceableLinks();
 }
 
 void EC_Placeable::AttachNode()
@@ -320,8 +325,12 @@ void EC_Placeable::AttachNode()
                             // We also need to listen to the parent placeable's transform changes, in case there are no animations playing in the parent skeletal mesh
                             // (in that case bones don't get automatically updated)
                             EC_Placeable* parentPlaceable = parentEntity->GetComponent<EC_Placeable>().get();
-                            parentPlaceable_ = parentPlaceable;
-                            connect(parentPlaceable_, SIGNAL(TransformChanged()), this, SLOT(OnParentPlaceableTransformChanged()), Qt::UniqueConnection);
+                            SetParentPlaceable(parentPlaceable);
+                            if (parentPlaceable_)
+                            {
+                                connect(parentPlaceable_, SIGNAL(TransformChanged()), this, SLOT(OnParentPlaceableTransformChanged()), Qt::UniqueConnection);
+                                connect(parentPlaceable_, SIGNAL(AboutToBeDestroyed()), this, SLOT(OnParentPlaceableDestroyed()), Qt::UniqueConnection);
+                            }
 
                             parentBone_ = bone;
                             parentMesh_ = parentMesh;
@@ -363,7 +372,7 @@ void EC_Placeable::AttachNode()
                         parentCheck = parentCheck->parentPlaceable_;
                     }
                     
-                    parentPlaceable_ = parentPlaceable;
+                    SetParentPlaceable(parentPlaceable);
                     parentPlaceable_->GetSceneNode()->addChild(sceneNode_);
                     
                     // Connect to destruction of the placeable to be able to detach gracefully
@@ -420,19 +429,23 @@ void EC_Placeable::DetachNode()
         if (parentBone_)
         {
             // Stop listening to parent placeable's transform changes for manual non-animating update
-            disconnect(parentPlaceable_, SIGNAL(TransformChanged()), this, SLOT(OnParentPlaceableTransformChanged()));
+            if (parentPlaceable_)
+            {
+                disconnect(parentPlaceable_, SIGNAL(TransformChanged()), this, SLOT(OnParentPlaceableTransformChanged()));
+                disconnect(parentPlaceable_, SIGNAL(AboutToBeDestroyed()), this, SLOT(OnParentPlaceableDestroyed()));
+            }
             disconnect(parentMesh_, SIGNAL(MeshAboutToBeDestroyed()), this, SLOT(OnParentMeshDestroyed()));
             attachmentListener.RemoveAttachment(parentBone_, this);
             boneAttachmentNode_->removeChild(sceneNode_);
             parentBone_ = 0;
             parentMesh_ = 0;
-            parentPlaceable_ = 0;
+            SetParentPlaceable(0);
         }
         else if (parentPlaceable_)
         {
             disconnect(parentPlaceable_, SIGNAL(AboutToBeDestroyed()), this, SLOT(OnParentPlaceableDestroyed()));
             parentPlaceable_->GetSceneNode()->removeChild(sceneNode_);
-            parentPlaceable_ = 0;
+            SetParentPlaceable(0);
         }
         else
             root_node->removeChild(sceneNode_);
@@ -445,6 +458,37 @@ void EC_Placeable::DetachNode()
     }
 }
 
+void EC_Placeable::SetParentPlaceable(EC_Placeable *parent)
+{
+    if (parentPlaceable_)
+    {
+        std::vector<EC_Placeable*> &siblings = parentPlaceable_->childPlaceables_;
+        siblings.erase(std::remove(siblings.begin(), siblings.end(), this), siblings.end());
+    }
+    parentPlaceable_ = parent;
+    if (parentPlaceable_)
+        parentPlaceable_->childPlaceables_.push_back(this);
+    InvalidateLocalToWorld();
+}
+
+void EC_Placeable::ClearParentPlaceableLinks()
+{
+    // Normally the children have detached already on AboutToBeDestroyed, but without an Ogre world they can not,
+    // so make sure that no placeable is left pointing to this one.
+    for(size_t i = 0; i < childPlaceables_.size(); ++i)
+    {
+        childPlaceables_[i]->parentPlaceable_ = 0;
+        childPlaceables_[i]->InvalidateLocalToWorld();
+    }
+    childPlaceables_.clear();
+    if (parentPlaceable_)
+    {
+        std::vector<EC_Placeable*> &siblings = parentPlaceable_->childPlaceables_;
+        siblings.erase(std::remove(siblings.begin(), siblings.end(), this), siblings.end());
+        parentPlaceable_ = 0;
+    }
+}
+
 void EC_Placeable::Show()
 {
     if (!sceneNode_)
@@ -694,6 +738,7 @@ void EC_Placeable::AttributesChanged()
     if (transform.ValueChanged())
     {
         transform.ClearChangedFlag();
+        InvalidateLocalToWorld();
         const Transform& trans = transform.Get();
         if (trans.pos.IsFinite())
             sceneNode_->setPosition(trans.pos);
@@ -979,10 +1024,32 @@ float3x4 EC_Placeable::LocalToWorld() const
     if (!parentBone.Get().isEmpty() && sceneNode_)
         return float4x4(sceneNode_->_getFullTransform()).Float3x4Part();
 
-    // Otherwise, compute the world matrix using our Tundra scene structures (not the Ogre scene structures, which can be out-of-date!)
+    // A transform set without signaling the change has not invalidated the cached matrix yet
+    if (transform.ValueChanged())
+        InvalidateLocalToWorld();
+    if (localToWorldDirty_)
+        UpdateLocalToWorld();
+    return localToWorld_;
+}
+
+void EC_Placeable::InvalidateLocalToWorld() const
+{
+    // If already out of date, so are the children
+    if (localToWorldDirty_)
+        return;
+    localToWorldDirty_ = true;
+    for(size_t i = 0; i < childPlaceables_.size(); ++i)
+        childPlaceables_[i]->InvalidateLocalToWorld();
+}
+
+void EC_Placeable::UpdateLocalToWorld() const
+{
+    // Compute the world matrix using our Tundra scene structures (not the Ogre scene structures, which can be out-of-date!)
     EC_Placeable *parentPlaceable = ParentPlaceableComponent();
     assert(parentPlaceable != this);
-    float3x4 localToWorld = parentPlaceable ? (parentPlaceable->LocalToWorld() * LocalToParent()) : LocalToParent();
+    localToWorld_ = parentPlaceable ? (parentPlaceable->LocalToWorld() * LocalToParent()) : LocalToParent();
+    // A parent attached to a bone is moved by Ogre without notice, so stay out of date along with it
+    localToWorldDirty_ = parentPlaceable && parentPlaceable->localToWorldDirty_;
 
 #ifdef _DEBUG
     // But confirm to detect oddities when/if these two don't match.
@@ -991,14 +1058,12 @@ float3x4 EC_Placeable::LocalToWorld() const
         float3x4 ogresViewOfLocalToWorld = float4x4(sceneNode_->_getFullTransform()).Float3x4Part();
         float3 t, s, t2, s2;
         Quat r, r2;
-        localToWorld.Decompose(t, r, s);
+        localToWorld_.Decompose(t, r, s);
         ogresViewOfLocalToWorld.Decompose(t2, r2, s2);
         if (!t.Equals(t2) || !s.Equals(s2) || !r.Equals(r2))
             LogDebug("Warning: Ogre SceneNode transform does not agree with Tundra Scenenode transform in EC_Placeable::LocalToWorld!");
     }
 #endif
-
-    return localToWorld;
 }
 
 float3x4 EC_Placeable::WorldToLocal() const
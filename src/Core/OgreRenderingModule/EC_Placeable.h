@@ -9,8 +9,11 @@
 #include "OgreModuleFwd.h"
 #include "Transform.h"
 #include "Math/float3.h"
+#include "Math/float3x4.h"
 #include "Math/MathFwd.h"
 
+#include <vector>
+
 /// Ogre placeable (scene node) component
 /** <table class="header">
     <tr>
@@ -214,6 +217,9 @@ public slots:
     float3 Scale() const;
 
     /// Returns the concatenated world transformation of this placeable.
+    /** The world transformation is cached, and recomputed only after the transform of this placeable or of a parent changes, or the
+        placeable is reparented. A transform set with AttributeChange::Disconnected is seen by the children once its change is signaled.
+        Placeables attached to a bone, and their children, are not cached. */
     float3x4 LocalToWorld() const;
     /// Returns the matrix that transforms objects from world space into the local coordinate space of this placeable.
     float3x4 WorldToLocal() const;
@@ -329,6 +335,18 @@ private:
     
     /// detaches scenenode from parent
     void DetachNode();
+
+    /// Sets the parent placeable, and keeps the parent's list of child placeables up to date
+    void SetParentPlaceable(EC_Placeable *parent);
+
+    /// Unlinks this placeable from its parent and child placeables, so that none of them is left with a dangling pointer on destruction
+    void ClearParentPlaceableLinks();
+
+    /// Marks the cached world transformation of this placeable and its children out of date
+    void InvalidateLocalToWorld() const;
+
+    /// Recomputes the cached world transformation
+    void UpdateLocalToWorld() const;
     
     /// Ogre world ptr
     OgreWorldWeakPtr world_;
@@ -344,6 +362,15 @@ private:
     
     /// Parent placeable, if any
     EC_Placeable* parentPlaceable_;
+
+    /// Placeables attached to this placeable, ie. the placeables whose parent placeable this is
+    std::vector<EC_Placeable*> childPlaceables_;
+
+    /// Cached world transformation, valid when localToWorldDirty_ is false
+    mutable float3x4 localToWorld_;
+
+    /// Cached world transformation out of date -flag. Always set when a parent is, so a clean placeable has clean parents
+    mutable bool localToWorldDirty_;
     
     /// Parent mesh in bone attachment mode
     EC_Mesh* parentMesh_;
@@ -213,7 +213,22 @@ Framework::Framework(int argc_, char** argv_, Application *app) :
         cmdLineDescs.commands["--noCentralWidget"] = "Disables the usage of QMainWindow's central widget."; // Framework
         cmdLineDescs.commands["--noMenuBar"] = "Disables showing of the application menu bar automatically."; // Framework
         cmdLineDescs.commands["--clientExtrapolationTime"] = "Rigid body extrapolation time on client in milliseconds. Default 66."; // TundraProtocolModule
+        cmdLineDescs.commands["--createTimeBudget"] = "Milliseconds per frame the client spends creating the entities received from the server, nearest to the observer first. Default: 0 (create immediately)."; // TundraProtocolModule
+        cmdLineDescs.commands["--parallelSync"] = "Serializes the scene sync state of the client connections in parallel worker threads. Default: false."; // TundraProtocolModule
+        cmdLineDescs.commands["--syncThreads"] = "Number of worker threads used with --parallelSync. Default: number of CPU cores."; // TundraProtocolModule
+        cmdLineDescs.commands["--syncByteBudget"] = "Maximum number of bytes the scene sync sends to a client per network update. Entities that do not fit are deferred to the next update, highest priority first. Default: 0 (unlimited)."; // TundraProtocolModule
+        cmdLineDescs.commands["--syncMaxStarvationTime"] = "Maximum time in seconds a dirty entity can be deferred by the scene sync byte budget. Default: 2."; // TundraProtocolModule
+        cmdLineDescs.commands["--adaptiveNetrate"] = "Adapts the network update rate of each client to its round trip time, packet loss and send queue, between 4 Hz and the given maximum rate. Usage: '--adaptiveNetrate [maxRate]'. Default maximum: 60."; // TundraProtocolModule
+        cmdLineDescs.commands["--rigidBodyErrorThreshold"] = "Enables dead reckoning for rigid body replication: an entity's position is sent only when the client's extrapolation drifts further than this many world units. Default: 0 (disabled)."; // TundraProtocolModule
+        cmdLineDescs.commands["--recordNetworkTraffic"] = "Records the network messages received by the server into the given file, for replaying with --replayNetworkTraffic."; // TundraProtocolModule
+        cmdLineDescs.commands["--replayNetworkTraffic"] = "Replays a network traffic recording into the server started with --server, reports the server frame time and exits when done."; // TundraProtocolModule
+        cmdLineDescs.commands["--replaySpeed"] = "Speed factor of --replayNetworkTraffic, 0 for maximum speed. Default: 1."; // TundraProtocolModule
         cmdLineDescs.commands["--noClientPhysics"] = "Disables rigid body handoff to client simulation after no movement packets received from server."; // TundraProtocolModule
+        cmdLineDescs.commands["--wsEventQueueSize"] = "Number of inbound WebSocket events the server buffers between frames, rounded up to a power of two. Default: 4096."; // WebSocketServerModule
+        cmdLineDescs.commands["--wsDropWhenFull"] = "Drops WebSocket messages when the inbound event queue is full, instead of stalling the reads until the main thread catches up."; // WebSocketServerModule
+        cmdLineDescs.commands["--wsMaxSendBuffer"] = "Number of unsent bytes after which a WebSocket client is considered stalled and disconnected, 0 for no limit. Default: 4194304."; // WebSocketServerModule
+        cmdLineDescs.commands["--wsCompressionLevel"] = "zlib compression level (0-9) of the frames sent to WebSocket clients that support compression, 0 to disable. Default: 6."; // WebSocketServerModule
+        cmdLineDescs.commands["--wsCompressionMinSize"] = "Size in bytes below which frames to WebSocket clients are sent uncompressed. Default: 256."; // WebSocketServerModule
         cmdLineDescs.commands["--dumpProfiler"] = "Dump profiling blocks to console every 5 seconds."; // DebugStatsModule
         cmdLineDescs.commands["--acceptUnknownLocalSources"] = "If specified, assets outside any known local storages are allowed. Otherwise, requests to them will fail."; // AssetModule
         cmdLineDescs.commands["--acceptUnknownHttpSources"] = "If specified, asset requests outside any registered HTTP storages are also accepted, and will appear as assets with no storage. "
@@ -59,7 +59,7 @@ public:
     typedef std::map<int, QString> EnumDescMap_t;
 
     /// Default constructor.
-    AttributeMetadata() : interpolation(None), designable(true) {}
+    AttributeMetadata() : interpolation(None), designable(true), latestValueWins(false), maxReplicationRate(0.f) {}
 
     /// Constructor.
     /** @param desc Description.
@@ -77,7 +77,9 @@ public:
         step(step_),
         enums(enum_desc),
         interpolation(interpolation_),
-        designable(designable_)
+        designable(designable_),
+        latestValueWins(false),
+        maxReplicationRate(0.f)
     {
     }
 
@@ -111,6 +113,15 @@ public:
     /// Indicates if Attribute should be shown in designer/editor ui.
     bool designable;
 
+    /// Indicates that only the latest value of the attribute matters in replication, so that outdated updates which have not been sent yet may be dropped.
+    /** Applies to kNet connections in both directions. The transform of EC_Placeable is sent in the rigid body update of its entity,
+        the other attributes in an edit attributes message of their own. */
+    bool latestValueWins;
+
+    /// Maximum number of times per second the changes of the attribute are replicated to each peer, 0 (default) for no limit.
+    /** Changes made within the interval are coalesced, and the latest value is sent when the interval expires. */
+    float maxReplicationRate;
+
 private:
     AttributeMetadata(const AttributeMetadata &);
     void operator=(const AttributeMetadata &);
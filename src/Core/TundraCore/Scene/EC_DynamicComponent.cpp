@@ -5,6 +5,7 @@
 #include "EC_DynamicComponent.h"
 
 #include "SceneAPI.h"
+#include "AttributeMetadata.h"
 
 #include "Entity.h"
 #include "LoggingFunctions.h"
@@ -55,6 +56,8 @@ EC_DynamicComponent::EC_DynamicComponent(Scene* scene):
 
 EC_DynamicComponent::~EC_DynamicComponent()
 {
+    for(AttributeMetadataMap::iterator iter = attributeMetadata_.begin(); iter != attributeMetadata_.end(); ++iter)
+        delete iter->second;
 }
 
 void EC_DynamicComponent::DeserializeFrom(QDomElement& element, AttributeChange::Type change)
@@ -183,6 +186,13 @@ void EC_DynamicComponent::RemoveAttribute(const QString &id, AttributeChange::Ty
             IComponent::RemoveAttribute((*iter)->Index(), change);
             break;
         }
+
+    AttributeMetadataMap::iterator metadata = attributeMetadata_.find(id.toLower());
+    if (metadata != attributeMetadata_.end())
+    {
+        delete metadata->second;
+        attributeMetadata_.erase(metadata);
+    }
 }
 
 void EC_DynamicComponent::RemoveAllAttributes(AttributeChange::Type change)
@@ -192,6 +202,33 @@ void EC_DynamicComponent::RemoveAllAttributes(AttributeChange::Type change)
             IComponent::RemoveAttribute((*iter)->Index(), change);
 
     attributes.clear();
+
+    for(AttributeMetadataMap::iterator iter = attributeMetadata_.begin(); iter != attributeMetadata_.end(); ++iter)
+        delete iter->second;
+    attributeMetadata_.clear();
+}
+
+void EC_DynamicComponent::SetAttributeMaxReplicationRate(const QString &id, float rate)
+{
+    IAttribute *attribute = IComponent::AttributeById(id);
+    if (!attribute)
+    {
+        LogError("EC_DynamicComponent::SetAttributeMaxReplicationRate: No attribute with ID \"" + id + "\" in dynamic component \"" + Name() + "\".");
+        return;
+    }
+
+    AttributeMetadata *&metadata = attributeMetadata_[id.toLower()];
+    if (!metadata)
+        metadata = new AttributeMetadata();
+    metadata->maxReplicationRate = std::max(rate, 0.f);
+    attribute->SetMetadata(metadata);
+}
+
+float EC_DynamicComponent::AttributeMaxReplicationRate(const QString &id) const
+{
+    IAttribute *attribute = IComponent::AttributeById(id);
+    const AttributeMetadata *metadata = attribute ? attribute->Metadata() : 0;
+    return metadata ? metadata->maxReplicationRate : 0.f;
 }
 
 int EC_DynamicComponent::GetInternalAttributeIndex(int index) const
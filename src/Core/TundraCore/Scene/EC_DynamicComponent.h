@@ -8,6 +8,8 @@
 
 #include <QVariant>
 
+#include <map>
+
 namespace kNet
 {
     class DataSerializer;
@@ -48,6 +50,8 @@ struct DeserializeData;
     <li>"RemoveAttribute": @copydoc RemoveAttribute
     <li>"ContainsAttribute": @copydoc ContainsAttribute
     <li>"RemoveAllAttributes": @copydoc RemoveAllAttributes
+    <li>"SetAttributeMaxReplicationRate": @copydoc SetAttributeMaxReplicationRate
+    <li>"AttributeMaxReplicationRate": @copydoc AttributeMaxReplicationRate
     </ul>
 
     Does not react on entity actions.
@@ -131,6 +135,18 @@ public slots:
     /// Removes all attributes from the component
     void RemoveAllAttributes(AttributeChange::Type change = AttributeChange::Default);
 
+    /// Sets the maximum number of times per second the changes of an attribute are replicated to each peer, 0 for no limit.
+    /** Changes made within the interval are coalesced, and the latest value is sent when the interval expires.
+        The limit is not replicated. It applies to the changes this peer sends, so set it on the server to cap the updates sent to the clients.
+        @param id ID of the attribute, case-insensitive.
+        @param rate Maximum number of updates per second.
+        @sa AttributeMetadata::maxReplicationRate */
+    void SetAttributeMaxReplicationRate(const QString &id, float rate);
+
+    /// Returns the maximum number of times per second the changes of an attribute are replicated to each peer, 0 if there is no limit.
+    /** @param id ID of the attribute, case-insensitive. */
+    float AttributeMaxReplicationRate(const QString &id) const;
+
     // DEPRECATED
     void AddQVariantAttribute(const QString &id, AttributeChange::Type change = AttributeChange::Default); /**< @deprecated Use CreateAttribute('qvariant') @todo Remove */
     void SetAttributeQScript(const QString &id, const QScriptValue &value, AttributeChange::Type change = AttributeChange::Default); /**< @deprecated Use SetAttribute @todo Remove */
@@ -143,4 +159,8 @@ private:
     void DeserializeCommon(std::vector<DeserializeData>& deserializedAttributes, AttributeChange::Type change);
     /// Convert attribute index without holes (used by client) into actual attribute index. Returns below zero if not found. Requires a linear search.
     int GetInternalAttributeIndex(int index) const;
+
+    typedef std::map<QString, AttributeMetadata*> AttributeMetadataMap;
+    /// Metadata owned by this component for its attributes, by lower case attribute ID.
+    AttributeMetadataMap attributeMetadata_;
 };
@@ -0,0 +1,27 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   EC_Name.cpp
+    @brief  EC_Name provides network-synchronizable means of identification for entities in addition to the plain ID number. */
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+#include "EC_Name.h"
+
+#include "AttributeMetadata.h"
+
+#include "MemoryLeakCheck.h"
+
+EC_Name::EC_Name(Scene* scene) :
+    IComponent(scene),
+    INIT_ATTRIBUTE_VALUE(name, "Name", ""),
+    INIT_ATTRIBUTE_VALUE(description, "Description", ""),
+    INIT_ATTRIBUTE_VALUE(group, "Group", "")
+{
+    // Scripts may rename entities every frame, while the clients need only a few updates per second
+    static AttributeMetadata nameMetadata;
+    nameMetadata.maxReplicationRate = 5.f;
+    name.SetMetadata(&nameMetadata);
+    description.SetMetadata(&nameMetadata);
+    group.SetMetadata(&nameMetadata);
+}
@@ -15,7 +15,7 @@
     <td>
     <h2>Name</h2>
     Provides network-synchronizable means of identification for entities in addition to the plain ID number.
-    This EC is not present by default for entities.
+    This EC is not present by default for entities. The changes of the attributes are replicated at most 5 times per second.
 
     Registered by TundraLogicModule.
 
@@ -40,12 +40,7 @@ class TUNDRACORE_API EC_Name : public IComponent
 public:
     /// @cond PRIVATE
     /// Do not directly allocate new components using operator new, but use the factory-based SceneAPI::CreateComponent functions instead.
-    explicit EC_Name(Scene* scene) :
-        IComponent(scene),
-        INIT_ATTRIBUTE_VALUE(name, "Name", ""),
-        INIT_ATTRIBUTE_VALUE(description, "Description", ""),
-        INIT_ATTRIBUTE_VALUE(group, "Group", "")
-    {}
+    explicit EC_Name(Scene* scene);
     /// @endcond
 
     ~EC_Name() {}
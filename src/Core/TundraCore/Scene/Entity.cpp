@@ -16,6 +16,8 @@
 
 #include <QDomDocument>
 
+#include <algorithm>
+
 #include <kNet/DataSerializer.h>
 #include <kNet/DataDeserializer.h>
 
@@ -41,9 +43,14 @@ Entity::~Entity()
 {
     // If components still alive, they become free-floating
     for (ComponentMap::const_iterator i = components_.begin(); i != components_.end(); ++i)
+    {
+        if (scene_)
+            scene_->EmitComponentRemoved(this, i->second.get(), AttributeChange::Disconnected);
         i->second->SetParentEntity(0);
+    }
    
     components_.clear();
+    typeIndex_.clear();
     qDeleteAll(actions_);
 }
 
@@ -62,9 +69,11 @@ void Entity::ChangeComponentId(component_id_t old_id, component_id_t new_id)
         RemoveComponentById(new_id, AttributeChange::LocalOnly);
     }
     
+    UnindexComponent(old_comp.get());
     old_comp->SetNewId(new_id);
     components_.erase(old_id);
     components_[new_id] = old_comp;
+    IndexComponent(old_comp);
 }
 
 void Entity::AddComponent(const ComponentPtr &component, AttributeChange::Type change)
@@ -121,6 +130,7 @@ void Entity::AddComponent(component_id_t id, const ComponentPtr &component, Attr
         component->SetNewId(id);
         component->SetParentEntity(this);
         components_[id] = component;
+        IndexComponent(component);
         
         if (change != AttributeChange::Disconnected)
             emit ComponentAdded(component.get(), change == AttributeChange::Default ? component->UpdateMode() : change);
@@ -186,6 +196,7 @@ void Entity::RemoveComponent(ComponentMap::iterator iter, AttributeChange::Type
         scene_->EmitComponentRemoved(this, iter->second.get(), change);
 
     iter->second->SetParentEntity(0);
+    UnindexComponent(iter->second.get());
     components_.erase(iter);
 }
 
@@ -355,8 +366,41 @@ ComponentPtr Entity::ComponentById(component_id_t id) const
     return (i != components_.end() ? i->second : ComponentPtr());
 }
 
+void Entity::IndexComponent(const ComponentPtr &component)
+{
+    ComponentTypeEntry entry;
+    entry.typeId = component->TypeId();
+    entry.id = component->Id();
+    entry.component = component;
+    typeIndex_.insert(std::upper_bound(typeIndex_.begin(), typeIndex_.end(), entry), entry);
+}
+
+void Entity::UnindexComponent(IComponent *component)
+{
+    const u32 typeId = component->TypeId();
+    for(ComponentTypeIndex::const_iterator i = FirstOfType(typeId); i != typeIndex_.end() && i->typeId == typeId; ++i)
+        if (i->component.get() == component)
+        {
+            typeIndex_.erase(typeIndex_.begin() + (i - typeIndex_.begin()));
+            return;
+        }
+}
+
+Entity::ComponentTypeIndex::const_iterator Entity::FirstOfType(u32 typeId) const
+{
+    ComponentTypeEntry key;
+    key.typeId = typeId;
+    key.id = 0;
+    return std::lower_bound(typeIndex_.begin(), typeIndex_.end(), key);
+}
+
 ComponentPtr Entity::Component(const QString &typeName) const
 {
+    // Known types go through the type index, the type ID lookup being cheaper than comparing the type names of all components
+    const u32 typeId = framework_->Scene()->ComponentTypeIdForTypeName(typeName);
+    if (typeId)
+        return Component(typeId);
+
     const QString ecTypeName = IComponent::EnsureTypeNameWithPrefix(typeName);
     for (ComponentMap::const_iterator i = components_.begin(); i != components_.end(); ++i)
         if (i->second->TypeName() == ecTypeName)
@@ -367,11 +411,8 @@ ComponentPtr Entity::Component(const QString &typeName) const
 
 ComponentPtr Entity::Component(u32 typeId) const
 {
-    for (ComponentMap::const_iterator i = components_.begin(); i != components_.end(); ++i)
-        if (i->second->TypeId() == typeId)
-            return i->second;
-
-    return ComponentPtr();
+    ComponentTypeIndex::const_iterator i = FirstOfType(typeId);
+    return (i != typeIndex_.end() && i->typeId == typeId ? i->component : ComponentPtr());
 }
 
 Entity::ComponentVector Entity::ComponentsOfType(const QString &typeName) const
@@ -382,14 +423,17 @@ Entity::ComponentVector Entity::ComponentsOfType(const QString &typeName) const
 Entity::ComponentVector Entity::ComponentsOfType(u32 typeId) const
 {
     ComponentVector ret;
-    for (ComponentMap::const_iterator i = components_.begin(); i != components_.end(); ++i)
-        if (i->second->TypeId() == typeId)
-            ret.push_back(i->second);
+    for (ComponentTypeIndex::const_iterator i = FirstOfType(typeId); i != typeIndex_.end() && i->typeId == typeId; ++i)
+        ret.push_back(i->component);
     return ret;
 }
 
 ComponentPtr Entity::Component(const QString &type_name, const QString& name) const
 {
+    const u32 typeId = framework_->Scene()->ComponentTypeIdForTypeName(type_name);
+    if (typeId)
+        return Component(typeId, name);
+
     const QString ecTypeName = IComponent::EnsureTypeNameWithPrefix(type_name);
     for (ComponentMap::const_iterator i = components_.begin(); i != components_.end(); ++i)
         if (i->second->TypeName() == ecTypeName && i->second->Name() == name)
@@ -400,9 +444,9 @@ ComponentPtr Entity::Component(const QString &type_name, const QString& name) co
 
 ComponentPtr Entity::Component(u32 typeId, const QString& name) const
 {
-    for (ComponentMap::const_iterator i = components_.begin(); i != components_.end(); ++i)
-        if (i->second->TypeId() == typeId && i->second->Name() == name)
-            return i->second;
+    for (ComponentTypeIndex::const_iterator i = FirstOfType(typeId); i != typeIndex_.end() && i->typeId == typeId; ++i)
+        if (i->component->Name() == name)
+            return i->component;
 
     return ComponentPtr();
 }
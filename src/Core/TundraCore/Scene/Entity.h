@@ -506,8 +506,29 @@ private:
     /// Collect child entities into an entity list, optionally recursive.
     void CollectChildren(EntityList& children, bool recursive) const;
 
+    /// Entry of the component type index.
+    struct ComponentTypeEntry
+    {
+        u32 typeId;
+        component_id_t id;
+        ComponentPtr component;
+
+        bool operator <(const ComponentTypeEntry &rhs) const { return typeId < rhs.typeId || (typeId == rhs.typeId && id < rhs.id); }
+    };
+    typedef std::vector<ComponentTypeEntry> ComponentTypeIndex;
+
+    /// Adds a component to the type index. Called internally
+    void IndexComponent(const ComponentPtr &component);
+
+    /// Removes a component from the type index. Called internally
+    void UnindexComponent(IComponent *component);
+
+    /// Returns the first component of the type in the type index, or the end of the index if there is none
+    ComponentTypeIndex::const_iterator FirstOfType(u32 typeId) const;
+
     UniqueIdGenerator idGenerator_; ///< Component ID generator
     ComponentMap components_; ///< a list of all components
+    ComponentTypeIndex typeIndex_; ///< The components sorted by type ID and then by ID, for looking them up by type without going through all of them
     entity_id_t id_; ///< Unique id for this entity
     Framework* framework_; ///< Pointer to framework
     Scene* scene_; ///< Pointer to scene
@@ -26,9 +26,10 @@ template <class T>
 std::vector<shared_ptr<T> > Entity::ComponentsOfType() const
 {
     std::vector<shared_ptr<T> > ret;
-    for(ComponentMap::const_iterator i = components_.begin(); i != components_.end(); ++i)
+    const u32 typeId = T::TypeIdStatic();
+    for(ComponentTypeIndex::const_iterator i = FirstOfType(typeId); i != typeIndex_.end() && i->typeId == typeId; ++i)
     {
-        shared_ptr<T> t = dynamic_pointer_cast<T>(i->second); /**< @todo static_pointer_cast should be ok here. */
+        shared_ptr<T> t = dynamic_pointer_cast<T>(i->component); /**< @todo static_pointer_cast should be ok here. */
         if (t)
             ret.push_back(t);
     }
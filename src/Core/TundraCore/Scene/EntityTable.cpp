@@ -0,0 +1,120 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "EntityTable.h"
+
+#include "MemoryLeakCheck.h"
+
+namespace
+{
+    /// Number of slots of an empty index, must be a power of two.
+    const size_t cMinSlots = 16;
+}
+
+EntityTable::EntityTable() :
+    shift_(32)
+{
+    Rehash(cMinSlots);
+}
+
+const EntityPtr &EntityTable::Find(entity_id_t id) const
+{
+    static const EntityPtr null;
+    const size_t slot = FindSlot(id);
+    return slot != cNotFound ? entities_[slots_[slot].index] : null;
+}
+
+bool EntityTable::Insert(entity_id_t id, const EntityPtr &entity)
+{
+    if (id == 0 || Contains(id))
+        return false;
+
+    // Keep the index at most 3/4 full, so that the probe sequences stay short
+    if ((entities_.size() + 1) * 4 > slots_.size() * 3)
+        Rehash(slots_.size() * 2);
+
+    const size_t mask = slots_.size() - 1;
+    size_t slot = HomeSlot(id);
+    while(slots_[slot].id != 0)
+        slot = (slot + 1) & mask;
+    slots_[slot].id = id;
+    slots_[slot].index = (u32)entities_.size();
+    entities_.push_back(entity);
+    ids_.push_back(id);
+    return true;
+}
+
+bool EntityTable::Erase(entity_id_t id)
+{
+    size_t hole = FindSlot(id);
+    if (hole == cNotFound)
+        return false;
+
+    // Move the last entity to the place of the removed one
+    const u32 index = slots_[hole].index;
+    const size_t last = entities_.size() - 1;
+    if (index != last)
+    {
+        entities_[index] = entities_[last];
+        ids_[index] = ids_[last];
+        slots_[FindSlot(ids_[index])].index = index;
+    }
+    entities_.pop_back();
+    ids_.pop_back();
+
+    // Shift back the entries after the removed one that would no longer be found past the empty slot
+    const size_t mask = slots_.size() - 1;
+    for(size_t slot = (hole + 1) & mask; slots_[slot].id != 0; slot = (slot + 1) & mask)
+    {
+        const size_t home = HomeSlot(slots_[slot].id);
+        const bool homeBetween = hole < slot ? (home > hole && home <= slot) : (home > hole || home <= slot);
+        if (!homeBetween)
+        {
+            slots_[hole] = slots_[slot];
+            hole = slot;
+        }
+    }
+    slots_[hole].id = 0;
+    return true;
+}
+
+void EntityTable::Clear()
+{
+    entities_.clear();
+    ids_.clear();
+    Rehash(cMinSlots);
+}
+
+size_t EntityTable::FindSlot(entity_id_t id) const
+{
+    if (id == 0)
+        return cNotFound;
+    const size_t mask = slots_.size() - 1;
+    for(size_t slot = HomeSlot(id); slots_[slot].id != 0; slot = (slot + 1) & mask)
+        if (slots_[slot].id == id)
+            return slot;
+    return cNotFound;
+}
+
+void EntityTable::Rehash(size_t numSlots)
+{
+    Slot empty;
+    empty.id = 0;
+    empty.index = 0;
+    slots_.assign(numSlots, empty);
+    shift_ = 32;
+    for(size_t n = numSlots; n > 1; n >>= 1)
+        --shift_;
+
+    const size_t mask = numSlots - 1;
+    for(size_t i = 0; i < ids_.size(); ++i)
+    {
+        size_t slot = HomeSlot(ids_[i]);
+        while(slots_[slot].id != 0)
+            slot = (slot + 1) & mask;
+        slots_[slot].id = ids_[i];
+        slots_[slot].index = (u32)i;
+    }
+}
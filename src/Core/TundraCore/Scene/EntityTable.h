@@ -0,0 +1,61 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "TundraCoreApi.h"
+#include "CoreTypes.h"
+#include "SceneFwd.h"
+
+#include <vector>
+
+/// Entities of a scene stored densely, with an open addressing index by entity ID.
+/** Used by Scene for looking up entities by ID and for going through all of them. The entities are in no particular order:
+    removing an entity moves the last entity to its place. Entity ID 0 is never used by a scene, and marks an empty slot of the index. */
+class TUNDRACORE_API EntityTable
+{
+public:
+    EntityTable();
+
+    /// Returns the entity with the ID, or a null pointer if there is none.
+    const EntityPtr &Find(entity_id_t id) const;
+
+    /// Returns whether there is an entity with the ID.
+    bool Contains(entity_id_t id) const { return FindSlot(id) != cNotFound; }
+
+    /// Adds an entity with the ID. Returns false if the ID is 0 or already in use.
+    bool Insert(entity_id_t id, const EntityPtr &entity);
+
+    /// Removes the entity with the ID. Returns false if there is none.
+    bool Erase(entity_id_t id);
+
+    /// Removes all entities.
+    void Clear();
+
+    /// Returns the number of entities.
+    size_t Size() const { return entities_.size(); }
+
+    /// Returns all entities, in no particular order. The order changes when entities are removed.
+    const std::vector<EntityPtr> &Entities() const { return entities_; }
+
+private:
+    static const size_t cNotFound = (size_t)-1;
+
+    /// Slot of the index
+    struct Slot
+    {
+        entity_id_t id; ///< 0 if the slot is empty.
+        u32 index; ///< Index of the entity in entities_.
+    };
+
+    /// Returns the slot of the entity ID, or cNotFound.
+    size_t FindSlot(entity_id_t id) const;
+    /// Returns the preferred slot of the entity ID.
+    size_t HomeSlot(entity_id_t id) const { return (size_t)((id * 2654435761u) >> shift_); }
+    /// Rebuilds the index with the number of slots.
+    void Rehash(size_t numSlots);
+
+    std::vector<Slot> slots_; ///< Linear probing index, the number of slots is a power of two.
+    unsigned shift_; ///< 32 - log2 of the number of slots.
+    std::vector<EntityPtr> entities_;
+    std::vector<entity_id_t> ids_; ///< IDs of the entities, by index. An entity may have already been given a new ID when it is erased.
+};
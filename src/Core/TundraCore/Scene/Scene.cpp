@@ -32,6 +32,7 @@
 #include <kNet/DataSerializer.h>
 
 #include <utility>
+#include <algorithm>
 #include "MemoryLeakCheck.h"
 
 using namespace kNet;
@@ -40,7 +41,8 @@ Scene::Scene(const QString &name, Framework *framework, bool viewEnabled, bool a
     name_(name),
     framework_(framework),
     interpolating_(false),
-    authority_(authority)
+    authority_(authority),
+    attributeChangeJournalEnabled_(false)
 {
     // In headless mode only view disabled-scenes can be created
     viewEnabled_ = framework->IsHeadless() ? false : viewEnabled;
@@ -76,13 +78,13 @@ EntityPtr Scene::CreateEntity(entity_id_t id, const QStringList &components, Att
                 id = replicated ? idGenerator_.AllocateReplicated() : idGenerator_.AllocateLocal();
             else
                 id = replicated ? idGenerator_.AllocateUnacked() : idGenerator_.AllocateLocal();
-            if (entities_.find(id) == entities_.end())
+            if (!entityTable_.Contains(id))
                 break;
         }
     }
     else
     {
-        if(entities_.find(id) != entities_.end())
+        if (entityTable_.Contains(id))
         {
             LogError("Can't create entity with given id because it's already used: " + QString::number(id));
             return EntityPtr();
@@ -107,6 +109,7 @@ EntityPtr Scene::CreateEntity(entity_id_t id, const QStringList &components, Att
         }
     }
     entities_[entity->Id()] = entity;
+    entityTable_.Insert(entity->Id(), entity);
 
     // Remember the creation and signal at end of frame if EmitEntityCreated() not called for this entity manually
     entitiesCreatedThisFrame_.push_back(std::make_pair(entity, change));
@@ -116,11 +119,7 @@ EntityPtr Scene::CreateEntity(entity_id_t id, const QStringList &components, Att
 
 EntityPtr Scene::EntityById(entity_id_t id) const
 {
-    EntityMap::const_iterator it = entities_.find(id);
-    if (it != entities_.end())
-        return it->second;
-
-    return EntityPtr();
+    return entityTable_.Find(id);
 }
 
 EntityPtr Scene::EntityByName(const QString &name) const
@@ -128,11 +127,15 @@ EntityPtr Scene::EntityByName(const QString &name) const
     if (name.isEmpty())
         return EntityPtr();
 
-    for(const_iterator it = begin(); it != end(); ++it)
-        if (it->second->Name() == name)
-            return it->second;
+    // The entity table is in no particular order, so find the match with the lowest ID, as with duplicate names
+    // the first entity by ID is returned.
+    EntityPtr match;
+    const std::vector<EntityPtr> &entities = entityTable_.Entities();
+    for(size_t i = 0; i < entities.size(); ++i)
+        if (entities[i]->Name() == name && (!match || entities[i]->Id() < match->Id()))
+            match = entities[i];
 
-    return EntityPtr();
+    return match;
 }
 
 bool Scene::IsUniqueName(const QString& name) const
@@ -158,6 +161,8 @@ void Scene::ChangeEntityId(entity_id_t old_id, entity_id_t new_id)
     old_entity->SetNewId(new_id);
     entities_.erase(old_id);
     entities_[new_id] = old_entity;
+    entityTable_.Erase(old_id);
+    entityTable_.Insert(new_id, old_entity);
 }
 
 bool Scene::RemoveEntity(entity_id_t id, AttributeChange::Type change)
@@ -188,6 +193,7 @@ bool Scene::RemoveEntity(entity_id_t id, AttributeChange::Type change)
         del_entity->RemoveAllChildren(change);
 
         entities_.erase(it);
+        entityTable_.Erase(id);
         
         // If entity somehow manages to live, at least it doesn't belong to the scene anymore
         del_entity->SetScene(0);
@@ -225,6 +231,9 @@ void Scene::RemoveAllEntities(bool signal, AttributeChange::Type change)
     {
         LogWarning("Scene::RemoveAllEntities: entity map was not clear after removing all entities, clearing manually");
         entities_.clear();
+        entityTable_.Clear();
+        componentsByType_.clear();
+        componentTypeListIndices_.clear();
     }
     
     if (signal)
@@ -254,9 +263,15 @@ EntityList Scene::EntitiesWithComponent(const QString &typeName, const QString &
 EntityList Scene::EntitiesWithComponent(u32 typeId, const QString &name) const
 {
     EntityList entities;
-    for(const_iterator it = begin(); it != end(); ++it)
-        if ((name.isEmpty() && it->second->Component(typeId)) || it->second->Component(typeId, name))
-            entities.push_back(it->second);
+    ComponentTypeList components;
+    SortedComponentsOfType(typeId, components);
+    for(ComponentTypeList::const_iterator it = components.begin(); it != components.end(); ++it)
+    {
+        Entity *entity = (*it)->ParentEntity();
+        // Each entity only once, through its first matching component
+        if (entity && (name.isEmpty() ? entity->Component(typeId).get() : entity->Component(typeId, name).get()) == *it)
+            entities.push_back(entity->shared_from_this());
+    }
     return entities;
 }
 
@@ -281,32 +296,97 @@ Entity::ComponentVector Scene::Components(const QString &typeName, const QString
 Entity::ComponentVector Scene::Components(u32 typeId, const QString &name) const
 {
     Entity::ComponentVector ret;
+    ComponentTypeList components;
+    SortedComponentsOfType(typeId, components);
     if (name.isEmpty())
     {
-        for(const_iterator it = begin(); it != end(); ++it)
-        {
-            Entity::ComponentVector components =  it->second->ComponentsOfType(typeId);
-            if (!components.empty())
-                ret.insert(ret.end(), components.begin(), components.end());
-        }
+        ret.reserve(components.size());
+        for(ComponentTypeList::const_iterator it = components.begin(); it != components.end(); ++it)
+            ret.push_back((*it)->shared_from_this());
     }
     else
     {
-        for(const_iterator it = begin(); it != end(); ++it)
+        for(ComponentTypeList::const_iterator it = components.begin(); it != components.end(); ++it)
         {
-            ComponentPtr component = it->second->GetComponent(typeId, name);
-            if (component)
-                ret.push_back(component);
+            // Only the first component with the name from each entity
+            Entity *entity = (*it)->ParentEntity();
+            if ((*it)->Name() == name && entity && entity->Component(typeId, name).get() == *it)
+                ret.push_back((*it)->shared_from_this());
         }
     }
     return ret;
 }
 
+const Scene::ComponentTypeList &Scene::ComponentsOfType(u32 typeId) const
+{
+    static const ComponentTypeList empty;
+    std::map<u32, ComponentTypeList>::const_iterator it = componentsByType_.find(typeId);
+    return it != componentsByType_.end() ? it->second : empty;
+}
+
+namespace
+{
+
+/// Orders components by entity ID, and by component ID within an entity.
+bool ComponentIdLess(const IComponent *a, const IComponent *b)
+{
+    const entity_id_t entityA = a->ParentEntity() ? a->ParentEntity()->Id() : 0;
+    const entity_id_t entityB = b->ParentEntity() ? b->ParentEntity()->Id() : 0;
+    return entityA < entityB || (entityA == entityB && a->Id() < b->Id());
+}
+
+}
+
+void Scene::SortedComponentsOfType(u32 typeId, ComponentTypeList &dest) const
+{
+    const ComponentTypeList &components = ComponentsOfType(typeId);
+    dest.assign(components.begin(), components.end());
+    std::sort(dest.begin(), dest.end(), &ComponentIdLess);
+}
+
+uint Scene::NumComponentsOfType(u32 typeId) const
+{
+    return (uint)ComponentsOfType(typeId).size();
+}
+
+IComponent *Scene::ComponentOfType(u32 typeId, uint index) const
+{
+    const ComponentTypeList &components = ComponentsOfType(typeId);
+    return index < components.size() ? components[index] : 0;
+}
+
+void Scene::RegisterComponent(IComponent* comp)
+{
+    if (componentTypeListIndices_.contains(comp))
+        return;
+    ComponentTypeList &components = componentsByType_[comp->TypeId()];
+    componentTypeListIndices_.insert(comp, components.size());
+    components.push_back(comp);
+}
+
+void Scene::UnregisterComponent(IComponent* comp)
+{
+    QHash<IComponent*, size_t>::iterator indexIt = componentTypeListIndices_.find(comp);
+    if (indexIt == componentTypeListIndices_.end())
+        return;
+    const size_t index = indexIt.value();
+    componentTypeListIndices_.erase(indexIt);
+
+    // Move the last component of the type to the freed slot
+    ComponentTypeList &components = componentsByType_[comp->TypeId()];
+    if (index + 1 < components.size())
+    {
+        components[index] = components.back();
+        componentTypeListIndices_[components[index]] = index;
+    }
+    components.pop_back();
+}
+
 EntityList Scene::GetAllEntities() const
 {
     LogWarning("Scene::GetAllEntities: this function is deprecated and will be removed. Use Scene::Entities instead");
 
-    std::list<EntityPtr> entities;
+    EntityList entities;
     for(const_iterator it = begin(); it != end(); ++it)
         entities.push_back(it->second);
 
@@ -315,6 +395,7 @@ EntityList Scene::GetAllEntities() const
 
 void Scene::EmitComponentAdded(Entity* entity, IComponent* comp, AttributeChange::Type change)
 {
+    RegisterComponent(comp);
     if (change == AttributeChange::Disconnected)
         return;
     if (change == AttributeChange::Default)
@@ -324,11 +405,14 @@ void Scene::EmitComponentAdded(Entity* entity, IComponent* comp, AttributeChange
 
 void Scene::EmitComponentRemoved(Entity* entity, IComponent* comp, AttributeChange::Type change)
 {
-    if (change == AttributeChange::Disconnected)
-        return;
-    if (change == AttributeChange::Default)
-        change = comp->UpdateMode();
-    emit ComponentRemoved(entity, comp, change);
+    if (change != AttributeChange::Disconnected)
+    {
+        if (change == AttributeChange::Default)
+            change = comp->UpdateMode();
+        emit ComponentRemoved(entity, comp, change);
+    }
+    // The component can still be found in the handlers of the signal
+    UnregisterComponent(comp);
 }
 
 void Scene::EmitAttributeChanged(IComponent* comp, IAttribute* attribute, AttributeChange::Type change)
@@ -337,9 +421,52 @@ void Scene::EmitAttributeChanged(IComponent* comp, IAttribute* attribute, Attrib
         return;
     if (change == AttributeChange::Default)
         change = comp->UpdateMode();
+    // A value changed by other means than the interpolation itself overrides a running interpolation. This is done right away,
+    // as the journal may be handled only after a new interpolation has been started for the attribute.
+    if (!interpolating_ && !interpolations_.empty() && attribute->Metadata() && attribute->Metadata()->interpolation == AttributeMetadata::Interpolate)
+        EndAttributeInterpolation(attribute);
+    if (attributeChangeJournalEnabled_ && !interpolating_)
+    {
+        AttributeChangeRecord record;
+        record.entity = comp->ParentEntity();
+        record.component = comp;
+        record.attributeIndex = attribute->Index();
+        record.change = change;
+        attributeChanges_.push_back(record);
+    }
     emit AttributeChanged(comp, attribute, change);
 }
 
+void Scene::SetAttributeChangeJournalEnabled(bool enabled)
+{
+    attributeChangeJournalEnabled_ = enabled;
+    if (!enabled)
+    {
+        attributeChanges_.clear();
+        takenAttributeChanges_.clear();
+    }
+}
+
+const Scene::AttributeChangeJournal &Scene::TakeAttributeChanges()
+{
+    // Swap the buffers, so that both keep their capacity
+    AttributeChangeJournal &changes = takenAttributeChanges_;
+    changes.clear();
+    changes.swap(attributeChanges_);
+
+    // Leave out the changes of the components that have been removed, as the pointers may no longer be valid.
+    // A component still in the scene is alive, and so is its parent entity if it is the recorded one.
+    size_t numValid = 0;
+    for(size_t i = 0; i < changes.size(); ++i)
+    {
+        const AttributeChangeRecord &record = changes[i];
+        if (componentTypeListIndices_.contains(record.component) && record.component->ParentEntity() == record.entity)
+            changes[numValid++] = record;
+    }
+    changes.resize(numValid);
+    return changes;
+}
+
 void Scene::EmitAttributeAdded(IComponent* comp, IAttribute* attribute, AttributeChange::Type change)
 {
     // "Stealth" addition (disconnected changetype) is not supported. Always signal.
@@ -1465,6 +1592,14 @@ bool Scene::StartAttributeInterpolation(IAttribute* attr, IAttribute* endvalue,
     return true;
 }
 
+bool Scene::IsAttributeInterpolating(IAttribute* attr) const
+{
+    for(uint i = 0; i < interpolations_.size(); ++i)
+        if (interpolations_[i].dest.Get() == attr)
+            return true;
+    return false;
+}
+
 bool Scene::EndAttributeInterpolation(IAttribute* attr)
 {
     for(uint i = 0; i < interpolations_.size(); ++i)
@@ -1600,6 +1735,7 @@ EntityList Scene::FindEntitiesContaining(const QString &substring) const
 
 EntityList Scene::RootLevelEntities() const
 {
+    // Go through the entities in ID order, so that the serialized scenes are in a stable order
     EntityList entities;
     for(const_iterator it = begin(); it != end(); ++it)
     {
@@ -11,9 +11,11 @@
 #include "Math/float3.h"
 #include "SceneDesc.h"
 #include "Entity.h"
+#include "EntityTable.h"
 
 #include <QObject>
 #include <QVariant>
+#include <QHash>
 
 #include <map>
 
@@ -63,6 +65,9 @@ public:
     /// Returns entity map for introspection purposes
     const EntityMap &Entities() const { return entities_; }
 
+    /// Returns all entities in no particular order. Faster to go through than Entities(); the order changes when entities are removed.
+    const std::vector<EntityPtr> &EntityVector() const { return entityTable_.Entities(); }
+
     /// Returns true if the two scenes have the same name
     bool operator == (const Scene &other) const { return Name() == other.Name(); }
 
@@ -96,6 +101,9 @@ public:
         @return true if an interpolation existed */
     bool EndAttributeInterpolation(IAttribute* attr);
 
+    /// Returns whether an interpolation of the attribute is running.
+    bool IsAttributeInterpolating(IAttribute* attr) const;
+
     /// Ends all attribute interpolations
     void EndAllAttributeInterpolations();
 
@@ -192,15 +200,49 @@ public:
     void EmitComponentAcked(IComponent* component, component_id_t oldId);
 
     /// Returns all components of type T (and additionally with specific name) in the scene.
+    /** @note The components are in entity ID order, and in component ID order within an entity. */
     template <typename T>
     std::vector<shared_ptr<T> > Components(const QString &name = "") const;
 
     /// Returns list of entities with a specific component present.
     /** @param name Name of the component, optional.
-        @note O(n) */
+        @note O(n log n), where n is the number of components of type T. The entities are in ID order. */
     template <typename T>
     EntityList EntitiesWithComponent(const QString &name = "") const;
 
+    /// Components of one type in the scene, in no particular order.
+    typedef std::vector<IComponent*> ComponentTypeList;
+
+    /// Returns all components of a specific type in the scene, without copying them.
+    /** The list is kept up to date as components are added and removed, so it must not be held on to, or iterated
+        while adding or removing components of the type. The order of the components changes when components are removed.
+        @param typeId Component type ID. */
+    const ComponentTypeList &ComponentsOfType(u32 typeId) const;
+
+    /// Attribute change recorded in the attribute change journal.
+    struct AttributeChangeRecord
+    {
+        Entity *entity; ///< Parent entity of the component.
+        IComponent *component; ///< Component of the attribute.
+        u8 attributeIndex; ///< Index of the attribute in the component.
+        AttributeChange::Type change; ///< Change signaling mode, never Default or Disconnected.
+    };
+    typedef std::vector<AttributeChangeRecord> AttributeChangeJournal;
+
+    /// Enables or disables recording the attribute changes to the attribute change journal. Disabled by default.
+    /** The journal lets a subscriber, such as SyncManager, handle the attribute changes in bulk instead of connecting to
+        AttributeChanged, which is still emitted for every change. The journal has a single consumer, which must call
+        TakeAttributeChanges regularly. Disabling the journal forgets the recorded changes. */
+    void SetAttributeChangeJournalEnabled(bool enabled);
+
+    /// Returns whether attribute changes are recorded to the attribute change journal.
+    bool IsAttributeChangeJournalEnabled() const { return attributeChangeJournalEnabled_; }
+
+    /// Returns the attribute changes recorded since the last call, in the order they happened, and empties the journal.
+    /** Changes of components removed from the scene since are left out. Changes made by attribute interpolation
+        (see UpdateAttributeInterpolations) are not recorded. The returned list is valid until the next call. */
+    const AttributeChangeJournal &TakeAttributeChanges();
+
     /// @cond PRIVATE
     /// Do not directly allocate new scenes using operator new, but use the factory-based SceneAPI::CreateScene functions instead.
     /** @param name Name of the scene.
@@ -267,7 +309,7 @@ public slots:
     /// Returns entity with the specified id
     /** @note Returns a shared pointer, but it is preferable to use a weak pointer, EntityWeakPtr,
         to avoid dangling references that prevent entities from being properly destroyed.
-        @note O(log n)
+        @note O(1)
         @sa EntityByName*/
     EntityPtr EntityById(entity_id_t id) const;
 
@@ -276,6 +318,7 @@ public slots:
         @note Returns a shared pointer, but it is preferable to use a weak pointer, EntityWeakPtr,
               to avoid dangling references that prevent entities from being properly destroyed.
         @note @note O(n)
+        @note If several entities have the same name, the one with the lowest ID is returned.
         @sa EntityById, FindEntities, FindEntitiesContaining */
     EntityPtr EntityByName(const QString &name) const;
 
@@ -284,8 +327,8 @@ public slots:
     bool IsUniqueName(const QString& name) const;
 
     /// Returns true if entity with the specified id exists in this scene, false otherwise
-    /** @note O(log n) */
-    bool HasEntity(entity_id_t id) const { return (entities_.find(id) != entities_.end()); }
+    /** @note O(1) */
+    bool HasEntity(entity_id_t id) const { return entityTable_.Contains(id); }
 
     /// Removes entity with specified id
     /** The entity may not get deleted if dangling references to a pointer to the entity exists.
@@ -310,7 +353,7 @@ public slots:
     /// Returns list of entities with a specific component present.
     /** @param typeId Type ID of the component
         @param name Name of the component, optional.
-        @note O(n) */
+        @note O(n log n), where n is the number of components of the type. The entities are in ID order. */
     EntityList EntitiesWithComponent(u32 typeId, const QString &name = "") const;
     /// @overload
     /** @param typeName typeName Type name of the component.
@@ -318,30 +361,50 @@ public slots:
     EntityList EntitiesWithComponent(const QString &typeName, const QString &name = "") const;
 
     /// Returns list of entities that belong to the group 'groupName'
-    /** @param groupName The name of the group to be queried */
+    /** @param groupName The name of the group to be queried
+        @note The entities are in ID order. */
     EntityList EntitiesOfGroup(const QString &groupName) const;
 
     /// Returns all components of specific type (and additionally with specific name) in the scene.
     /*  @param typeId Component type ID.
-        @param name Arbitrary name of the component (optional). */
+        @param name Arbitrary name of the component (optional).
+        @note The components are in entity ID order, and in component ID order within an entity. */
     Entity::ComponentVector Components(u32 typeId, const QString &name = "") const;
     /// overload
     /** @param typeName Component type name.
         @note The overload taking type ID is more efficient than this overload. */
     Entity::ComponentVector Components(const QString &typeName, const QString &name = "") const;
 
+    /// Returns the number of components of a specific type in the scene.
+    /** Use with ComponentOfType() to go through the components without building a list of them, f.ex.:
+        @code
+        var typeId = framework.Scene().ComponentTypeIdForTypeName("EC_ProximityTrigger");
+        for(var i = 0; i < scene.NumComponentsOfType(typeId); ++i)
+            scene.ComponentOfType(typeId, i).active = false;
+        @endcode
+        @param typeId Component type ID. */
+    uint NumComponentsOfType(u32 typeId) const;
+
+    /// Returns a component of a specific type by index, or null if the index is out of range.
+    /** @param typeId Component type ID.
+        @param index Index of the component, [0, NumComponentsOfType(typeId) - 1]. The order changes when components of the type are removed. */
+    IComponent *ComponentOfType(u32 typeId, uint index) const;
+
     /// Performs a regular expression matching through the entities, and returns a list of the matched entities.
     /** @param pattern Regular expression to be matched.
         @note Wildcards can be escaped with '\' character.
+        @note The entities are in ID order.
         @sa FindEntitiesContaining */
     EntityList FindEntities(const QRegExp &pattern) const;
     EntityList FindEntities(const QString &pattern) const; /**< @overload @param pattern String pattern with wildcards. */
 
     /// Performs a search through the entities, and returns a list of all the entities that contain 'substring' in their names.
-    /** @param substring String to be searched. */
+    /** @param substring String to be searched.
+        @note The entities are in ID order. */
     EntityList FindEntitiesContaining(const QString &substring) const;
 
     /// Return root-level entities, ie. those that have no parent.
+    /** @note The entities are in ID order. */
     EntityList RootLevelEntities() const;
 
     /// Loads the scene from XML.
@@ -439,7 +502,7 @@ public slots:
 
 signals:
     /// Signal when an attribute of a component has changed
-    /** Network synchronization managers should connect to this. */
+    /** To handle many changes at a time, see also SetAttributeChangeJournalEnabled. */
     void AttributeChanged(IComponent* comp, IAttribute* attribute, AttributeChange::Type change);
 
     /// Signal when an attribute of a component has been added (dynamic structure components only)
@@ -511,6 +574,13 @@ private:
     /// Create entity desc from an XML element and recurse into child entities. Called internally.
     void CreateEntityDescFromXml(SceneDesc& sceneDesc, QList<EntityDesc>& dest, const QDomElement& ent_elem) const;
 
+    /// Adds a component to the per-type component lists. Called internally.
+    void RegisterComponent(IComponent* comp);
+    /// Removes a component from the per-type component lists. Called internally.
+    void UnregisterComponent(IComponent* comp);
+    /// Copies the components of a type, sorted by entity ID and component ID, for the functions that return them in a stable order.
+    void SortedComponentsOfType(u32 typeId, ComponentTypeList &dest) const;
+
     /// Container for an ongoing attribute interpolation
     struct AttributeInterpolation
     {
@@ -521,7 +591,10 @@ private:
     };
 
     UniqueIdGenerator idGenerator_; ///< Entity ID generator
-    EntityMap entities_; ///< All entities in the scene.
+    EntityMap entities_; ///< All entities in the scene, ordered by ID. Kept for Entities(), begin() and end().
+    EntityTable entityTable_; ///< All entities in the scene, for lookups by ID and for going through them all.
+    std::map<u32, ComponentTypeList> componentsByType_; ///< All components in the scene by type ID.
+    QHash<IComponent*, size_t> componentTypeListIndices_; ///< Indices of the components in their component type lists, for removing them in constant time.
     Framework *framework_; ///< Parent framework.
     QString name_; ///< Name of the scene.
     bool viewEnabled_; ///< View enabled -flag.
@@ -529,6 +602,9 @@ private:
     bool authority_; ///< Authority -flag
     std::vector<AttributeInterpolation> interpolations_; ///< Running attribute interpolations.
     std::vector<std::pair<EntityWeakPtr, AttributeChange::Type> > entitiesCreatedThisFrame_; ///< Entities to signal for creation at frame end.
+    AttributeChangeJournal attributeChanges_; ///< Attribute changes not taken yet by the journal consumer.
+    AttributeChangeJournal takenAttributeChanges_; ///< Attribute changes returned by the last TakeAttributeChanges.
+    bool attributeChangeJournalEnabled_; ///< Attribute change journal enabled -flag.
 };
 
 #include "Scene.inl"
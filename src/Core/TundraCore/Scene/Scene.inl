@@ -13,23 +13,16 @@ template <typename T>
 std::vector<shared_ptr<T> > Scene::Components(const QString &name) const
 {
     std::vector<shared_ptr<T> > ret;
-    if (name.isEmpty())
+    ComponentTypeList components;
+    SortedComponentsOfType(T::ComponentTypeId, components);
+    for(ComponentTypeList::const_iterator it = components.begin(); it != components.end(); ++it)
     {
-        for(const_iterator it = begin(); it != end(); ++it)
-        {
-            std::vector<shared_ptr<T> > components =  it->second->ComponentsOfType<T>();
-            if (!components.empty())
-                ret.insert(ret.end(), components.begin(), components.end());
-        }
-    }
-    else
-    {
-        for(const_iterator it = begin(); it != end(); ++it)
-        {
-            shared_ptr<T> component = it->second->GetComponent<T>(name);
-            if (component)
-                ret.push_back(component);
-        }
+        // With a name, only the first component with the name from each entity
+        if (!name.isEmpty() && ((*it)->Name() != name || !(*it)->ParentEntity() || (*it)->ParentEntity()->Component(T::ComponentTypeId, name).get() != *it))
+            continue;
+        shared_ptr<T> component = dynamic_pointer_cast<T>((*it)->shared_from_this());
+        if (component)
+            ret.push_back(component);
     }
     return ret;
 }
@@ -0,0 +1,113 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "AttributeDelta.h"
+
+#include <kNet/DataSerializer.h>
+#include <kNet/DataDeserializer.h>
+#include <kNet/NetException.h>
+
+#include "MemoryLeakCheck.h"
+
+namespace TundraLogic
+{
+
+namespace
+{
+    /// Unchanged bytes between two changed ones are sent as part of the same run if there are fewer than this many of them,
+    /// as starting a new run costs at least two bytes.
+    const size_t cMaxUnchangedBytesInRun = 3;
+    /// Largest accepted value size. The sync buffers do not allow sending larger attributes.
+    const size_t cMaxValueSize = 64 * 1024;
+
+    /// Returns a byte of the baseline, bytes past its end are zero.
+    inline u8 BaselineByte(const std::vector<u8> &baseline, size_t i)
+    {
+        return i < baseline.size() ? baseline[i] : 0;
+    }
+}
+
+void AttributeDelta::Write(kNet::DataSerializer &dest, const u8 *data, size_t numBytes, std::vector<u8> &baseline, char *scratch, size_t scratchSize)
+{
+    kNet::DataSerializer delta(scratch, scratchSize);
+    bool useDelta = false;
+    if (!baseline.empty() && numBytes >= cMinBaselineSize)
+    {
+        size_t pos = 0;
+        while(pos < numBytes)
+        {
+            const size_t skipStart = pos;
+            while(pos < numBytes && data[pos] == BaselineByte(baseline, pos))
+                ++pos;
+            const size_t skip = pos - skipStart;
+            if (pos >= numBytes)
+            {
+                // Only unchanged bytes remain
+                delta.AddVLE<kNet::VLE8_16_32>((u32)skip);
+                delta.AddVLE<kNet::VLE8_16_32>(0);
+                break;
+            }
+
+            size_t lastChanged = pos;
+            for(size_t i = pos; i < numBytes && i - lastChanged < cMaxUnchangedBytesInRun; ++i)
+                if (data[i] != BaselineByte(baseline, i))
+                    lastChanged = i;
+            const size_t runEnd = lastChanged + 1;
+
+            delta.AddVLE<kNet::VLE8_16_32>((u32)skip);
+            delta.AddVLE<kNet::VLE8_16_32>((u32)(runEnd - pos));
+            for(; pos < runEnd; ++pos)
+                delta.Add<u8>(data[pos] ^ BaselineByte(baseline, pos));
+        }
+        useDelta = delta.BytesFilled() < numBytes;
+    }
+
+    dest.AddVLE<kNet::VLE8_16_32>((u32)((numBytes << 1) | (useDelta ? 1 : 0)));
+    if (useDelta)
+        dest.AddArray<u8>((const u8*)scratch, (u32)delta.BytesFilled());
+    else if (numBytes)
+        dest.AddArray<u8>(data, (u32)numBytes);
+
+    if (numBytes >= cMinBaselineSize)
+        baseline.assign(data, data + numBytes);
+}
+
+bool AttributeDelta::Read(kNet::DataDeserializer &src, std::vector<u8> &baseline, std::vector<u8> &value)
+{
+    const u32 header = src.ReadVLE<kNet::VLE8_16_32>();
+    const size_t numBytes = header >> 1;
+    if (numBytes > cMaxValueSize)
+        throw kNet::NetException("Too large attribute value in EditAttributes message");
+    value.resize(numBytes);
+
+    bool ok = true;
+    if (!(header & 1))
+    {
+        if (numBytes)
+            src.ReadArray<u8>(&value[0], (u32)numBytes);
+    }
+    else
+    {
+        ok = !baseline.empty();
+        size_t pos = 0;
+        while(pos < numBytes)
+        {
+            const size_t skip = src.ReadVLE<kNet::VLE8_16_32>();
+            const size_t count = src.ReadVLE<kNet::VLE8_16_32>();
+            if ((!skip && !count) || skip > numBytes - pos || count > numBytes - pos - skip)
+                throw kNet::NetException("Malformed attribute delta in EditAttributes message");
+            for(const size_t skipEnd = pos + skip; pos < skipEnd; ++pos)
+                value[pos] = BaselineByte(baseline, pos);
+            for(const size_t runEnd = pos + count; pos < runEnd; ++pos)
+                value[pos] = src.Read<u8>() ^ BaselineByte(baseline, pos);
+        }
+    }
+
+    if (numBytes >= cMinBaselineSize)
+        baseline = value;
+    return ok;
+}
+
+}
@@ -0,0 +1,48 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "TundraProtocolModuleApi.h"
+#include "CoreTypes.h"
+
+#include <kNetFwd.h>
+
+#include <vector>
+
+namespace TundraLogic
+{
+
+/// Delta encoding of attribute values in the EditAttributes message, used with protocol version ProtocolAttributeDeltas and newer.
+/** Each edited attribute value is written as a VLE header (numBytes << 1 | isDelta), followed by either the full binary encoding
+    of the value, or the runs of bytes in which the value differs from its baseline, XORed with the baseline.
+
+    The baseline of an attribute is the value that was last sent over the same connection in an EditAttributes message.
+    As the scene sync messages are reliable and in order, the receiver has always received the same value by the time the
+    delta arrives, so no acknowledgement is needed. Both ends store a value as the baseline only if it is at least
+    cMinBaselineSize bytes, so the ends agree on the baselines without sending extra information. The sender may drop baselines
+    at any time, after which it sends the full value; the receiver drops them only when the sender is known to have dropped them too,
+    i.e. when receiving RemoveEntity and RemoveComponents messages. */
+class TUNDRAPROTOCOL_MODULE_API AttributeDelta
+{
+public:
+    /// Values smaller than this are always sent in full and are not stored as baselines.
+    static const size_t cMinBaselineSize = 8;
+
+    /// Writes an attribute value, delta-encoded if the baseline exists and the delta is smaller than the value, and updates the baseline.
+    /** @param dest Destination serializer. Does not need to be byte-aligned.
+        @param data Binary encoding of the value, as produced by IAttribute::ToBinary().
+        @param numBytes Size of the value in bytes.
+        @param baseline Baseline of the attribute, empty if none.
+        @param scratch Temporary buffer used for the delta encoding.
+        @param scratchSize Size of the temporary buffer in bytes. */
+    static void Write(kNet::DataSerializer &dest, const u8 *data, size_t numBytes, std::vector<u8> &baseline, char *scratch, size_t scratchSize);
+
+    /// Reads an attribute value written by Write() and updates the baseline.
+    /** @param src Source deserializer.
+        @param baseline Baseline of the attribute, empty if none.
+        @param value [out] The decoded binary encoding of the value.
+        @return False if the value was delta-encoded but there was no baseline, in which case the decoded value is invalid. */
+    static bool Read(kNet::DataDeserializer &src, std::vector<u8> &baseline, std::vector<u8> &value);
+};
+
+}
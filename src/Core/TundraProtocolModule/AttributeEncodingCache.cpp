@@ -0,0 +1,75 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "AttributeEncodingCache.h"
+#include "IAttribute.h"
+
+#include <kNet/DataSerializer.h>
+
+#include "MemoryLeakCheck.h"
+
+namespace TundraLogic
+{
+
+uint qHash(const AttributeEncodingCache::Key &key)
+{
+    return (key.entityId * 2654435761u) ^ (key.componentId * 40503u) ^ ((uint)key.attributeIndex << 24);
+}
+
+AttributeEncodingCache::AttributeEncodingCache() :
+    generation_(0)
+{
+}
+
+void AttributeEncodingCache::NewGeneration()
+{
+    QWriteLocker locker(&lock_);
+    ++generation_;
+    encodings_.clear();
+    hits_ = 0;
+    misses_ = 0;
+}
+
+void AttributeEncodingCache::Write(kNet::DataSerializer &dest, entity_id_t entityId, component_id_t componentId, IAttribute *attr,
+    char *scratch, size_t scratchSize)
+{
+    QByteArray encoding = Encode(entityId, componentId, attr, scratch, scratchSize);
+    // Attribute encodings always consist of whole bytes, so the cached data can be appended at any bit offset.
+    if (encoding.size())
+        dest.AddArray<u8>((const u8*)encoding.constData(), (u32)encoding.size());
+}
+
+QByteArray AttributeEncodingCache::Encode(entity_id_t entityId, component_id_t componentId, IAttribute *attr, char *scratch, size_t scratchSize)
+{
+    Key key;
+    key.entityId = entityId;
+    key.componentId = componentId;
+    key.attributeIndex = attr->Index();
+
+    QByteArray encoding;
+    {
+        QReadLocker locker(&lock_);
+        QHash<Key, QByteArray>::const_iterator it = encodings_.find(key);
+        if (it != encodings_.end())
+            encoding = it.value(); // Implicitly shared, no copy of the data is made.
+    }
+
+    if (!encoding.isNull())
+        hits_.ref();
+    else
+    {
+        // Encode outside the lock. If two workers miss the same attribute simultaneously, both encode it, which is harmless.
+        kNet::DataSerializer ds(scratch, scratchSize);
+        attr->ToBinary(ds);
+        encoding = QByteArray(scratch, (int)ds.BytesFilled());
+        misses_.ref();
+
+        QWriteLocker locker(&lock_);
+        encodings_.insert(key, encoding);
+    }
+    return encoding;
+}
+
+}
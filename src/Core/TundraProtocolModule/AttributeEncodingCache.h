@@ -0,0 +1,78 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "TundraProtocolModuleApi.h"
+#include "CoreTypes.h"
+
+#include <kNetFwd.h>
+
+#include <QHash>
+#include <QByteArray>
+#include <QReadWriteLock>
+#include <QAtomicInt>
+
+class IAttribute;
+
+namespace TundraLogic
+{
+
+/// Shared cache of binary attribute encodings used when replicating the same changes to several user connections.
+/** Without the cache, each dirty attribute is encoded with IAttribute::ToBinary() once per user connection.
+    With the cache, the first user connection to replicate an attribute encodes it, and the rest of the user connections
+    copy the already encoded bytes.
+
+    The cache is valid for a single change generation, i.e. one sync tick during which the scene is not modified.
+    SyncManager calls NewGeneration() at the start of each tick. Lookups and insertions are thread-safe so that the
+    cache can be shared by the parallel sync worker threads. */
+class TUNDRAPROTOCOL_MODULE_API AttributeEncodingCache
+{
+public:
+    AttributeEncodingCache();
+
+    /// Forgets all encodings produced during the previous change generation.
+    void NewGeneration();
+
+    /// Returns the current change generation.
+    u32 Generation() const { return generation_; }
+
+    /// Writes the binary encoding of an attribute to a serializer, using the cached encoding if one exists.
+    /** @param dest Destination serializer. Does not need to be byte-aligned.
+        @param entityId Id of the entity the attribute belongs to.
+        @param componentId Id of the component the attribute belongs to.
+        @param attr The attribute.
+        @param scratch Temporary buffer used for encoding the attribute on a cache miss.
+        @param scratchSize Size of the temporary buffer in bytes. */
+    void Write(kNet::DataSerializer &dest, entity_id_t entityId, component_id_t componentId, IAttribute *attr,
+        char *scratch, size_t scratchSize);
+
+    /// Returns the binary encoding of an attribute, encoding it on a cache miss. The parameters are the same as in Write().
+    QByteArray Encode(entity_id_t entityId, component_id_t componentId, IAttribute *attr, char *scratch, size_t scratchSize);
+
+    /// Returns the number of cache hits during the current change generation.
+    uint Hits() const { return (uint)hits_; }
+    /// Returns the number of cache misses (encodes) during the current change generation.
+    uint Misses() const { return (uint)misses_; }
+
+private:
+    struct Key
+    {
+        entity_id_t entityId;
+        component_id_t componentId;
+        u8 attributeIndex;
+
+        bool operator ==(const Key &rhs) const
+        {
+            return entityId == rhs.entityId && componentId == rhs.componentId && attributeIndex == rhs.attributeIndex;
+        }
+    };
+    friend uint qHash(const Key &key);
+
+    QHash<Key, QByteArray> encodings_;
+    QReadWriteLock lock_;
+    u32 generation_;
+    QAtomicInt hits_;
+    QAtomicInt misses_;
+};
+
+}
@@ -374,6 +374,9 @@ void Client::HandleLoginReply(MessageConnection* /*source*/, const char *data, s
     serverUserConnection_->protocolVersion = ProtocolOriginal;
     if (dd.BytesLeft())
         serverUserConnection_->protocolVersion = (NetworkProtocolVersion)dd.ReadVLE<kNet::VLE8_16_32>();
+    // The server starts with empty string tables for each connection
+    serverUserConnection_->sentStrings.Clear();
+    serverUserConnection_->receivedStrings.Clear();
 
     if (msg.success)
     {
@@ -181,10 +181,12 @@ void KristalliProtocolModule::Update(f64 /*frametime*/)
         // In Tundra, we *never* keep half-open server->client connections alive. 
         // (the usual case would be to wait for a file transfer to complete, but Tundra messaging mechanism doesn't use that).
         // So, bidirectionally close all half-open connections.
-        NetworkServer::ConnectionMap connections = server->GetConnections();
-        for(NetworkServer::ConnectionMap::iterator iter = connections.begin(); iter != connections.end(); ++iter)
-            if (!iter->second->IsReadOpen() && iter->second->IsWriteOpen())
-                iter->second->Disconnect(0);
+        for(UserConnectionList::iterator iter = connections.begin(); iter != connections.end(); ++iter)
+        {
+            KNetUserConnection *kNetConn = dynamic_cast<KNetUserConnection*>(iter->get());
+            if (kNetConn && kNetConn->connection && !kNetConn->connection->IsReadOpen() && kNetConn->connection->IsWriteOpen())
+                kNetConn->connection->Disconnect(0);
+        }
     }
     
     if ((!serverConnection || serverConnection->GetConnectionState() == ConnectionClosed ||
@@ -0,0 +1,118 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "NetworkTrafficRecorder.h"
+#include "UserConnection.h"
+#include "LoggingFunctions.h"
+
+#include <kNet/DataSerializer.h>
+
+#include "MemoryLeakCheck.h"
+
+namespace TundraLogic
+{
+
+const char NetworkTrafficRecorder::cMagic[4] = { 'T', 'N', 'T', 'R' };
+
+NetworkTrafficRecorder::NetworkTrafficRecorder() :
+    lastRecordTime_(0)
+{
+}
+
+NetworkTrafficRecorder::~NetworkTrafficRecorder()
+{
+    Close();
+}
+
+bool NetworkTrafficRecorder::Open(const QString &filename)
+{
+    Close();
+    file_.setFileName(filename);
+    if (!file_.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        LogError("NetworkTrafficRecorder: Could not open " + filename + " for writing: " + file_.errorString());
+        return false;
+    }
+
+    char header[8];
+    kNet::DataSerializer ds(header, sizeof(header));
+    ds.AddArray<char>(cMagic, sizeof(cMagic));
+    ds.Add<u32>(cFormatVersion);
+    file_.write(header, ds.BytesFilled());
+    lastRecordTime_ = kNet::Clock::Tick();
+    LogInfo("NetworkTrafficRecorder: Recording network traffic to " + filename);
+    return true;
+}
+
+void NetworkTrafficRecorder::Close()
+{
+    if (file_.isOpen())
+    {
+        file_.close();
+        LogInfo("NetworkTrafficRecorder: Stopped recording network traffic to " + file_.fileName());
+    }
+}
+
+void NetworkTrafficRecorder::RecordConnect(UserConnection *user)
+{
+    if (!file_.isOpen() || !user)
+        return;
+
+    const QByteArray loginData = user->LoginData().toUtf8();
+    char header[32];
+    kNet::DataSerializer ds(header, sizeof(header));
+    WriteRecordHeader(ds, RecordConnected, user->ConnectionId());
+    ds.AddVLE<kNet::VLE8_16_32>((u32)user->ProtocolVersion());
+    ds.AddVLE<kNet::VLE8_16_32>((u32)loginData.size());
+    WriteRecord(header, ds.BytesFilled(), loginData.constData(), (size_t)loginData.size());
+}
+
+void NetworkTrafficRecorder::RecordNetworkMessage(UserConnection *user, kNet::message_id_t id, const char *data, size_t numBytes)
+{
+    if (!file_.isOpen() || !user)
+        return;
+
+    char header[32];
+    kNet::DataSerializer ds(header, sizeof(header));
+    WriteRecordHeader(ds, RecordMessage, user->ConnectionId());
+    ds.AddVLE<kNet::VLE8_16_32>(id);
+    ds.AddVLE<kNet::VLE8_16_32>((u32)numBytes);
+    WriteRecord(header, ds.BytesFilled(), data, numBytes);
+}
+
+void NetworkTrafficRecorder::RecordDisconnect(UserConnection *user)
+{
+    if (!file_.isOpen() || !user)
+        return;
+
+    char header[32];
+    kNet::DataSerializer ds(header, sizeof(header));
+    WriteRecordHeader(ds, RecordDisconnected, user->ConnectionId());
+    WriteRecord(header, ds.BytesFilled(), 0, 0);
+}
+
+void NetworkTrafficRecorder::WriteRecordHeader(kNet::DataSerializer &ds, RecordType type, u32 connectionId)
+{
+    // Store the time relative to the previous record, so that it usually fits in one or two bytes.
+    const kNet::tick_t now = kNet::Clock::Tick();
+    const double elapsedMs = kNet::Clock::TimespanToMillisecondsD(lastRecordTime_, now);
+    const u32 cMaxTime = 0x1FFFFFFF;
+    const u32 timeMs = elapsedMs < (double)cMaxTime ? (u32)elapsedMs : cMaxTime;
+    // Carry the unrecorded fraction of a millisecond over to the next record, so that rounding errors do not accumulate.
+    lastRecordTime_ += (kNet::tick_t)(timeMs * (double)kNet::Clock::TicksPerMillisecond());
+
+    ds.Add<u8>((u8)type);
+    ds.AddVLE<kNet::VLE8_16_32>(timeMs);
+    ds.AddVLE<kNet::VLE8_16_32>(connectionId);
+}
+
+void NetworkTrafficRecorder::WriteRecord(const char *header, size_t headerSize, const char *data, size_t numBytes)
+{
+    file_.write(header, headerSize);
+    if (numBytes)
+        file_.write(data, numBytes);
+}
+
+}
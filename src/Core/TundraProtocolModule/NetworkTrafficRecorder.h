@@ -0,0 +1,72 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "TundraProtocolModuleApi.h"
+#include "TundraProtocolModuleFwd.h"
+#include "CoreTypes.h"
+
+#include <kNetFwd.h>
+#include <kNet/Types.h>
+#include <kNet/Clock.h>
+
+#include <QFile>
+#include <QString>
+
+namespace TundraLogic
+{
+
+/// Records the network messages received by the server into a file, for replaying them with NetworkTrafficReplay.
+/** Enabled with the --recordNetworkTraffic <file> command line parameter. Both the kNet and the WebSocket connections are
+    recorded, as the server receives the messages of both through Server::EmitNetworkMessageReceived().
+
+    The file starts with the four bytes "TNTR" and a u32 format version, followed by the records. Each record is a u8 record
+    type, the VLE time in milliseconds since the previous record and the VLE connection ID, followed by
+    - for RecordConnected: the VLE protocol version and the VLE length and UTF-8 bytes of the login data,
+    - for RecordMessage: the VLE message ID and the VLE length and bytes of the message payload,
+    - for RecordDisconnected: nothing. */
+class TUNDRAPROTOCOL_MODULE_API NetworkTrafficRecorder
+{
+public:
+    /// Record types of the file.
+    enum RecordType
+    {
+        RecordConnected = 0,
+        RecordMessage = 1,
+        RecordDisconnected = 2
+    };
+
+    /// Identifies the file format.
+    static const char cMagic[4];
+    /// Version of the file format.
+    static const u32 cFormatVersion = 1;
+
+    NetworkTrafficRecorder();
+    ~NetworkTrafficRecorder();
+
+    /// Starts recording into a file, replacing it if it exists.
+    /** @return False if the file could not be opened. */
+    bool Open(const QString &filename);
+    /// Flushes the file and stops recording.
+    void Close();
+    /// Returns whether recording is in progress.
+    bool IsOpen() const { return file_.isOpen(); }
+
+    /// Records that a user has logged in.
+    void RecordConnect(UserConnection *user);
+    /// Records a message received from a user.
+    void RecordNetworkMessage(UserConnection *user, kNet::message_id_t id, const char *data, size_t numBytes);
+    /// Records that a user has disconnected.
+    void RecordDisconnect(UserConnection *user);
+
+private:
+    /// Writes the record type, time and connection ID of a record.
+    void WriteRecordHeader(kNet::DataSerializer &ds, RecordType type, u32 connectionId);
+    /// Writes a record, consisting of a header and an optional payload, into the file.
+    void WriteRecord(const char *header, size_t headerSize, const char *data, size_t numBytes);
+
+    QFile file_;
+    kNet::tick_t lastRecordTime_;
+};
+
+}
@@ -0,0 +1,247 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "NetworkTrafficReplay.h"
+#include "NetworkTrafficRecorder.h"
+#include "TundraLogicModule.h"
+#include "Server.h"
+#include "SyncManager.h"
+#include "Framework.h"
+#include "LoggingFunctions.h"
+
+#include <kNet/DataDeserializer.h>
+#include <kNet/NetException.h>
+
+#include <QFile>
+#include <QDomDocument>
+
+#include <cstring>
+#include <algorithm>
+
+#include "MemoryLeakCheck.h"
+
+namespace TundraLogic
+{
+
+void ReplayUserConnection::Send(kNet::message_id_t /*id*/, const char* /*data*/, size_t numBytes, bool /*reliable*/, bool /*inOrder*/,
+    unsigned long /*priority*/, unsigned long /*contentID*/)
+{
+    ++messagesSent;
+    bytesSent += numBytes;
+}
+
+NetworkTrafficReplay::NetworkTrafficReplay(TundraLogicModule *owner) :
+    owner_(owner),
+    framework_(owner->GetFramework()),
+    pos_(0),
+    recordTime_(0.0),
+    nextRecordTime_(0.0),
+    replayTime_(0.0),
+    speed_(1.f),
+    lastFrameTime_(0),
+    numFrames_(0),
+    totalFrameTimeMs_(0.0),
+    maxFrameTimeMs_(0.0),
+    reportTimer_(0.0),
+    messagesReplayed_(0),
+    bytesReplayed_(0),
+    startTime_(0)
+{
+}
+
+NetworkTrafficReplay::~NetworkTrafficReplay()
+{
+    RemoveUsers();
+}
+
+bool NetworkTrafficReplay::Open(const QString &filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        LogError("NetworkTrafficReplay: Could not open " + filename + ": " + file.errorString());
+        return false;
+    }
+    QByteArray data = file.readAll();
+    const int cHeaderSize = sizeof(NetworkTrafficRecorder::cMagic) + sizeof(u32);
+    if (data.size() < cHeaderSize || memcmp(data.constData(), NetworkTrafficRecorder::cMagic, sizeof(NetworkTrafficRecorder::cMagic)) != 0)
+    {
+        LogError("NetworkTrafficReplay: " + filename + " is not a network traffic recording.");
+        return false;
+    }
+    kNet::DataDeserializer dd(data.constData() + sizeof(NetworkTrafficRecorder::cMagic), sizeof(u32));
+    const u32 version = dd.Read<u32>();
+    if (version != NetworkTrafficRecorder::cFormatVersion)
+    {
+        LogError("NetworkTrafficReplay: Unsupported format version " + QString::number(version) + " in " + filename);
+        return false;
+    }
+
+    RemoveUsers();
+    filename_ = filename;
+    data_ = data;
+    pos_ = cHeaderSize;
+    recordTime_ = 0.0;
+    replayTime_ = 0.0;
+    PeekNextRecordTime();
+    LogInfo("NetworkTrafficReplay: Replaying network traffic from " + filename + " (" + QString::number(data_.size()) + " bytes)");
+    return true;
+}
+
+void NetworkTrafficReplay::Update(f64 frametime)
+{
+    const kNet::tick_t now = kNet::Clock::Tick();
+    if (lastFrameTime_)
+    {
+        const double frameTimeMs = kNet::Clock::TimespanToMillisecondsD(lastFrameTime_, now);
+        ++numFrames_;
+        totalFrameTimeMs_ += frameTimeMs;
+        maxFrameTimeMs_ = std::max(maxFrameTimeMs_, frameTimeMs);
+        reportTimer_ += frameTimeMs / 1000.0;
+    }
+    else
+        startTime_ = now;
+    lastFrameTime_ = now;
+
+    if (IsFinished() || !owner_->IsServer())
+        return;
+
+    // At maximum speed, advance by one sync update period per frame so that the sync runs at the same pace relative to the traffic.
+    replayTime_ += speed_ > 0.f ? frametime * speed_ : owner_->GetSyncManager()->GetUpdatePeriod();
+    try
+    {
+        while(!IsFinished() && nextRecordTime_ <= replayTime_)
+            ReplayRecord();
+    }
+    catch(kNet::NetException &e)
+    {
+        LogError("NetworkTrafficReplay: Malformed record at offset " + QString::number(pos_) + " in " + filename_ + ": " + e.what());
+        pos_ = (size_t)data_.size();
+    }
+
+    if (reportTimer_ >= 5.0)
+        ReportStatistics(false);
+
+    if (IsFinished())
+    {
+        ReportStatistics(true);
+        RemoveUsers();
+        framework_->Exit();
+    }
+}
+
+void NetworkTrafficReplay::PeekNextRecordTime()
+{
+    if (IsFinished())
+        return;
+    kNet::DataDeserializer dd(data_.constData() + pos_, (size_t)data_.size() - pos_);
+    dd.Read<u8>();
+    nextRecordTime_ = recordTime_ + dd.ReadVLE<kNet::VLE8_16_32>() / 1000.0;
+}
+
+void NetworkTrafficReplay::ReplayRecord()
+{
+    kNet::DataDeserializer dd(data_.constData() + pos_, (size_t)data_.size() - pos_);
+    const u8 type = dd.Read<u8>();
+    dd.ReadVLE<kNet::VLE8_16_32>(); // Time, already read by PeekNextRecordTime()
+    const u32 connectionId = dd.ReadVLE<kNet::VLE8_16_32>();
+    recordTime_ = nextRecordTime_;
+
+    Server *server = owner_->GetServer().get();
+    std::map<u32, shared_ptr<ReplayUserConnection> >::iterator user = users_.find(connectionId);
+    switch(type)
+    {
+    case NetworkTrafficRecorder::RecordConnected:
+    {
+        const NetworkProtocolVersion protocolVersion = (NetworkProtocolVersion)dd.ReadVLE<kNet::VLE8_16_32>();
+        const u32 loginDataSize = dd.ReadVLE<kNet::VLE8_16_32>();
+        if (loginDataSize > dd.BytesLeft())
+            throw kNet::NetException("Login data exceeds the end of the recording");
+        const QString loginData = QString::fromUtf8(data_.constData() + pos_ + dd.BytePos(), (int)loginDataSize);
+        dd.SkipBytes(loginDataSize);
+
+        shared_ptr<ReplayUserConnection> newUser = MAKE_SHARED(ReplayUserConnection);
+        newUser->protocolVersion = protocolVersion;
+        // Fill the login properties the same way as Server::HandleLogin, so that the login is authorized as in the recording.
+        newUser->loginData = loginData;
+        QDomDocument xml;
+        xml.setContent(loginData);
+        for(QDomElement elem = xml.firstChildElement().firstChildElement(); !elem.isNull(); elem = elem.nextSiblingElement())
+            newUser->SetProperty(elem.tagName(), elem.attribute("value"));
+
+        if (user != users_.end())
+        {
+            server->RemoveExternalUser(user->second);
+            users_.erase(user);
+        }
+        if (server->AddExternalUser(newUser))
+            users_[connectionId] = newUser;
+        else
+            LogWarning("NetworkTrafficReplay: Replayed user " + QString::number(connectionId) + " was denied access.");
+        break;
+    }
+    case NetworkTrafficRecorder::RecordMessage:
+    {
+        const kNet::message_id_t messageId = dd.ReadVLE<kNet::VLE8_16_32>();
+        const u32 numBytes = dd.ReadVLE<kNet::VLE8_16_32>();
+        if (numBytes > dd.BytesLeft())
+            throw kNet::NetException("Message exceeds the end of the recording");
+        const char *payload = data_.constData() + pos_ + dd.BytePos();
+        dd.SkipBytes(numBytes);
+        // Messages of users that were connected before the recording started can not be replayed.
+        if (user != users_.end() && user->second->properties["authenticated"].toBool())
+        {
+            server->EmitNetworkMessageReceived(user->second.get(), 0, messageId, payload, numBytes);
+            ++messagesReplayed_;
+            bytesReplayed_ += numBytes;
+        }
+        break;
+    }
+    case NetworkTrafficRecorder::RecordDisconnected:
+        if (user != users_.end())
+        {
+            server->RemoveExternalUser(user->second);
+            users_.erase(user);
+        }
+        break;
+    default:
+        throw kNet::NetException("Unknown record type");
+    }
+
+    pos_ += dd.BytePos();
+    PeekNextRecordTime();
+}
+
+void NetworkTrafficReplay::RemoveUsers()
+{
+    Server *server = owner_->GetServer().get();
+    if (server)
+    {
+        for(std::map<u32, shared_ptr<ReplayUserConnection> >::iterator it = users_.begin(); it != users_.end(); ++it)
+            server->RemoveExternalUser(it->second);
+    }
+    users_.clear();
+}
+
+void NetworkTrafficReplay::ReportStatistics(bool final)
+{
+    reportTimer_ = 0.0;
+    u64 messagesSent = 0;
+    u64 bytesSent = 0;
+    for(std::map<u32, shared_ptr<ReplayUserConnection> >::const_iterator it = users_.begin(); it != users_.end(); ++it)
+    {
+        messagesSent += it->second->messagesSent;
+        bytesSent += it->second->bytesSent;
+    }
+
+    const double elapsed = startTime_ ? kNet::Clock::SecondsSinceD(startTime_) : 0.0;
+    LogInfo(QString("NetworkTrafficReplay: %1 %2 s of recording in %3 s. %4 frames, frame time average %5 ms, max %6 ms. "
+        "Replayed %7 messages (%8 bytes), sent %9 messages (%10 bytes) to %11 replayed users.")
+        .arg(final ? "Finished replaying" : "Replayed").arg(recordTime_, 0, 'f', 1).arg(elapsed, 0, 'f', 1)
+        .arg(numFrames_).arg(numFrames_ ? totalFrameTimeMs_ / numFrames_ : 0.0, 0, 'f', 2).arg(maxFrameTimeMs_, 0, 'f', 2)
+        .arg(messagesReplayed_).arg(bytesReplayed_).arg(messagesSent).arg(bytesSent).arg(users_.size()));
+}
+
+}
@@ -0,0 +1,108 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "TundraProtocolModuleApi.h"
+#include "TundraProtocolModuleFwd.h"
+#include "UserConnection.h"
+#include "CoreTypes.h"
+
+#include <kNet/Types.h>
+#include <kNet/Clock.h>
+
+#include <QByteArray>
+#include <QString>
+
+#include <map>
+
+class Framework;
+
+namespace TundraLogic
+{
+
+/// A user connection recreated from a network traffic recording. Discards the messages sent to it, but counts them.
+class TUNDRAPROTOCOL_MODULE_API ReplayUserConnection : public UserConnection
+{
+    Q_OBJECT
+
+public:
+    ReplayUserConnection() : messagesSent(0), bytesSent(0) {}
+
+    virtual QString ConnectionType() const { return "replay"; }
+
+    /// Counts the message and discards it.
+    virtual void Send(kNet::message_id_t id, const char* data, size_t numBytes, bool reliable, bool inOrder, unsigned long priority = 100, unsigned long contentID = 0);
+
+    /// Number of messages sent to the connection.
+    u64 messagesSent;
+    /// Number of payload bytes sent to the connection.
+    u64 bytesSent;
+
+public slots:
+    /// Does nothing, the connection is removed when the recording says so.
+    virtual void Disconnect() {}
+    /// Does nothing, the connection is removed when the recording says so.
+    virtual void Close() {}
+};
+
+/// Replays a network traffic recording made with NetworkTrafficRecorder into the running server.
+/** Started with the --replayNetworkTraffic <file> command line parameter together with --server, typically headless and with the
+    same startup scene as the recording. The recorded users are added to the server as ReplayUserConnections, and their messages are
+    fed to the server as if they had been received from the network, so that they are handled by SyncManager::HandleNetworkMessage().
+
+    The --replaySpeed <factor> parameter scales the replay speed; 0 replays at maximum speed, advancing the recording by one sync
+    update period on each frame. The server frame time is reported periodically and when the replay finishes, after which
+    the application exits. */
+class TUNDRAPROTOCOL_MODULE_API NetworkTrafficReplay
+{
+public:
+    explicit NetworkTrafficReplay(TundraLogicModule *owner);
+    ~NetworkTrafficReplay();
+
+    /// Reads the recording into memory.
+    /** @return False if the file could not be read or is not a network traffic recording. */
+    bool Open(const QString &filename);
+
+    /// Sets the replay speed factor, 0 for maximum speed.
+    void SetSpeed(float speed) { speed_ = speed >= 0.f ? speed : 1.f; }
+    /// Returns the replay speed factor.
+    float Speed() const { return speed_; }
+
+    /// Returns whether all records have been replayed.
+    bool IsFinished() const { return pos_ >= (size_t)data_.size(); }
+
+    /// Replays the records that are due, and measures the frame time. Call once per frame.
+    void Update(f64 frametime);
+
+private:
+    /// Reads the time of the record at the read position, if any, into nextRecordTime_.
+    void PeekNextRecordTime();
+    /// Replays the record at the read position.
+    void ReplayRecord();
+    /// Removes all replayed users from the server.
+    void RemoveUsers();
+    /// Logs the frame time statistics and the amount of replayed traffic.
+    void ReportStatistics(bool final);
+
+    TundraLogicModule *owner_;
+    Framework *framework_;
+    QString filename_;
+    QByteArray data_; ///< The whole recording.
+    size_t pos_; ///< Read position of the next record in data_.
+    double recordTime_; ///< Recording time of the latest replayed record in seconds.
+    double nextRecordTime_; ///< Recording time of the next record in seconds.
+    double replayTime_; ///< Current replay time in seconds, on the recording's time line.
+    float speed_;
+    std::map<u32, shared_ptr<ReplayUserConnection> > users_; ///< Replayed users by their recorded connection ID.
+
+    kNet::tick_t lastFrameTime_; ///< Time of the previous Update() call, 0 on the first frame.
+    u32 numFrames_;
+    double totalFrameTimeMs_;
+    double maxFrameTimeMs_;
+    double reportTimer_; ///< Seconds since the previous statistics report.
+    u64 messagesReplayed_;
+    u64 bytesReplayed_;
+    kNet::tick_t startTime_;
+};
+
+}
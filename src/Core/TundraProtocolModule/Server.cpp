@@ -7,6 +7,7 @@
 #include "TundraLogicModule.h"
 #include "SyncManager.h"
 #include "KristalliProtocolModule.h"
+#include "NetworkTrafficRecorder.h"
 #include "TundraMessages.h"
 #include "MsgLogin.h"
 #include "MsgLoginReply.h"
@@ -102,6 +103,15 @@ bool Server::Start(unsigned short port, QString protocol)
 //    framework_->Scene()->SetDefaultScene(scene);
     owner_->GetSyncManager()->RegisterToScene(scene);
 
+    // Record the received network traffic for replaying, if requested
+    QStringList recordParam = framework_->CommandLineParameters("--recordNetworkTraffic");
+    if (!recordParam.empty())
+    {
+        trafficRecorder_ = MAKE_SHARED(NetworkTrafficRecorder);
+        if (!trafficRecorder_->Open(recordParam.last()))
+            trafficRecorder_.reset();
+    }
+
     emit ServerStarted();
 
     KristalliProtocolModule *kristalli = framework_->GetModule<KristalliProtocolModule>();
@@ -120,6 +130,7 @@ void Server::Stop()
         ::LogInfo("Stopped Tundra server. Removing TundraServer scene.");
 
         owner_->GetKristalliModule()->StopServer();
+        trafficRecorder_.reset();
         framework_->Scene()->RemoveScene("TundraServer");
         
         emit ServerStopped();
@@ -260,6 +271,9 @@ void Server::RemoveExternalUser(UserConnectionPtr user)
     // If user had zero ID, was not logged in yet and does not need to be reported
     if (user->userID)
     {
+        if (trafficRecorder_)
+            trafficRecorder_->RecordDisconnect(user.get());
+
         // Tell everyone of the client leaving
         MsgClientLeft left;
         left.userID = user->userID;
@@ -308,6 +322,10 @@ void Server::EmitNetworkMessageReceived(UserConnection* user, kNet::packet_id_t
 {
     if (user)
     {
+        // The login is recorded as the connect record instead
+        if (trafficRecorder_ && messageId != MsgLogin::messageID)
+            trafficRecorder_->RecordNetworkMessage(user, messageId, data, numBytes);
+
         // Emit both global and user-specific message
         emit MessageReceived(user, packetId, messageId, data, numBytes);
         user->EmitNetworkMessageReceived(packetId, messageId, data, numBytes);
@@ -376,6 +394,8 @@ bool Server::FinalizeLogin(UserConnectionPtr user)
     }
     
     ::LogInfo("User with connection ID " + QString::number(user->userID) + " and protocol version " + QString::number(user->protocolVersion) + " logged in.");
+    if (trafficRecorder_)
+        trafficRecorder_->RecordConnect(user.get());
     
     // Allow entityactions & EC sync from now on
     MsgLoginReply reply;
@@ -429,6 +449,9 @@ bool Server::FinalizeLogin(UserConnectionPtr user)
 
 void Server::HandleUserDisconnected(UserConnection* user)
 {
+    if (trafficRecorder_)
+        trafficRecorder_->RecordDisconnect(user);
+
     // Tell everyone of the client leaving
     MsgClientLeft left;
     left.userID = user->userID;
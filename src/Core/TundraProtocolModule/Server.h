@@ -133,6 +133,9 @@ private:
     /// Finalize the login of a user. Allow security plugins to inspect login credentials. Return true if allowed to log in
     bool FinalizeLogin(UserConnectionPtr user);
 
+    /// Records the received network traffic if the --recordNetworkTraffic command line parameter is given, null otherwise.
+    shared_ptr<NetworkTrafficRecorder> trafficRecorder_;
+
     UserConnectionWeakPtr actionSender;
     TundraLogicModule* owner_;
     Framework* framework_;
@@ -0,0 +1,122 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "StringTable.h"
+
+#include <kNet/DataSerializer.h>
+#include <kNet/DataDeserializer.h>
+#include <kNet/NetException.h>
+
+#include "MemoryLeakCheck.h"
+
+namespace TundraLogic
+{
+
+namespace
+{
+    /// Writes a string as VLE length followed by the bytes.
+    void WriteLiteral(kNet::DataSerializer &ds, const std::string &str)
+    {
+        ds.AddVLE<kNet::VLE8_16_32>((u32)str.size());
+        if (!str.empty())
+            ds.AddArray<u8>((const u8*)str.data(), (u32)str.size());
+    }
+
+    /// Reads a string written by WriteLiteral().
+    std::string ReadLiteral(kNet::DataDeserializer &ds)
+    {
+        const u32 length = ds.ReadVLE<kNet::VLE8_16_32>();
+        if (length > ds.BytesLeft())
+            throw kNet::NetException("Out of bounds string length in scene sync message");
+        std::string str(length, '\0');
+        if (length)
+            ds.ReadArray<u8>((u8*)&str[0], length);
+        return str;
+    }
+}
+
+StringTable::StringTable() :
+    numAnnounced_(0)
+{
+}
+
+void StringTable::WriteString(kNet::DataSerializer &ds, const std::string &str, bool internOnFirstUse)
+{
+    std::map<std::string, u32>::const_iterator it = ids_.find(str);
+    if (it != ids_.end())
+    {
+        ds.AddVLE<kNet::VLE8_16_32>(it->second);
+        return;
+    }
+
+    bool intern = str.size() <= cMaxInternedLength && strings_.size() < cMaxStrings;
+    if (intern && !internOnFirstUse && seen_.insert(str).second)
+    {
+        // Forget the candidates every now and then, so that one-off values do not accumulate
+        if (seen_.size() > cMaxStrings)
+            seen_.clear();
+        intern = false;
+    }
+
+    if (!intern)
+    {
+        ds.AddVLE<kNet::VLE8_16_32>(0);
+        WriteLiteral(ds, str);
+        return;
+    }
+
+    seen_.erase(str);
+    strings_.push_back(str);
+    const u32 id = (u32)strings_.size();
+    ids_[str] = id;
+    ds.AddVLE<kNet::VLE8_16_32>(id);
+}
+
+std::string StringTable::ReadString(kNet::DataDeserializer &ds) const
+{
+    const u32 id = ds.ReadVLE<kNet::VLE8_16_32>();
+    if (id == 0)
+        return ReadLiteral(ds);
+    if (id > strings_.size())
+        throw kNet::NetException("Unknown string ID in scene sync message");
+    return strings_[id - 1];
+}
+
+size_t StringTable::NewStringsSize() const
+{
+    size_t size = 2 * 4;
+    for(size_t i = numAnnounced_; i < strings_.size(); ++i)
+        size += 4 + strings_[i].size();
+    return size;
+}
+
+void StringTable::WriteNewStrings(kNet::DataSerializer &ds)
+{
+    ds.AddVLE<kNet::VLE8_16_32>((u32)numAnnounced_ + 1); // ID of the first new string
+    ds.AddVLE<kNet::VLE8_16_32>((u32)(strings_.size() - numAnnounced_));
+    for(size_t i = numAnnounced_; i < strings_.size(); ++i)
+        WriteLiteral(ds, strings_[i]);
+    numAnnounced_ = strings_.size();
+}
+
+void StringTable::ReadNewStrings(kNet::DataDeserializer &ds)
+{
+    const u32 firstId = ds.ReadVLE<kNet::VLE8_16_32>();
+    const u32 count = ds.ReadVLE<kNet::VLE8_16_32>();
+    if (firstId != strings_.size() + 1 || count > cMaxStrings - strings_.size())
+        throw kNet::NetException("Malformed StringTable message");
+    for(u32 i = 0; i < count; ++i)
+        strings_.push_back(ReadLiteral(ds));
+}
+
+void StringTable::Clear()
+{
+    ids_.clear();
+    seen_.clear();
+    strings_.clear();
+    numAnnounced_ = 0;
+}
+
+}
@@ -0,0 +1,69 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "TundraProtocolModuleApi.h"
+#include "CoreTypes.h"
+
+#include <kNetFwd.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace TundraLogic
+{
+
+/// Per-connection dictionary of strings repeated in scene sync messages, used with protocol version ProtocolStringTable and newer.
+/** Each end of a user connection has one table for the strings it sends and one for the strings it receives. The sender assigns
+    the next free ID to each new string and announces the new strings to the peer in a StringTable message, which must be sent
+    before the messages that use them. As the scene sync messages are reliable and in order, the receiver knows every ID by the time
+    it is used. IDs are never reused, so messages held back by the receiver can be decoded later.
+
+    A string is written as a VLE: its ID, or 0 followed by the string itself (VLE length and the bytes) when it is not interned.
+    The table holds at most cMaxStrings strings; after that, new strings are always written in full. */
+class TUNDRAPROTOCOL_MODULE_API StringTable
+{
+public:
+    /// Maximum number of strings in a table.
+    static const size_t cMaxStrings = 4096;
+    /// Longer strings are never interned.
+    static const size_t cMaxInternedLength = 255;
+
+    StringTable();
+
+    /// Writes a string, interning it first if it is new.
+    /** @param internOnFirstUse If false, the string is interned only when it is written for the second time. Use for values
+        such as action parameters, which are often used only once. */
+    void WriteString(kNet::DataSerializer &ds, const std::string &str, bool internOnFirstUse = true);
+
+    /// Reads a string written with WriteString() by the sending table of the peer. Throws NetException on an unknown ID.
+    std::string ReadString(kNet::DataDeserializer &ds) const;
+
+    /// Returns whether there are new strings that have not been announced to the peer yet.
+    bool HasNewStrings() const { return numAnnounced_ < strings_.size(); }
+
+    /// Returns an upper bound of the size of the StringTable message announcing the new strings, in bytes.
+    size_t NewStringsSize() const;
+
+    /// Writes the payload of a StringTable message announcing the new strings, and marks them announced.
+    void WriteNewStrings(kNet::DataSerializer &ds);
+
+    /// Adds the strings announced by the peer in a StringTable message. Throws NetException if the message is malformed.
+    void ReadNewStrings(kNet::DataDeserializer &ds);
+
+    /// Returns the number of strings in the table.
+    size_t Size() const { return strings_.size(); }
+
+    /// Forgets all strings. Both ends must clear their tables at the same point, ie. when the connection is (re)established.
+    void Clear();
+
+private:
+    std::map<std::string, u32> ids_; ///< IDs of the sent strings.
+    std::set<std::string> seen_; ///< Strings written once that wait for their second use to be interned.
+    std::vector<std::string> strings_; ///< The strings by ID - 1.
+    size_t numAnnounced_; ///< Number of sent strings announced to the peer.
+};
+
+}
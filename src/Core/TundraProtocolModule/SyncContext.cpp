@@ -0,0 +1,182 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "SyncContext.h"
+#include "UserConnection.h"
+#include "AttributeEncodingCache.h"
+#include "AttributeDelta.h"
+#include "IAttribute.h"
+#include "LoggingFunctions.h"
+#include "TundraMessages.h"
+
+#include <cstring>
+
+#include "MemoryLeakCheck.h"
+
+namespace TundraLogic
+{
+
+SyncContext::SyncContext(bool deferred) :
+    encodingCache(0),
+    deferred_(deferred),
+    bytesSent_(0),
+    batchUser_(0),
+    batchCount_(0),
+    batchFirstId_(0),
+    batchFirstOffset_(0)
+{
+}
+
+void SyncContext::WriteAttribute(kNet::DataSerializer &ds, entity_id_t entityId, component_id_t componentId, IAttribute *attr)
+{
+    if (encodingCache)
+        encodingCache->Write(ds, entityId, componentId, attr, attrEncodeBuffer, sizeof(attrEncodeBuffer));
+    else
+        attr->ToBinary(ds);
+}
+
+void SyncContext::WriteAttributeDelta(kNet::DataSerializer &ds, entity_id_t entityId, component_id_t componentId, IAttribute *attr,
+    std::vector<u8> &baseline)
+{
+    if (encodingCache)
+    {
+        QByteArray encoding = encodingCache->Encode(entityId, componentId, attr, attrEncodeBuffer, sizeof(attrEncodeBuffer));
+        AttributeDelta::Write(ds, (const u8*)encoding.constData(), (size_t)encoding.size(), baseline, attrDeltaBuffer, sizeof(attrDeltaBuffer));
+    }
+    else
+    {
+        kNet::DataSerializer encodeDs(attrEncodeBuffer, sizeof(attrEncodeBuffer));
+        attr->ToBinary(encodeDs);
+        AttributeDelta::Write(ds, (const u8*)attrEncodeBuffer, encodeDs.BytesFilled(), baseline, attrDeltaBuffer, sizeof(attrDeltaBuffer));
+    }
+}
+
+void SyncContext::Send(UserConnection *user, kNet::message_id_t id, bool reliable, bool inOrder, kNet::DataSerializer &ds,
+    unsigned long priority, unsigned long contentID)
+{
+    bytesSent_ += ds.BytesFilled();
+    const size_t numBytes = ds.BytesFilled();
+
+    if (reliable && inOrder && priority == 100 && contentID == 0 && user->ProtocolVersion() >= ProtocolBatchedMessages)
+    {
+        char header[8];
+        kNet::DataSerializer headerDs(header, sizeof(header));
+        headerDs.AddVLE<kNet::VLE8_16_32>(id);
+        headerDs.AddVLE<kNet::VLE8_16_32>((u32)numBytes);
+        const size_t entrySize = headerDs.BytesFilled() + numBytes;
+
+        if (batchUser_ != user || batchData_.size() + entrySize > cMaxBatchSize)
+            FlushBatch();
+        if (entrySize <= cMaxBatchSize)
+        {
+            if (!batchCount_)
+            {
+                batchFirstId_ = id;
+                batchFirstOffset_ = headerDs.BytesFilled();
+            }
+            batchData_.insert(batchData_.end(), header, header + headerDs.BytesFilled());
+            if (numBytes)
+                batchData_.insert(batchData_.end(), ds.GetData(), ds.GetData() + numBytes);
+            batchUser_ = user;
+            ++batchCount_;
+            return;
+        }
+    }
+    else if (batchUser_ == user)
+        FlushBatch(); // Keep the order of the messages to the user.
+
+    SendMessage(user, id, ds.GetData(), numBytes, reliable, inOrder, priority, contentID);
+}
+
+void SyncContext::FlushBatch()
+{
+    if (!batchUser_)
+        return;
+
+    // A lone message is sent as is, without the batch overhead
+    if (batchCount_ == 1)
+    {
+        const size_t numBytes = batchData_.size() - batchFirstOffset_;
+        SendMessage(batchUser_, batchFirstId_, numBytes ? &batchData_[batchFirstOffset_] : 0, numBytes, true, true, 100, 0);
+    }
+    else
+        SendMessage(batchUser_, cBatchedSceneMessage, &batchData_[0], batchData_.size(), true, true, 100, 0);
+
+    batchUser_ = 0;
+    batchData_.clear();
+    batchCount_ = 0;
+}
+
+void SyncContext::SendMessage(UserConnection *user, kNet::message_id_t id, const char *data, size_t numBytes, bool reliable, bool inOrder,
+    unsigned long priority, unsigned long contentID)
+{
+    if (!deferred_)
+    {
+        user->Send(id, numBytes ? data : 0, numBytes, reliable, inOrder, priority, contentID);
+        return;
+    }
+
+    QueuedMessage msg;
+    msg.user = user;
+    msg.id = id;
+    msg.reliable = reliable;
+    msg.inOrder = inOrder;
+    msg.priority = priority;
+    msg.contentID = contentID;
+    msg.offset = messageData_.size();
+    msg.numBytes = numBytes;
+    if (msg.numBytes)
+    {
+        messageData_.resize(msg.offset + msg.numBytes);
+        memcpy(&messageData_[msg.offset], data, msg.numBytes);
+    }
+    messages_.push_back(msg);
+}
+
+void SyncContext::LogWarning(const QString &msg)
+{
+    if (!deferred_)
+    {
+        ::LogWarning(msg);
+        return;
+    }
+    QueuedLogLine line = { false, msg };
+    logLines_.push_back(line);
+}
+
+void SyncContext::LogError(const QString &msg)
+{
+    if (!deferred_)
+    {
+        ::LogError(msg);
+        return;
+    }
+    QueuedLogLine line = { true, msg };
+    logLines_.push_back(line);
+}
+
+void SyncContext::Flush()
+{
+    FlushBatch();
+
+    for(size_t i = 0; i < logLines_.size(); ++i)
+    {
+        if (logLines_[i].error)
+            ::LogError(logLines_[i].text);
+        else
+            ::LogWarning(logLines_[i].text);
+    }
+    logLines_.clear();
+
+    for(size_t i = 0; i < messages_.size(); ++i)
+    {
+        const QueuedMessage &msg = messages_[i];
+        msg.user->Send(msg.id, msg.numBytes ? &messageData_[msg.offset] : 0, msg.numBytes, msg.reliable, msg.inOrder, msg.priority, msg.contentID);
+    }
+    messages_.clear();
+    messageData_.clear();
+}
+
+}
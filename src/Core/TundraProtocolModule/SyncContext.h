@@ -0,0 +1,158 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "TundraProtocolModuleApi.h"
+#include "TundraProtocolModuleFwd.h"
+#include "CoreTypes.h"
+
+#include <kNet/Types.h>
+#include <kNet/DataSerializer.h>
+
+#include <QString>
+
+#include <vector>
+
+class IAttribute;
+
+namespace TundraLogic
+{
+
+class AttributeEncodingCache;
+
+/// Scratch buffers and outbound message sink used when serializing the sync state of user connections.
+/** SyncManager owns one non-deferred context for the main thread. When parallel sync is enabled, each worker
+    thread gets its own deferred context: the produced messages and log lines are queued and then sent/printed
+    on the main thread by calling Flush(), in the order they were produced.
+
+    For user connections with protocol version ProtocolBatchedMessages or newer, consecutive reliable in-order messages
+    with the default priority are packed into BatchedSceneMessages of at most cMaxBatchSize bytes, instead of sending
+    each of them separately. The pending batch is sent when a message to another user, a message that can not be batched
+    or a message that does not fit arrives, or when FlushBatch() is called. */
+class TUNDRAPROTOCOL_MODULE_API SyncContext
+{
+public:
+    /// Maximum payload size of a BatchedSceneMessage, chosen so that a full batch fits in a single UDP datagram.
+    static const size_t cMaxBatchSize = 1200;
+
+    /// @param deferred If true, Send() and the logging functions queue their output until Flush() is called.
+    explicit SyncContext(bool deferred = false);
+
+    /// Sends a message to the user immediately, or queues it if the context is deferred. The message may be held in the pending batch.
+    /** @note Messages sent directly to the user, bypassing the context, must be preceded by a FlushBatch() to keep them in order. */
+    void Send(UserConnection *user, kNet::message_id_t id, bool reliable, bool inOrder, kNet::DataSerializer &ds,
+        unsigned long priority = 100, unsigned long contentID = 0);
+
+    /// Sends a typed network message to the user, or queues it if the context is deferred.
+    template<typename SerializableMessage>
+    void Send(UserConnection *user, const SerializableMessage &msg)
+    {
+        kNet::DataSerializer ds(msg.Size());
+        msg.SerializeTo(ds);
+        Send(user, SerializableMessage::messageID, msg.reliable, msg.inOrder, ds);
+    }
+
+    /// Logs a warning, or queues it if the context is deferred.
+    void LogWarning(const QString &msg);
+    /// Logs an error, or queues it if the context is deferred.
+    void LogError(const QString &msg);
+
+    /// Sends or queues the pending batch of messages, if any.
+    void FlushBatch();
+
+    /// Sends out the pending batch, all queued messages and prints all queued log lines. Must be called from the main thread.
+    void Flush();
+
+    /// Returns whether the output of this context is deferred.
+    bool IsDeferred() const { return deferred_; }
+
+    /// Returns the total number of message payload bytes sent or queued through this context.
+    size_t BytesSent() const { return bytesSent_; }
+
+    /// Writes the binary encoding of an attribute, through the shared encoding cache if one is set.
+    void WriteAttribute(kNet::DataSerializer &ds, entity_id_t entityId, component_id_t componentId, IAttribute *attr);
+
+    /// Writes an attribute value delta-encoded against its baseline, and updates the baseline. @sa AttributeDelta
+    void WriteAttributeDelta(kNet::DataSerializer &ds, entity_id_t entityId, component_id_t componentId, IAttribute *attr, std::vector<u8> &baseline);
+
+    /// Shared attribute encoding cache, or null if the attributes should be encoded directly. Not owned.
+    AttributeEncodingCache *encodingCache;
+
+    /// Fixed buffers for crafting messages
+    char createEntityBuffer[64 * 1024];
+    char createCompsBuffer[64 * 1024];
+    char editAttrsBuffer[64 * 1024];
+    char createAttrsBuffer[16 * 1024];
+    char attrDataBuffer[16 * 1024];
+    char removeCompsBuffer[1024];
+    char removeEntityBuffer[1024];
+    char removeAttrsBuffer[1024];
+    char attrEncodeBuffer[16 * 1024];
+    char attrDeltaBuffer[16 * 1024];
+    std::vector<u8> changedAttributes;
+
+    /// Edited attribute with AttributeMetadata::latestValueWins, sent in its own EditAttributes message with a content ID.
+    struct LatestValueAttribute
+    {
+        component_id_t componentId;
+        u8 index;
+        IAttribute *attribute;
+    };
+    std::vector<LatestValueAttribute> latestValueAttributes;
+    std::vector<u8> latestValueBaseline; ///< Always empty baseline for writing the latest value wins attributes in full.
+
+    /// Dirty entity scheduled for sending, ordered by score in a max-heap.
+    struct ScheduledEntity
+    {
+        EntitySyncState *state;
+        float score;
+        bool starving; ///< The entity has waited longer than the starvation limit; it goes first and ignores the byte budget.
+
+        bool operator <(const ScheduledEntity &rhs) const
+        {
+            if (starving != rhs.starving)
+                return !starving;
+            return score < rhs.score;
+        }
+    };
+    /// Heap of scheduled entities, reused between updates.
+    std::vector<ScheduledEntity> schedule;
+    /// Entities checked for rigid body changes, reused between updates.
+    std::vector<EntitySyncState*> rigidBodyCandidates;
+
+private:
+    struct QueuedMessage
+    {
+        UserConnection *user;
+        kNet::message_id_t id;
+        bool reliable;
+        bool inOrder;
+        unsigned long priority;
+        unsigned long contentID;
+        size_t offset; ///< Offset of the message data in messageData_.
+        size_t numBytes;
+    };
+
+    struct QueuedLogLine
+    {
+        bool error;
+        QString text;
+    };
+
+    /// Sends a message to the user immediately, or queues it if the context is deferred.
+    void SendMessage(UserConnection *user, kNet::message_id_t id, const char *data, size_t numBytes, bool reliable, bool inOrder,
+        unsigned long priority, unsigned long contentID);
+
+    bool deferred_;
+    size_t bytesSent_;
+    UserConnection *batchUser_; ///< Recipient of the pending batch, null if there is none.
+    std::vector<char> batchData_; ///< Messages of the pending batch as (VLE message ID, VLE size, payload) entries.
+    size_t batchCount_; ///< Number of messages in the pending batch.
+    kNet::message_id_t batchFirstId_; ///< ID of the first message of the pending batch.
+    size_t batchFirstOffset_; ///< Offset of the payload of the first message in batchData_.
+    std::vector<QueuedMessage> messages_;
+    std::vector<char> messageData_; ///< Payloads of all queued messages, back to back. Capacity is retained between flushes.
+    std::vector<QueuedLogLine> logLines_;
+};
+
+}
@@ -25,11 +25,18 @@
 #include "UserConnection.h"
 #include "EC_Mesh.h"
 #include "OgreMeshAsset.h"
+#include "AttributeDelta.h"
 //#include "EC_Sound.h"
 
 #include <kNet.h>
 
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+
 #include <cstring>
+#include <algorithm>
+#include <functional>
 
 #include "MemoryLeakCheck.h"
 
@@ -161,26 +168,111 @@ int DetectRotSendType(bool rotChanged, const float3x3 &rot)
         return 0;
 }
 
+// Reads a delta-encoded attribute value, updates the baseline, and writes the value in full.
+void DecodeAttributeValue(kNet::DataDeserializer &src, AttributeBaselines &baselines, unsigned attrIndex, std::vector<u8> &value, kNet::DataSerializer &dest)
+{
+    if (attrIndex >= 256)
+        throw kNet::NetException("Out of bounds attribute index in EditAttributes message");
+    if (attrIndex >= baselines.size())
+        baselines.resize(attrIndex + 1);
+    if (!TundraLogic::AttributeDelta::Read(src, baselines[attrIndex], value))
+        LogWarning("Delta-encoded value of attribute index " + QString::number(attrIndex) + " received without a baseline in EditAttributes message");
+    if (!value.empty())
+        dest.AddArray<u8>(&value[0], (u32)value.size());
+}
+
+// Marks the entity's transform changes unsent by dead reckoning, so that they are rechecked on the next update.
+void MarkTransformPending(SceneSyncState *state, EntitySyncState &ess)
+{
+    if (!ess.transformPending)
+    {
+        ess.transformPending = true;
+        state->pendingRigidBodies.push_back(ess.id);
+    }
+}
+
+// Returns the kNet content ID of a latest value wins attribute, unique per entity, component and attribute, or 0 if the IDs do not fit into it.
+u32 LatestValueContentId(entity_id_t entityId, component_id_t compId, u8 attrIndex)
+{
+    if (entityId > 0xFFFFF || compId > 0xF)
+        return 0;
+    return (entityId << 12) | (compId << 8) | attrIndex;
+}
+
+/// Returns the table of the strings sent to the user, or null if the user does not support string interning.
+TundraLogic::StringTable *SentStrings(UserConnection *user)
+{
+    return user->ProtocolVersion() >= ProtocolStringTable ? &user->sentStrings : 0;
+}
+
+/// Returns the table of the strings received from the user, or null if the user does not support string interning.
+const TundraLogic::StringTable *ReceivedStrings(UserConnection *user)
+{
+    return user->ProtocolVersion() >= ProtocolStringTable ? &user->receivedStrings : 0;
+}
+
+/// Writes a name through the string table, or in full if there is none.
+void WriteName(kNet::DataSerializer &ds, const std::string &name, TundraLogic::StringTable *strings)
+{
+    if (strings)
+        strings->WriteString(ds, name);
+    else
+        ds.AddString(name);
+}
+
+/// Reads a name written by WriteName().
+std::string ReadName(kNet::DataDeserializer &ds, const TundraLogic::StringTable *strings)
+{
+    return strings ? strings->ReadString(ds) : ds.ReadString();
+}
+
+/// Writes an EntityAction message with the name and parameters interned, for protocol version ProtocolStringTable and newer.
+void WriteInternedEntityAction(kNet::DataSerializer &ds, const MsgEntityAction &msg, TundraLogic::StringTable &strings)
+{
+    ds.Add<u32>(msg.entityId);
+    strings.WriteString(ds, BufferToString(msg.name));
+    ds.Add<u8>(msg.executionType);
+    ds.AddVLE<kNet::VLE8_16_32>((u32)msg.parameters.size());
+    // Parameters are often unique values, so intern only the repeated ones
+    for(size_t i = 0; i < msg.parameters.size(); ++i)
+        strings.WriteString(ds, BufferToString(msg.parameters[i].parameter), false);
+}
+
+/// Reads an EntityAction message written by WriteInternedEntityAction().
+void ReadInternedEntityAction(kNet::DataDeserializer &ds, MsgEntityAction &msg, const TundraLogic::StringTable &strings)
+{
+    msg.entityId = ds.Read<u32>();
+    msg.name = StringToBuffer(strings.ReadString(ds));
+    msg.executionType = ds.Read<u8>();
+    const u32 numParams = ds.ReadVLE<kNet::VLE8_16_32>();
+    if (numParams > ds.BytesLeft())
+        throw kNet::NetException("Malformed EntityAction message");
+    msg.parameters.resize(numParams);
+    for(u32 i = 0; i < numParams; ++i)
+        msg.parameters[i].parameter = StringToBuffer(strings.ReadString(ds));
+}
+
 } // ~unnamed namespace
 
 namespace TundraLogic
 {
 
-void SyncManager::WriteComponentFullUpdate(kNet::DataSerializer& ds, ComponentPtr comp)
+void SyncManager::WriteComponentFullUpdate(SyncContext& ctx, kNet::DataSerializer& ds, ComponentPtr comp, StringTable* strings)
 {
     // Component identification
     ds.AddVLE<kNet::VLE8_16_32>(comp->Id() & UniqueIdGenerator::LAST_REPLICATED_ID);
     ds.AddVLE<kNet::VLE8_16_32>(comp->TypeId());
-    ds.AddString(comp->Name().toStdString());
+    WriteName(ds, comp->Name().toStdString(), strings);
     
     // Create a nested dataserializer for the attributes, so we can survive unknown or incompatible components
-    kNet::DataSerializer attrDs(attrDataBuffer_, 16 * 1024);
+    kNet::DataSerializer attrDs(ctx.attrDataBuffer, 16 * 1024);
+    const entity_id_t entityId = comp->ParentEntity() ? comp->ParentEntity()->Id() : 0;
     
     // Static-structured attributes
     unsigned numStaticAttrs = comp->NumStaticAttributes();
     const AttributeVector& attrs = comp->Attributes();
     for (uint i = 0; i < numStaticAttrs; ++i)
-        attrs[i]->ToBinary(attrDs);
+        ctx.WriteAttribute(attrDs, entityId, comp->Id(), attrs[i]);
     
     // Dynamic-structured attributes (use EOF to detect so do not need to send their amount)
     for (unsigned i = numStaticAttrs; i < attrs.size(); ++i)
@@ -189,14 +281,50 @@ void SyncManager::WriteComponentFullUpdate(kNet::DataSerializer& ds, ComponentPt
         {
             attrDs.Add<u8>(i); // Index
             attrDs.Add<u8>(attrs[i]->TypeId());
-            attrDs.AddString(attrs[i]->Name().toStdString());
-            attrs[i]->ToBinary(attrDs);
+            WriteName(attrDs, attrs[i]->Name().toStdString(), strings);
+            ctx.WriteAttribute(attrDs, entityId, comp->Id(), attrs[i]);
         }
     }
     
     // Add the attribute array to the main serializer
     ds.AddVLE<kNet::VLE8_16_32>((u32)attrDs.BytesFilled());
-    ds.AddArray<u8>((unsigned char*)attrDataBuffer_, (u32)attrDs.BytesFilled());
+    ds.AddArray<u8>((unsigned char*)ctx.attrDataBuffer, (u32)attrDs.BytesFilled());
+}
+
+void SyncManager::WriteEntityFullUpdate(SyncContext& ctx, kNet::DataSerializer& ds, Entity* entity, bool writeParent)
+{
+    unsigned sceneId = 0; ///\todo Replace with proper scene ID once multiscene support is in place.
+    
+    // Entity identification and temporary flag
+    ds.AddVLE<kNet::VLE8_16_32>(sceneId);
+    ds.AddVLE<kNet::VLE8_16_32>(entity->Id() & UniqueIdGenerator::LAST_REPLICATED_ID);
+    // Do not write the temporary flag as a bit to not desync the byte alignment at this point, as a lot of data potentially follows
+    ds.Add<u8>(entity->IsTemporary() ? 1 : 0);
+    // If hierarchic scene is supported, send parent entity ID or 0 if unparented. Note that this is a full 32bit ID to handle the unacked range if necessary
+    if (writeParent)
+    {
+        if (entity->Parent() && entity->Parent()->IsLocal())
+            ctx.LogWarning("Replicated entity " + QString::number(entity->Id()) + " is parented to a local entity, can not replicate parenting properly over the network");
+
+        ds.Add<u32>(entity->Parent() ? entity->Parent()->Id() : 0);
+    }
+    
+    const Entity::ComponentMap& components = entity->Components();
+    // Count the amount of replicated components
+    uint numReplicatedComponents = 0;
+    for (Entity::ComponentMap::const_iterator i = components.begin(); i != components.end(); ++i)
+    {
+        if (i->second->IsReplicated())
+            ++numReplicatedComponents;
+    }
+    ds.AddVLE<kNet::VLE8_16_32>(numReplicatedComponents);
+    
+    // Serialize each replicated component
+    for (Entity::ComponentMap::const_iterator i = components.begin(); i != components.end(); ++i)
+    {
+        if (i->second->IsReplicated())
+            WriteComponentFullUpdate(ctx, ds, i->second);
+    }
 }
 
 SyncManager::SyncManager(TundraLogicModule* owner) :
@@ -204,17 +332,79 @@ SyncManager::SyncManager(TundraLogicModule* owner) :
     framework_(owner->GetFramework()),
     updatePeriod_(1.0f / 20.0f),
     updateAcc_(0.0),
+    lastUpdateTime_(0),
     maxLinExtrapTime_(3.0f),
     noClientPhysicsHandoff_(false),
     componentTypeSender_(0),
     prioUpdateAcc_(0.0),
     interestManagementEnabled_(false),
-    priorityUpdatePeriod_(1.f)
+    priorityUpdatePeriod_(1.f),
+    priorityInfoGeneration_(0),
+    snapshotTracking_(false),
+    syncByteBudget_(0),
+    maxStarvationTime_(2.f),
+    rigidBodyErrorThreshold_(0.f),
+    parallelSyncEnabled_(false),
+    syncThreadCount_(QThread::idealThreadCount()),
+    syncThreadPool_(0),
+    adaptiveUpdateRateEnabled_(false),
+    minAdaptiveUpdatePeriod_(1.f / 60.f),
+    maxAdaptiveUpdatePeriod_(1.f / 4.f),
+    createTimeBudget_(0.f),
+    queuedEntityOrder_(0),
+    predictionSmoothingTime_(0.1f),
+    predictionSnapDistance_(4.f)
 {
     QStringList imArg = framework_->CommandLineParameters("--interestManagement");
     if (!imArg.empty())
         SetInterestManagementEnabled(ParseBool(imArg.last()));
 
+    if (framework_->HasCommandLineParameter("--parallelSync"))
+    {
+        // Allow both "--parallelSync" and "--parallelSync false"
+        QStringList parallelArg = framework_->CommandLineParameters("--parallelSync");
+        SetParallelSyncEnabled(parallelArg.empty() || ParseBool(parallelArg.last()));
+    }
+    QStringList budgetArg = framework_->CommandLineParameters("--syncByteBudget");
+    if (!budgetArg.empty())
+        SetSyncByteBudget(budgetArg.last().toInt());
+    QStringList starvationArg = framework_->CommandLineParameters("--syncMaxStarvationTime");
+    if (!starvationArg.empty())
+        SetMaxStarvationTime(starvationArg.last().toFloat());
+    QStringList errorThresholdArg = framework_->CommandLineParameters("--rigidBodyErrorThreshold");
+    if (!errorThresholdArg.empty())
+        SetRigidBodyErrorThreshold(errorThresholdArg.last().toFloat());
+    QStringList threadsArg = framework_->CommandLineParameters("--syncThreads");
+    if (!threadsArg.empty())
+    {
+        bool ok;
+        int count = threadsArg.last().toInt(&ok);
+        if (ok)
+            SetSyncThreadCount(count);
+        else
+            LogError("SyncManager: --syncThreads parameter is not a valid integer.");
+    }
+
+    if (framework_->HasCommandLineParameter("--adaptiveNetrate"))
+    {
+        // Allow both "--adaptiveNetrate" and "--adaptiveNetrate <maxRate>"
+        SetAdaptiveUpdateRateEnabled(true);
+        QStringList adaptiveArg = framework_->CommandLineParameters("--adaptiveNetrate");
+        if (!adaptiveArg.empty())
+        {
+            bool ok;
+            float maxRate = adaptiveArg.last().toFloat(&ok);
+            if (ok && maxRate > 0.f)
+                SetMinAdaptiveUpdatePeriod(1.f / maxRate);
+            else
+                LogError("SyncManager: --adaptiveNetrate parameter is not a valid rate.");
+        }
+    }
+
+    QStringList createBudgetArg = framework_->CommandLineParameters("--createTimeBudget");
+    if (!createBudgetArg.empty())
+        SetCreateTimeBudget(createBudgetArg.last().toFloat());
+
     if (framework_->HasCommandLineParameter("--noclientphysics"))
         noClientPhysicsHandoff_ = true;
 
@@ -232,6 +422,21 @@ SyncManager::SyncManager(TundraLogicModule* owner) :
 
 SyncManager::~SyncManager()
 {
+    ScenePtr scene = scene_.lock();
+    if (scene)
+        scene->SetAttributeChangeJournalEnabled(false);
+    if (syncThreadPool_)
+        syncThreadPool_->waitForDone();
+    SAFE_DELETE(syncThreadPool_);
+}
+
+void SyncManager::SetSyncThreadCount(int count)
+{
+    if (count < 1)
+        count = QThread::idealThreadCount();
+    syncThreadCount_ = std::max(count, 1);
+    if (syncThreadPool_)
+        syncThreadPool_->setMaxThreadCount(syncThreadCount_);
 }
 
 void SyncManager::SetPriorityUpdatePeriod(float period)
@@ -241,6 +446,30 @@ void SyncManager::SetPriorityUpdatePeriod(float period)
         priorityUpdatePeriod_ = updatePeriod_;
 }
 
+void SyncManager::SetInterestManagementEnabled(bool enabled)
+{
+    if (enabled && !interestManagementEnabled_)
+    {
+        // The entity changes were not tracked while disabled, so recompute everything.
+        ClearPriorityInfos();
+        if (owner_->GetKristalliModule() && owner_->IsServer()) // Called also from the constructor, before the module is initialized.
+        {
+            UserConnectionList& users = owner_->GetServer()->UserConnections();
+            for(UserConnectionList::iterator i = users.begin(); i != users.end(); ++i)
+                if ((*i)->syncState) (*i)->syncState->priorityObserverPos = float3::nan;
+        }
+    }
+    interestManagementEnabled_ = enabled;
+}
+
+void SyncManager::ClearPriorityInfos()
+{
+    priorityInfos_.Clear();
+    dirtyPriorityInfos_.clear();
+    parentedPriorityInfos_.clear();
+    changedPriorityInfos_.clear();
+}
+
 void SyncManager::SetUpdatePeriod(float period)
 {
     // Allow max 100fps
@@ -289,12 +518,16 @@ void SyncManager::RegisterToScene(ScenePtr scene)
     if (previous)
     {
         disconnect(previous.get(), 0, this, 0);
+        previous->SetAttributeChangeJournalEnabled(false);
     }
     
     serverConnection_->syncState->Clear();
     serverConnection_->syncState->SetParentScene(SceneWeakPtr(scene));
     scene_.reset();
+    queuedEntities_.clear();
     componentTypesFromServer_.clear();
+    ClearPriorityInfos();
+    ClearSceneSnapshot();
     
     if (!scene)
     {
@@ -305,8 +538,8 @@ void SyncManager::RegisterToScene(ScenePtr scene)
     scene_ = scene;
     Scene* sceneptr = scene.get();
     
-    connect(sceneptr, SIGNAL( AttributeChanged(IComponent*, IAttribute*, AttributeChange::Type) ),
-        SLOT( OnAttributeChanged(IComponent*, IAttribute*, AttributeChange::Type) ));
+    // Attribute changes are many, so handle them in bulk from the journal instead of connecting to AttributeChanged
+    sceneptr->SetAttributeChangeJournalEnabled(true);
     connect(sceneptr, SIGNAL( AttributeAdded(IComponent*, IAttribute*, AttributeChange::Type) ),
         SLOT( OnAttributeAdded(IComponent*, IAttribute*, AttributeChange::Type) ));
     connect(sceneptr, SIGNAL( AttributeRemoved(IComponent*, IAttribute*, AttributeChange::Type) ),
@@ -332,57 +565,10 @@ void SyncManager::HandleNetworkMessage(UserConnection* user, kNet::packet_id_t p
 
     try
     {
-        switch(messageId)
-        {
-        case cObserverPositionMessage:
-            HandleObserverPosition(user, data, numBytes);
-            break;
-        case cCreateEntityMessage:
-            HandleCreateEntity(user, data, numBytes);
-            break;
-        case cCreateComponentsMessage:
-            HandleCreateComponents(user, data, numBytes);
-            break;
-        case cCreateAttributesMessage:
-            HandleCreateAttributes(user, data, numBytes);
-            break;
-        case cEditAttributesMessage:
-            HandleEditAttributes(user, data, numBytes);
-            break;
-        case cRemoveAttributesMessage:
-            HandleRemoveAttributes(user, data, numBytes);
-            break;
-        case cRemoveComponentsMessage:
-            HandleRemoveComponents(user, data, numBytes);
-            break;
-        case cRemoveEntityMessage:
-            HandleRemoveEntity(user, data, numBytes);
-            break;
-        case cCreateEntityReplyMessage:
-            HandleCreateEntityReply(user, data, numBytes);
-            break;
-        case cCreateComponentsReplyMessage:
-            HandleCreateComponentsReply(user, data, numBytes);
-            break;
-        case cRigidBodyUpdateMessage:
-            HandleRigidBodyChanges(user, packetId, data, numBytes);
-            break;
-        case cEditEntityPropertiesMessage:
-            HandleEditEntityProperties(user, data, numBytes);
-            break;
-        case cSetEntityParentMessage:
-            HandleSetEntityParent(user, data, numBytes);
-            break;
-        case cEntityActionMessage:
-            {
-                MsgEntityAction msg(data, numBytes);
-                HandleEntityAction(user, msg);
-            }
-            break;
-        case cRegisterComponentTypeMessage:
-            HandleRegisterComponentType(user, data, numBytes);
-            break;
-        }
+        if (messageId == cBatchedSceneMessage)
+            HandleBatchedSceneMessage(user, packetId, data, numBytes);
+        else
+            DispatchNetworkMessage(user, packetId, messageId, data, numBytes);
     }
     catch (kNet::NetException& e)
     {
@@ -391,6 +577,88 @@ void SyncManager::HandleNetworkMessage(UserConnection* user, kNet::packet_id_t p
     }
 }
 
+void SyncManager::HandleBatchedSceneMessage(UserConnection* user, kNet::packet_id_t packetId, const char* data, size_t numBytes)
+{
+    kNet::DataDeserializer ds(data, numBytes);
+    while(ds.BytesLeft() > 0)
+    {
+        const kNet::message_id_t messageId = ds.ReadVLE<kNet::VLE8_16_32>();
+        const u32 size = ds.ReadVLE<kNet::VLE8_16_32>();
+        if (size > ds.BytesLeft() || messageId == cBatchedSceneMessage)
+            throw kNet::NetException("Malformed BatchedSceneMessage");
+        DispatchNetworkMessage(user, packetId, messageId, data + ds.BytePos(), size);
+        ds.SkipBytes(size);
+        // Handling a message may have removed the scene.
+        if (scene_.expired())
+            return;
+    }
+}
+
+void SyncManager::DispatchNetworkMessage(UserConnection* user, kNet::packet_id_t packetId, kNet::message_id_t messageId, const char* data, size_t numBytes)
+{
+    if (QueueEntityMessage(user, messageId, data, numBytes))
+        return;
+
+    switch(messageId)
+    {
+    case cObserverPositionMessage:
+        HandleObserverPosition(user, data, numBytes);
+        break;
+    case cCreateEntityMessage:
+        HandleCreateEntity(user, data, numBytes);
+        break;
+    case cCreateComponentsMessage:
+        HandleCreateComponents(user, data, numBytes);
+        break;
+    case cCreateAttributesMessage:
+        HandleCreateAttributes(user, data, numBytes);
+        break;
+    case cEditAttributesMessage:
+        HandleEditAttributes(user, data, numBytes);
+        break;
+    case cSceneSnapshotMessage:
+        HandleSceneSnapshot(user, data, numBytes);
+        break;
+    case cRemoveAttributesMessage:
+        HandleRemoveAttributes(user, data, numBytes);
+        break;
+    case cRemoveComponentsMessage:
+        HandleRemoveComponents(user, data, numBytes);
+        break;
+    case cRemoveEntityMessage:
+        HandleRemoveEntity(user, data, numBytes);
+        break;
+    case cCreateEntityReplyMessage:
+        HandleCreateEntityReply(user, data, numBytes);
+        break;
+    case cCreateComponentsReplyMessage:
+        HandleCreateComponentsReply(user, data, numBytes);
+        break;
+    case cRigidBodyUpdateMessage:
+        HandleRigidBodyChanges(user, packetId, data, numBytes);
+        break;
+    case cEditEntityPropertiesMessage:
+        HandleEditEntityProperties(user, data, numBytes);
+        break;
+    case cSetEntityParentMessage:
+        HandleSetEntityParent(user, data, numBytes);
+        break;
+    case cEntityActionMessage:
+        {
+            MsgEntityAction msg;
+            ReadEntityAction(user, data, numBytes, msg);
+            HandleEntityAction(user, msg);
+        }
+        break;
+    case cRegisterComponentTypeMessage:
+        HandleRegisterComponentType(user, data, numBytes);
+        break;
+    case cStringTableMessage:
+        HandleStringTable(user, data, numBytes);
+        break;
+    }
+}
+
 void SyncManager::NewUserConnected(const UserConnectionPtr &user)
 {
     PROFILE(SyncManager_NewUserConnected);
@@ -416,6 +684,19 @@ void SyncManager::NewUserConnected(const UserConnectionPtr &user)
     if (owner_->IsServer())
         emit SceneStateCreated(user.get(), user->syncState.get());
 
+    // If supported, send the initial scene as the shared scene snapshot on the next update
+    if (owner_->IsServer() && user->ProtocolVersion() >= ProtocolSceneSnapshot)
+        user->syncState->sceneSnapshotPending = true;
+    else
+        MarkSceneDirty(user.get());
+}
+
+void SyncManager::MarkSceneDirty(UserConnection* user)
+{
+    ScenePtr scene = scene_.lock();
+    if (!scene)
+        return;
+
     for(Scene::iterator iter = scene->begin(); iter != scene->end(); ++iter)
     {
         EntityPtr entity = iter->second;
@@ -430,25 +711,165 @@ void SyncManager::NewUserConnected(const UserConnectionPtr &user)
     }
 }
 
-void SyncManager::OnAttributeChanged(IComponent* comp, IAttribute* attr, AttributeChange::Type change)
+void SyncManager::SendSceneSnapshot(UserConnection* user)
 {
-    assert(comp && attr);
-    if (!comp || !attr)
+    PROFILE(SyncManager_SendSceneSnapshot);
+
+    SceneSyncState* state = user->syncState.get();
+    state->sceneSnapshotPending = false;
+    ScenePtr scene = scene_.lock();
+    if (!scene)
         return;
 
-    bool isServer = owner_->IsServer();
-    
-    // Client: Check for stopping interpolation, if we change a currently interpolating variable ourselves
-    if (!isServer) // Since the server never interpolates attributes, we don't need to do this check on the server at all.
+    // The snapshot is the same for everyone, so it can not be used if scripts filter the entities sent to the user.
+    if (state->HasEntityFilter())
     {
-        ScenePtr scene = scene_.lock();
-        if (scene && !scene->IsInterpolating())
+        MarkSceneDirty(user);
+        return;
+    }
+
+    // The components in the snapshot may refer to placeholder component types
+    SendPlaceholderComponentTypes(syncContext_, user);
+
+    const QByteArray& snapshot = SceneSnapshot();
+    syncContext_.FlushBatch();
+    user->Send(cSceneSnapshotMessage, snapshot.constData(), (size_t)snapshot.size(), true, true);
+
+    // Mark the entities sent, so that only the changes from now on will be sent to the user.
+    for(Scene::iterator iter = scene->begin(); iter != scene->end(); ++iter)
+    {
+        Entity* entity = iter->second.get();
+        if (entity->IsLocal())
+            continue;
+        const entity_id_t id = entity->Id();
+        state->RemoveFromQueue(id);
+        EntitySyncState& entityState = state->entities[id];
+        const Entity::ComponentMap& components = entity->Components();
+        for(Entity::ComponentMap::const_iterator i = components.begin(); i != components.end(); ++i)
+            if (i->second->IsReplicated())
+                entityState.ComponentState(i->second->Id()).DirtyProcessed();
+        state->MarkEntityProcessed(id);
+    }
+}
+
+const QByteArray& SyncManager::SceneSnapshot()
+{
+    PROFILE(SyncManager_SceneSnapshot);
+
+    // Make sure the entities changed on this frame are reserialized
+    ProcessAttributeChanges();
+
+    ScenePtr scene = scene_.lock();
+    if (!scene)
+    {
+        ClearSceneSnapshot();
+        return snapshotData_;
+    }
+
+    // Start tracking the changes when the snapshot is first needed, so that servers without new clients pay nothing.
+    if (!snapshotTracking_)
+    {
+        snapshotTracking_ = true;
+        for(Scene::iterator iter = scene->begin(); iter != scene->end(); ++iter)
+            dirtySnapshotEntities_.insert(iter->first);
+    }
+
+    // Reserialize only the entities that have changed since the snapshot was last used
+    if (!dirtySnapshotEntities_.isEmpty())
+    {
+        for(QSet<entity_id_t>::const_iterator it = dirtySnapshotEntities_.begin(); it != dirtySnapshotEntities_.end(); ++it)
+        {
+            EntityPtr entity = scene->EntityById(*it);
+            if (!entity || entity->IsLocal())
+            {
+                snapshotEntities_.remove(*it);
+                continue;
+            }
+            kNet::DataSerializer ds(syncContext_.createEntityBuffer, 64 * 1024);
+            WriteEntityFullUpdate(syncContext_, ds, entity.get(), true);
+            snapshotEntities_[*it] = QByteArray(ds.GetData(), (int)ds.BytesFilled());
+        }
+        dirtySnapshotEntities_.clear();
+        snapshotData_.clear();
+    }
+
+    if (snapshotData_.isNull())
+    {
+        // Concatenate the create entity messages, each prefixed with its size. Parents are written before their children,
+        // so that the receiver can parent the entities as it creates them.
+        std::vector<char> buffer;
+        QSet<entity_id_t> written;
+        std::vector<Entity*> chain;
+        for(Scene::iterator iter = scene->begin(); iter != scene->end(); ++iter)
         {
-            if (attr->Metadata() && attr->Metadata()->interpolation == AttributeMetadata::Interpolate)
-                // Note: it does not matter if the attribute was not actually interpolating
-                scene->EndAttributeInterpolation(attr);
+            chain.clear();
+            for(Entity* entity = iter->second.get(); entity && !written.contains(entity->Id()) && snapshotEntities_.contains(entity->Id());
+                entity = entity->Parent().get())
+            {
+                written.insert(entity->Id());
+                chain.push_back(entity);
+            }
+            for(std::vector<Entity*>::reverse_iterator i = chain.rbegin(); i != chain.rend(); ++i)
+            {
+                const QByteArray& data = snapshotEntities_[(*i)->Id()];
+                char sizeBuffer[4];
+                kNet::DataSerializer sizeDs(sizeBuffer, sizeof(sizeBuffer));
+                sizeDs.AddVLE<kNet::VLE8_16_32>((u32)data.size());
+                buffer.insert(buffer.end(), sizeBuffer, sizeBuffer + sizeDs.BytesFilled());
+                buffer.insert(buffer.end(), data.constData(), data.constData() + data.size());
+            }
         }
+        snapshotData_ = qCompress((const uchar*)(buffer.empty() ? 0 : &buffer[0]), (int)buffer.size());
+    }
+    return snapshotData_;
+}
+
+void SyncManager::InvalidateSnapshotEntity(entity_id_t id)
+{
+    if (snapshotTracking_)
+        dirtySnapshotEntities_.insert(id);
+}
+
+void SyncManager::ClearSceneSnapshot()
+{
+    snapshotEntities_.clear();
+    dirtySnapshotEntities_.clear();
+    snapshotData_ = QByteArray();
+    snapshotTracking_ = false;
+}
+
+void SyncManager::ProcessAttributeChanges()
+{
+    ScenePtr scene = scene_.lock();
+    if (!scene)
+        return;
+
+    const Scene::AttributeChangeJournal &changes = scene->TakeAttributeChanges();
+    for(size_t i = 0; i < changes.size(); ++i)
+    {
+        const Scene::AttributeChangeRecord &record = changes[i];
+        // Handling a change again right after itself would do nothing new
+        if (i > 0 && record.component == changes[i-1].component && record.attributeIndex == changes[i-1].attributeIndex && record.change == changes[i-1].change)
+            continue;
+        const AttributeVector &attrs = record.component->Attributes();
+        if (record.attributeIndex < attrs.size() && attrs[record.attributeIndex])
+            OnAttributeChanged(record.component, attrs[record.attributeIndex], record.change);
     }
+}
+
+void SyncManager::OnAttributeChanged(IComponent* comp, IAttribute* attr, AttributeChange::Type change)
+{
+    assert(comp && attr);
+    if (!comp || !attr)
+        return;
+
+    bool isServer = owner_->IsServer();
+
+    // The scene snapshot contains the current values, whether or not the change is replicated.
+    if (isServer && !comp->IsLocal() && comp->ParentEntity())
+        InvalidateSnapshotEntity(comp->ParentEntity()->Id());
+
+    // Client: a change to a currently interpolating attribute has already stopped the interpolation in Scene::EmitAttributeChanged
     
     // Is this change even supposed to go to the network?
     if (change != AttributeChange::Replicate || comp->IsLocal())
@@ -460,6 +881,10 @@ void SyncManager::OnAttributeChanged(IComponent* comp, IAttribute* attr, Attribu
     
     if (isServer)
     {
+        // The placeable and the mesh determine the entity's interest management priority.
+        if (interestManagementEnabled_ && (comp->TypeId() == EC_Placeable::TypeIdStatic() || comp->TypeId() == EC_Mesh::TypeIdStatic()))
+            MarkPriorityInfoDirty(entity->Id());
+
         // For each client connected to this server, mark this attribute dirty, so it will be updated to the
         // clients on the next network sync iteration.
         UserConnectionList& users = owner_->GetServer()->UserConnections();
@@ -496,6 +921,7 @@ void SyncManager::OnAttributeAdded(IComponent* comp, IAttribute* attr, Attribute
     
     if (isServer)
     {
+        InvalidateSnapshotEntity(entity->Id());
         UserConnectionList& users = owner_->GetServer()->UserConnections();
         for(UserConnectionList::iterator i = users.begin(); i != users.end(); ++i)
             if ((*i)->syncState) (*i)->syncState->MarkAttributeCreated(entity->Id(), comp->Id(), attr->Index());
@@ -525,6 +951,7 @@ void SyncManager::OnAttributeRemoved(IComponent* comp, IAttribute* attr, Attribu
     
     if (isServer)
     {
+        InvalidateSnapshotEntity(entity->Id());
         UserConnectionList& users = owner_->GetServer()->UserConnections();
         for(UserConnectionList::iterator i = users.begin(); i != users.end(); ++i)
             if ((*i)->syncState) (*i)->syncState->MarkAttributeRemoved(entity->Id(), comp->Id(), attr->Index());
@@ -541,6 +968,8 @@ void SyncManager::OnComponentAdded(Entity* entity, IComponent* comp, AttributeCh
     if (!entity || !comp)
         return;
 
+    if (owner_->IsServer() && !comp->IsLocal())
+        InvalidateSnapshotEntity(entity->Id());
     if ((change != AttributeChange::Replicate) || (comp->IsLocal()))
         return;
     if (entity->IsLocal())
@@ -548,6 +977,8 @@ void SyncManager::OnComponentAdded(Entity* entity, IComponent* comp, AttributeCh
     
     if (owner_->IsServer())
     {
+        if (interestManagementEnabled_)
+            MarkPriorityInfoDirty(entity->Id());
         UserConnectionList& users = owner_->GetServer()->UserConnections();
         for(UserConnectionList::iterator i = users.begin(); i != users.end(); ++i)
             if ((*i)->syncState) (*i)->syncState->MarkComponentDirty(entity->Id(), comp->Id());
@@ -563,6 +994,8 @@ void SyncManager::OnComponentRemoved(Entity* entity, IComponent* comp, Attribute
     assert(entity && comp);
     if (!entity || !comp)
         return;
+    if (owner_->IsServer() && !comp->IsLocal())
+        InvalidateSnapshotEntity(entity->Id());
     if ((change != AttributeChange::Replicate) || (comp->IsLocal()))
         return;
     if (entity->IsLocal())
@@ -570,6 +1003,8 @@ void SyncManager::OnComponentRemoved(Entity* entity, IComponent* comp, Attribute
     
     if (owner_->IsServer())
     {
+        if (interestManagementEnabled_)
+            MarkPriorityInfoDirty(entity->Id());
         UserConnectionList& users = owner_->GetServer()->UserConnections();
         for(UserConnectionList::iterator i = users.begin(); i != users.end(); ++i)
             if ((*i)->syncState) (*i)->syncState->MarkComponentRemoved(entity->Id(), comp->Id());
@@ -585,11 +1020,15 @@ void SyncManager::OnEntityCreated(Entity* entity, AttributeChange::Type change)
     assert(entity);
     if (!entity)
         return;
+    if (owner_->IsServer() && !entity->IsLocal())
+        InvalidateSnapshotEntity(entity->Id());
     if ((change != AttributeChange::Replicate) || (entity->IsLocal()))
         return;
 
     if (owner_->IsServer())
     {
+        if (interestManagementEnabled_)
+            MarkPriorityInfoDirty(entity->Id());
         UserConnectionList& users = owner_->GetServer()->UserConnections();
         for(UserConnectionList::iterator i = users.begin(); i != users.end(); ++i)
         {
@@ -615,6 +1054,8 @@ void SyncManager::OnEntityRemoved(Entity* entity, AttributeChange::Type change)
     assert(entity);
     if (!entity)
         return;
+    if (owner_->IsServer() && !entity->IsLocal())
+        InvalidateSnapshotEntity(entity->Id());
     if (change != AttributeChange::Replicate)
         return;
     if (entity->IsLocal())
@@ -622,6 +1063,8 @@ void SyncManager::OnEntityRemoved(Entity* entity, AttributeChange::Type change)
     
     if (owner_->IsServer())
     {
+        priorityInfos_.Erase(entity->Id());
+        parentedPriorityInfos_.erase(entity->Id());
         UserConnectionList& users = owner_->GetServer()->UserConnections();
         for(UserConnectionList::iterator i = users.begin(); i != users.end(); ++i)
             if ((*i)->syncState) (*i)->syncState->MarkEntityRemoved(entity->Id());
@@ -655,7 +1098,7 @@ void SyncManager::OnActionTriggered(Entity *entity, const QString &action, const
     {
         // send without Local flag
         msg.executionType = (u8)(type & ~EntityAction::Local);
-        owner_->GetClient()->GetConnection()->Send(msg);
+        SendEntityAction(serverConnection_.get(), msg);
     }
 
     if (isServer && (type & EntityAction::Peers) != 0)
@@ -692,7 +1135,7 @@ void SyncManager::OnUserActionTriggered(UserConnection* user, Entity *entity, co
         MsgEntityAction::S_parameters p = { StringToBuffer(params[i].toStdString()) };
         msg.parameters.push_back(p);
     }
-    user->Send(msg);
+    SendEntityAction(user, msg);
 }
 
 void SyncManager::OnEntityPropertiesChanged(Entity* entity, AttributeChange::Type change)
@@ -700,6 +1143,8 @@ void SyncManager::OnEntityPropertiesChanged(Entity* entity, AttributeChange::Typ
     assert(entity);
     if (!entity)
         return;
+    if (owner_->IsServer() && !entity->IsLocal())
+        InvalidateSnapshotEntity(entity->Id());
     if ((change != AttributeChange::Replicate) || (entity->IsLocal()))
         return;
 
@@ -723,6 +1168,8 @@ void SyncManager::OnEntityParentChanged(Entity* entity, Entity* newParent, Attri
     assert(entity);
     if (!entity)
         return;
+    if (owner_->IsServer() && !entity->IsLocal())
+        InvalidateSnapshotEntity(entity->Id());
     if ((change != AttributeChange::Replicate) || (entity->IsLocal()))
         return;
     if (newParent && newParent->IsLocal())
@@ -733,6 +1180,9 @@ void SyncManager::OnEntityParentChanged(Entity* entity, Entity* newParent, Attri
 
     if (owner_->IsServer())
     {
+        // Parenting changes the world transform of the placeable.
+        if (interestManagementEnabled_)
+            MarkPriorityInfoDirty(entity->Id());
         UserConnectionList& users = owner_->GetServer()->UserConnections();
         for(UserConnectionList::iterator i = users.begin(); i != users.end(); ++i)
         {
@@ -755,32 +1205,23 @@ void SyncManager::OnPlaceholderComponentTypeRegistered(u32 typeId, const QString
     ReplicateComponentType(typeId);
 }
 
-void SyncManager::ReplicateComponentType(u32 typeId, UserConnection* connection)
+void SyncManager::ReplicateComponentType(u32 typeId, UserConnection* connection, SyncContext* ctx)
 {
     SceneAPI* sceneAPI = framework_->Scene();
     const SceneAPI::PlaceholderComponentTypeMap& descs = sceneAPI->GetPlaceholderComponentTypes();
     SceneAPI::PlaceholderComponentTypeMap::const_iterator it = descs.find(typeId);
     if (it == descs.end())
     {
-        LogWarning("SyncManager::SendComponentTypeDescription: unknown component type " + QString::number(typeId));
+        const QString msg = "SyncManager::SendComponentTypeDescription: unknown component type " + QString::number(typeId);
+        if (ctx)
+            ctx->LogWarning(msg);
+        else
+            LogWarning(msg);
         return;
     }
 
     const ComponentDesc& desc = it->second;
 
-    kNet::DataSerializer ds(64 * 1024);
-    ds.AddVLE<kNet::VLE8_16_32>(desc.typeId);
-    ds.AddString(desc.typeName.toStdString());
-    ds.AddVLE<kNet::VLE8_16_32>(desc.attributes.size());
-    for (int i = 0; i < desc.attributes.size(); ++i)
-    {
-        const AttributeDesc& attrDesc = desc.attributes[i];
-        ds.Add<u8>(sceneAPI->GetAttributeTypeId(attrDesc.typeName));
-        /// \todo Use UTF-8 encoding
-        ds.AddString(attrDesc.id.toStdString());
-        ds.AddString(attrDesc.name.toStdString());
-    }
-
     if (!connection)
     {
         if (owner_->IsServer())
@@ -789,17 +1230,42 @@ void SyncManager::ReplicateComponentType(u32 typeId, UserConnection* connection)
             for(UserConnectionList::iterator i = users.begin(); i != users.end(); ++i)
             {
                 if ((*i)->ProtocolVersion() >= ProtocolCustomComponents && (*i).get() != componentTypeSender_)
-                    (*i)->Send(cRegisterComponentTypeMessage, true, true, ds);
+                    SendComponentType(desc, (*i).get());
             }
         }   
         else if (serverConnection_ && serverConnection_->ProtocolVersion() >= ProtocolCustomComponents)
-            serverConnection_->Send(cRegisterComponentTypeMessage, true, true, ds);
+            SendComponentType(desc, serverConnection_.get());
     }
     else
     {
         if (connection->ProtocolVersion() >= ProtocolCustomComponents)
-            connection->Send(cRegisterComponentTypeMessage, true, true, ds);
+            SendComponentType(desc, connection, ctx);
+    }
+}
+
+void SyncManager::SendComponentType(const ComponentDesc& desc, UserConnection* user, SyncContext* ctx)
+{
+    SceneAPI* sceneAPI = framework_->Scene();
+    StringTable* strings = SentStrings(user);
+
+    kNet::DataSerializer ds(64 * 1024);
+    ds.AddVLE<kNet::VLE8_16_32>(desc.typeId);
+    WriteName(ds, desc.typeName.toStdString(), strings);
+    ds.AddVLE<kNet::VLE8_16_32>(desc.attributes.size());
+    for (int i = 0; i < desc.attributes.size(); ++i)
+    {
+        const AttributeDesc& attrDesc = desc.attributes[i];
+        ds.Add<u8>(sceneAPI->GetAttributeTypeId(attrDesc.typeName));
+        /// \todo Use UTF-8 encoding
+        WriteName(ds, attrDesc.id.toStdString(), strings);
+        WriteName(ds, attrDesc.name.toStdString(), strings);
     }
+
+    SendNewStrings(user, ctx);
+    if (ctx)
+        ctx->Send(user, cRegisterComponentTypeMessage, true, true, ds);
+    else
+        user->Send(cRegisterComponentTypeMessage, true, true, ds);
 }
 
 /// Interpolates from (pos0, vel0) to (pos1, vel1) with a C1 curve (continuous in position and velocity)
@@ -944,18 +1410,31 @@ void SyncManager::Update(f64 frametime)
 {
     PROFILE(SyncManager_Update);
 
-    // For the client, smoothly update all rigid bodies by interpolating.
+    ProcessAttributeChanges();
+
+    // For the client, smoothly update all rigid bodies by interpolating, and create the entities received from the server.
     if (!owner_->IsServer())
+    {
         InterpolateRigidBodies(frametime, serverConnection_->syncState.get());
+        if (!serverConnection_->syncState->entityPredictions.empty())
+            PredictRigidBodies(frametime, serverConnection_->syncState.get());
+        if (!queuedEntities_.empty())
+            CreateQueuedEntities();
+    }
 
-    // Check if it is yet time to perform a network update tick.
+    // Check if it is yet time to perform a network update tick. With the adaptive update rate, the tick runs at the
+    // fastest adaptive rate and the user connections are updated at their own periods.
+    const bool adaptive = adaptiveUpdateRateEnabled_ && owner_->IsServer();
+    const float tickPeriod = adaptive ? minAdaptiveUpdatePeriod_ : updatePeriod_;
     updateAcc_ += (float)frametime;
     prioUpdateAcc_ += (float)frametime;
-    if (updateAcc_ < updatePeriod_)
+    if (updateAcc_ < tickPeriod)
         return;
 
     // If multiple updates passed, update still just once.
-    updateAcc_ = fmod(updateAcc_, updatePeriod_);
+    updateAcc_ = fmod(updateAcc_, tickPeriod);
+    const float timeSinceLastUpdate = lastUpdateTime_ ? kNet::Clock::SecondsSinceF(lastUpdateTime_) : tickPeriod;
+    lastUpdateTime_ = kNet::Clock::Tick();
     
     ScenePtr scene = scene_.lock();
     if (!scene)
@@ -964,33 +1443,54 @@ void SyncManager::Update(f64 frametime)
     if (owner_->IsServer())
     {
         // If we are server, process all authenticated users
-
-        // Then send out changes to other attributes via the generic sync mechanism.
+        std::vector<UserConnection*> syncUsers;
         UserConnectionList& users = owner_->GetServer()->UserConnections();
+
+        // When there are several users, encode each changed attribute only once and share the result.
+        encodingCache_.NewGeneration();
+        syncContext_.encodingCache = (users.size() > 1 ? &encodingCache_ : 0);
+
+        // First update the priorities if IM enabled. The entities' spatial information is refreshed once and shared by
+        // all users. This is always done on the main thread, as computing the spatial information may request assets.
+        bool updatePriorities = false;
+        if (interestManagementEnabled_ && prioUpdateAcc_ >= priorityUpdatePeriod_)
+        {
+            prioUpdateAcc_ = fmod(prioUpdateAcc_, priorityUpdatePeriod_);
+            UpdatePriorityInfos();
+            updatePriorities = true;
+        }
+
         for(UserConnectionList::iterator i = users.begin(); i != users.end(); ++i)
             if ((*i)->syncState)
             {
-                // First sort the dirty queue according to priority if IM enabled
-                if (interestManagementEnabled_)
+                SceneSyncState *state = (*i)->syncState.get();
+
+                // Send the initial scene to just connected users. Done on the main thread, as the snapshot is shared.
+                if (state->sceneSnapshotPending)
+                    SendSceneSnapshot((*i).get());
+
+                if (updatePriorities)
+                    ComputePrioritiesForEntitySyncStates(state);
+
+                if (adaptive)
                 {
-                    if (prioUpdateAcc_ >= priorityUpdatePeriod_)
-                    {
-                        prioUpdateAcc_ = fmod(prioUpdateAcc_, priorityUpdatePeriod_);
-                        ComputePrioritiesForEntitySyncStates((*i)->syncState.get());
-                    }
-                    PROFILE(SyncManager_Update_SortDirtyQueue);
-                    (*i)->syncState->dirtyQueue.sort();
+                    state->updateAcc += timeSinceLastUpdate;
+                    if (state->updatePeriod > 0.f && state->updateAcc < state->updatePeriod)
+                        continue;
+                    AdaptUpdatePeriod((*i).get());
+                    state->updateAcc = fmod(state->updateAcc, state->updatePeriod);
                 }
+                else
+                    state->updatePeriod = updatePeriod_;
 
-                // First send out all changes to rigid bodies. Supported on desktop (kNet) clients and web clients
-                // with sufficiently high protocol version. After processing this function, the bits related to 
-                // rigid body states have been cleared, so the generic sync will not double-replicate the rigid body
-                // positions and velocities.
-                if (dynamic_pointer_cast<KNetUserConnection>(*i) || (*i)->protocolVersion >= ProtocolWebClientRigidBodyMessage)
-                    ReplicateRigidBodyChanges((*i).get());
-                // Then send out changes to other attributes via the generic sync mechanism.
-                ProcessSyncState((*i).get());
+                if (parallelSyncEnabled_)
+                    syncUsers.push_back((*i).get());
+                else
+                    SyncUser(syncContext_, (*i).get());
             }
+
+        if (!syncUsers.empty())
+            SyncUsersParallel(syncUsers);
     }
     else
     {
@@ -998,7 +1498,9 @@ void SyncManager::Update(f64 frametime)
         kNet::MessageConnection* connection = static_pointer_cast<KNetUserConnection>(serverConnection_)->connection;
         if (connection)
         {
-            ProcessSyncState(serverConnection_.get());
+            PROFILE(SyncManager_ProcessSyncState);
+            serverConnection_->syncState->updatePeriod = updatePeriod_;
+            ProcessSyncState(syncContext_, serverConnection_.get());
             if (interestManagementEnabled_ && prioUpdateAcc_ >= priorityUpdatePeriod_)
             {
                 prioUpdateAcc_ = fmod(prioUpdateAcc_, priorityUpdatePeriod_);
@@ -1009,10 +1511,96 @@ void SyncManager::Update(f64 frametime)
     }
 }
 
-void SyncManager::ReplicateRigidBodyChanges(UserConnection* user)
+/// Processes a subset of the user connections' sync states in a sync worker thread.
+class SyncWorkerTask : public QRunnable
+{
+public:
+    SyncWorkerTask(SyncManager *owner, SyncContext *ctx) :
+        owner_(owner),
+        ctx_(ctx)
+    {
+    }
+
+    /// QRunnable override.
+    void run()
+    {
+        for(size_t i = 0; i < users.size(); ++i)
+            owner_->SyncUser(*ctx_, users[i]);
+    }
+
+    std::vector<UserConnection*> users;
+
+private:
+    SyncManager *owner_;
+    SyncContext *ctx_;
+};
+
+void SyncManager::SyncUser(SyncContext& ctx, UserConnection* user)
+{
+    // PROFILE is usable only from the main thread.
+    const bool profile = !ctx.IsDeferred();
+
+    // First send out all changes to rigid bodies. Supported on desktop (kNet) clients and web clients
+    // with sufficiently high protocol version. After processing this function, the bits related to 
+    // rigid body states have been cleared, so the generic sync will not double-replicate the rigid body
+    // positions and velocities.
+    if (dynamic_cast<KNetUserConnection*>(user) || user->protocolVersion >= ProtocolWebClientRigidBodyMessage)
+    {
+        if (profile)
+        {
+            PROFILE(SyncManager_ReplicateRigidBodyChanges);
+            ReplicateRigidBodyChanges(ctx, user);
+        }
+        else
+            ReplicateRigidBodyChanges(ctx, user);
+    }
+
+    // Then send out changes to other attributes via the generic sync mechanism.
+    if (profile)
+    {
+        PROFILE(SyncManager_ProcessSyncState);
+        ProcessSyncState(ctx, user);
+    }
+    else
+        ProcessSyncState(ctx, user);
+}
+
+void SyncManager::SyncUsersParallel(const std::vector<UserConnection*>& users)
+{
+    PROFILE(SyncManager_SyncUsersParallel);
+
+    if (!syncThreadPool_)
+    {
+        syncThreadPool_ = new QThreadPool();
+        syncThreadPool_->setMaxThreadCount(syncThreadCount_);
+    }
+
+    const size_t numWorkers = std::min((size_t)syncThreadCount_, users.size());
+    while(workerContexts_.size() < numWorkers)
+        workerContexts_.push_back(MAKE_SHARED(SyncContext, true));
+    for(size_t i = 0; i < numWorkers; ++i)
+        workerContexts_[i]->encodingCache = syncContext_.encodingCache;
+
+    // Distribute the users evenly to the workers. Each user is processed by exactly one worker,
+    // so the messages to a single user keep their order.
+    std::vector<SyncWorkerTask*> tasks;
+    for(size_t i = 0; i < numWorkers; ++i)
+        tasks.push_back(new SyncWorkerTask(this, workerContexts_[i].get()));
+    for(size_t i = 0; i < users.size(); ++i)
+        tasks[i % numWorkers]->users.push_back(users[i]);
+
+    // The thread pool takes ownership of the tasks. The scene is read-only until all of them have finished.
+    for(size_t i = 0; i < tasks.size(); ++i)
+        syncThreadPool_->start(tasks[i]);
+    syncThreadPool_->waitForDone();
+
+    // Back on the main thread, send out everything the workers produced.
+    for(size_t i = 0; i < numWorkers; ++i)
+        workerContexts_[i]->Flush();
+}
+
+void SyncManager::ReplicateRigidBodyChanges(SyncContext& ctx, UserConnection* user)
 {
-    PROFILE(SyncManager_ReplicateRigidBodyChanges);
-    
     ScenePtr scene = scene_.lock();
     if (!scene)
         return;
@@ -1021,49 +1609,78 @@ void SyncManager::ReplicateRigidBodyChanges(UserConnection* user)
     kNet::DataSerializer ds(maxMessageSizeBytes);
     bool msgReliable = false;
     SceneSyncState* state = user->syncState.get();
+    const bool deadReckoning = rigidBodyErrorThreshold_ > 0.f;
+    const bool kNetUser = dynamic_cast<KNetUserConnection*>(user) != 0;
+
+    // Check the dirty entities, and with dead reckoning also the entities that still have unsent transform changes.
+    std::vector<EntitySyncState*>& candidates = ctx.rigidBodyCandidates;
+    candidates.clear();
+    for(EntitySyncState *iter = state->dirtyQueue.Front(); iter; iter = state->dirtyQueue.Next(iter))
+        candidates.push_back(iter);
+    for(size_t i = 0; i < state->pendingRigidBodies.size(); ++i)
+    {
+        EntitySyncState *pending = state->entities.Find(state->pendingRigidBodies[i]);
+        if (pending && pending->transformPending && !pending->isInQueue)
+            candidates.push_back(pending);
+    }
+    state->pendingRigidBodies.clear();
 
-    for(std::list<EntitySyncState*>::iterator iter = state->dirtyQueue.begin(); iter != state->dirtyQueue.end(); ++iter)
+    for(size_t candidateIdx = 0; candidateIdx < candidates.size(); ++candidateIdx)
     {
+        EntitySyncState *iter = candidates[candidateIdx];
         const int maxRigidBodyMessageSizeBits = 350; // An update for a single rigid body can take at most this many bits. (conservative bound)
         // If we filled up this message, send it out and start crafting anothero one.
         if (maxMessageSizeBytes * 8 - (int)ds.BitsFilled() <= maxRigidBodyMessageSizeBits)
         {
-            user->Send(cRigidBodyUpdateMessage, msgReliable, true, ds);
+            ctx.Send(user, cRigidBodyUpdateMessage, msgReliable, true, ds);
             ds = kNet::DataSerializer(maxMessageSizeBytes);
             msgReliable = false;
         }
-        EntitySyncState &ess = **iter;
+        EntitySyncState &ess = *iter;
+        // The dirty bit of the transform is cleared below, so dead reckoning remembers unsent changes until they are sent.
+        const bool transformPending = ess.transformPending;
+        ess.transformPending = false;
 
         if (ess.isNew || ess.removed)
             continue; // Newly created and removed entities are handled through the traditional sync mechanism.
 
         EntityPtr e = scene->GetEntity(ess.id);
+        if (!e)
+            continue;
         shared_ptr<EC_Placeable> placeable = e->GetComponent<EC_Placeable>();
         if (!placeable.get())
             continue;
 
-        std::map<component_id_t, ComponentSyncState>::iterator placeableComp = ess.components.find(placeable->Id());
+        // If the transform is a latest value wins attribute, the update is sent to kNet users in its own message with a content ID,
+        // so that kNet drops the outdated updates of the entity that are still waiting to be sent.
+        const AttributeMetadata *transformMetadata = placeable->transform.Metadata();
+        const u32 contentId = kNetUser && transformMetadata && transformMetadata->latestValueWins ? LatestValueContentId(ess.id, placeable->Id(), 0) : 0;
+
+        ComponentSyncState *placeableComp = ess.FindComponent(placeable->Id());
 
         bool transformDirty = false;
-        if (placeableComp != ess.components.end())
+        if (placeableComp)
         {
-            ComponentSyncState &pss = placeableComp->second;
+            ComponentSyncState &pss = *placeableComp;
             if (!pss.isNew && !pss.removed) // Newly created and deleted components are handled through the traditional sync mechanism.
             {
                 transformDirty = (pss.dirtyAttributes[0] & 1) != 0; // The Transform of an EC_Placeable is the first attibute in the component.
                 pss.dirtyAttributes[0] &= ~1;
             }
         }
+        if (deadReckoning)
+            transformDirty = transformDirty || transformPending;
         bool velocityDirty = false;
         bool angularVelocityDirty = false;
+        bool reliable = false;
         
         shared_ptr<EC_RigidBody> rigidBody = e->GetComponent<EC_RigidBody>();
         if (rigidBody)
         {
-            std::map<component_id_t, ComponentSyncState>::iterator rigidBodyComp = ess.components.find(rigidBody->Id());
-            if (rigidBodyComp != ess.components.end())
+            ComponentSyncState *rigidBodyComp = ess.FindComponent(rigidBody->Id());
+            if (rigidBodyComp)
             {
-                ComponentSyncState &rss = rigidBodyComp->second;
+                ComponentSyncState &rss = *rigidBodyComp;
                 if (!rss.isNew && !rss.removed) // Newly created and deleted components are handled through the traditional sync mechanism.
                 {
                     velocityDirty = (rss.dirtyAttributes[1] & (1 << 5)) != 0;
@@ -1080,12 +1697,12 @@ void SyncManager::ReplicateRigidBodyChanges(UserConnection* user)
                     if (rigidBody->linearVelocity.Get().IsZero(1e-4f) && !ess.linearVelocity.IsZero(1e-4f))
                     {
                         velocityDirty = true;
-                        msgReliable = true;
+                        reliable = true;
                     }
                     if (rigidBody->angularVelocity.Get().IsZero(1e-4f) && !ess.angularVelocity.IsZero(1e-4f))
                     {
                         angularVelocityDirty = true;
-                        msgReliable = true;
+                        reliable = true;
                     }
                 }
             }
@@ -1096,16 +1713,33 @@ void SyncManager::ReplicateRigidBodyChanges(UserConnection* user)
 
         float timeSinceLastSend = kNet::Clock::SecondsSinceF(ess.lastNetworkSendTime);
         /// @todo Is this the best place for this check?
-        if (interestManagementEnabled_ && timeSinceLastSend < ess.ComputePrioritizedUpdateInterval(updatePeriod_))
+        if (interestManagementEnabled_ && timeSinceLastSend < ess.ComputePrioritizedUpdateInterval(state->updatePeriod))
+        {
+            if (deadReckoning && transformDirty)
+                MarkTransformPending(state, ess);
             continue;
+        }
 
         const float3 predictedClientSidePosition = ess.transform.pos + timeSinceLastSend * ess.linearVelocity;
         const Transform &t = placeable->transform.Get();
         float error = t.pos.DistanceSq(predictedClientSidePosition);
-        UNREFERENCED_PARAM(error)
-        // TEST: To have the server estimate how far the client has simulated, use this.
-//        bool posChanged = transformDirty && (timeSinceLastSend > 0.2f || t.pos.DistanceSq(/*ess.transform.pos*/ predictedClientSidePosition) > 5e-5f);
-        bool posChanged = transformDirty && t.pos.DistanceSq(ess.transform.pos) > 1e-3f;
+        bool posChanged;
+        if (deadReckoning)
+        {
+            // Send the position when the client's extrapolation has drifted too far, or at least once a second so that the
+            // client's physics simulation can not diverge for long. A velocity change resets the extrapolation, so the position
+            // is sent with it.
+            const float cMaxErrorScale = 10.f;
+            const float cMaxSendInterval = 1.f;
+            float threshold = rigidBodyErrorThreshold_;
+            if (interestManagementEnabled_ && ess.priority > 0.f && ess.relevancy > 0.f)
+                threshold *= Clamp(ess.ComputePrioritizedUpdateInterval(state->updatePeriod) / state->updatePeriod, 1.f, cMaxErrorScale);
+            posChanged = (transformDirty && (error > threshold * threshold || timeSinceLastSend >= cMaxSendInterval)) || velocityDirty;
+            if (transformDirty && !posChanged)
+                MarkTransformPending(state, ess);
+        }
+        else
+            posChanged = transformDirty && t.pos.DistanceSq(ess.transform.pos) > 1e-3f;
         bool rotChanged = transformDirty && (t.rot.DistanceSq(ess.transform.rot) > 1e-1f);
         bool scaleChanged = transformDirty && (t.scale.DistanceSq(ess.transform.scale) > 1e-3f);
 
@@ -1136,33 +1770,37 @@ void SyncManager::ReplicateRigidBodyChanges(UserConnection* user)
         if (posSendType == 0 && rotSendType == 0 && scaleSendType == 0 && velSendType == 0 && angVelSendType == 0)
             continue;
 
-        size_t bitIdx = ds.BitsFilled();
+        char latestData[64];
+        kNet::DataSerializer latestDs(latestData, sizeof(latestData));
+        kNet::DataSerializer &dest = contentId ? latestDs : ds;
+
+        size_t bitIdx = dest.BitsFilled();
         UNREFERENCED_PARAM(bitIdx)
-        ds.AddVLE<kNet::VLE8_16_32>(ess.id); // Sends max. 32 bits.
+        dest.AddVLE<kNet::VLE8_16_32>(ess.id); // Sends max. 32 bits.
 
-        ds.AddArithmeticEncoded(8, posSendType, 3, rotSendType, 4, scaleSendType, 3, velSendType, 3, angVelSendType, 2); // Sends fixed 8 bits.
+        dest.AddArithmeticEncoded(8, posSendType, 3, rotSendType, 4, scaleSendType, 3, velSendType, 3, angVelSendType, 2); // Sends fixed 8 bits.
 
-        WriteOptimizedPosAndRot(ds, posSendType, t.pos, rotSendType, rot);
+        WriteOptimizedPosAndRot(dest, posSendType, t.pos, rotSendType, rot);
 
         if (scaleSendType == 1) // Sends fixed 32 bytes.
         {
-            ds.Add<float>(t.scale.x);
+            dest.Add<float>(t.scale.x);
         }
         else if (scaleSendType == 2) // Sends fixed 96 bits.
         {
-            ds.Add<float>(t.scale.x);
-            ds.Add<float>(t.scale.y);
-            ds.Add<float>(t.scale.z);
+            dest.Add<float>(t.scale.x);
+            dest.Add<float>(t.scale.y);
+            dest.Add<float>(t.scale.z);
         }
 
         if (velSendType == 1) // Sends fixed 32 bits.
         {
-            ds.AddVector3D(linearVel.x, linearVel.y, linearVel.z, 11, 10, 3, 8);
+            dest.AddVector3D(linearVel.x, linearVel.y, linearVel.z, 11, 10, 3, 8);
             ess.linearVelocity = linearVel;
         }
         else if (velSendType == 2) // Sends fixed 39 bits.
         {
-            ds.AddVector3D(linearVel.x, linearVel.y, linearVel.z, 11, 10, 10, 8);
+            dest.AddVector3D(linearVel.x, linearVel.y, linearVel.z, 11, 10, 10, 8);
             ess.linearVelocity = linearVel;
         }
 
@@ -1179,9 +1817,9 @@ void SyncManager::ReplicateRigidBodyChanges(UserConnection* user)
                 angle = 2.f * 3.141592654f - angle;
             }
              // Sends at most 31 bits.
-            u32 quantizedAngle = ds.AddQuantizedFloat(0, 3.141592654f, 10, angle);
+            u32 quantizedAngle = dest.AddQuantizedFloat(0, 3.141592654f, 10, angle);
             if (quantizedAngle != 0)
-                ds.AddNormalizedVector3D(axis.x, axis.y, axis.z, 11, 10);
+                dest.AddNormalizedVector3D(axis.x, axis.y, axis.z, 11, 10);
 
             ess.angularVelocity = angVel;
         }
@@ -1194,12 +1832,117 @@ void SyncManager::ReplicateRigidBodyChanges(UserConnection* user)
 
 //        std::cout << "pos: " << posSendType << ", rot: " << rotSendType << ", scale: " << scaleSendType << ", vel: " << velSendType << ", angvel: " << angVelSendType << std::endl;
 
-        size_t bitsEnd = ds.BitsFilled();
+        size_t bitsEnd = dest.BitsFilled();
         UNREFERENCED_PARAM(bitsEnd)
+        // An update that puts the entity to rest must not be dropped in favour of a newer unreliable one, so it is sent without the content ID.
+        if (contentId)
+            ctx.Send(user, cRigidBodyUpdateMessage, reliable, true, latestDs, 100, reliable ? 0 : contentId);
+        else
+            msgReliable = msgReliable || reliable;
         ess.lastNetworkSendTime = kNet::Clock::Tick();
     }
     if (ds.BytesFilled() > 0)
-        user->Send(cRigidBodyUpdateMessage, msgReliable, true, ds);
+        ctx.Send(user, cRigidBodyUpdateMessage, msgReliable, true, ds);
+}
+
+void SyncManager::SetEntityPredicted(entity_id_t id, bool enabled)
+{
+    if (owner_->IsServer())
+    {
+        LogWarning("SyncManager::SetEntityPredicted: Prediction is supported only on the client.");
+        return;
+    }
+
+    SceneSyncState* state = serverConnection_->syncState.get();
+    ScenePtr scene = scene_.lock();
+    EntityPtr entity = scene ? scene->EntityById(id) : EntityPtr();
+    shared_ptr<EC_RigidBody> rigidBody = entity ? entity->GetComponent<EC_RigidBody>() : shared_ptr<EC_RigidBody>();
+    if (enabled)
+    {
+        if (state->entityPredictions.find(id) != state->entityPredictions.end())
+            return;
+        state->entityPredictions[id] = RigidBodyPredictionState();
+        // The entity is no longer interpolated, but simulated by the local physics
+        state->entityInterpolations.erase(id);
+        if (rigidBody)
+            rigidBody->SetClientExtrapolating(true);
+    }
+    else if (state->entityPredictions.erase(id) > 0 && rigidBody)
+        rigidBody->SetClientExtrapolating(false);
+}
+
+bool SyncManager::IsEntityPredicted(entity_id_t id) const
+{
+    const SceneSyncState* state = serverConnection_->syncState.get();
+    return state && state->entityPredictions.find(id) != state->entityPredictions.end();
+}
+
+void SyncManager::PredictRigidBodies(f64 frametime, SceneSyncState* state)
+{
+    ScenePtr scene = scene_.lock();
+    if (!scene)
+        return;
+
+    const kNet::tick_t now = kNet::Clock::Tick();
+    for(std::map<entity_id_t, RigidBodyPredictionState>::iterator iter = state->entityPredictions.begin();
+        iter != state->entityPredictions.end();)
+    {
+        EntityPtr e = scene->GetEntity(iter->first);
+        shared_ptr<EC_Placeable> placeable = e ? e->GetComponent<EC_Placeable>() : shared_ptr<EC_Placeable>();
+        if (!placeable.get())
+        {
+            std::map<entity_id_t, RigidBodyPredictionState>::iterator del = iter++;
+            state->entityPredictions.erase(del);
+            continue;
+        }
+
+        RigidBodyPredictionState &p = iter->second;
+        Transform t = placeable->transform.Get();
+        if (!p.positionError.Equals(float3::zero))
+        {
+            // Apply a part of the correction on each frame. Small corrections are applied at once as they are not noticeable,
+            // and large ones because smoothing them out would look like the entity is sliding.
+            float3 correction = p.positionError;
+            const float errorSq = p.positionError.LengthSq();
+            const bool snap = errorSq < 1e-6f || (predictionSnapDistance_ > 0.f && errorSq > predictionSnapDistance_ * predictionSnapDistance_);
+            if (!snap && predictionSmoothingTime_ > 0.f)
+                correction *= std::min(1.f, (float)frametime / predictionSmoothingTime_);
+            p.positionError -= correction;
+            t.pos += correction;
+            placeable->transform.Set(t, AttributeChange::LocalOnly);
+        }
+
+        RigidBodyPredictionState::PredictedState predicted = { now, t.pos + p.positionError };
+        p.history.push_back(predicted);
+        if (p.history.size() > RigidBodyPredictionState::cMaxHistorySize)
+            p.history.pop_front();
+        ++iter;
+    }
+}
+
+void SyncManager::ReconcilePrediction(RigidBodyPredictionState& prediction, const float3& serverPos)
+{
+    if (prediction.history.empty())
+        return;
+
+    // The server state reflects the client's actions up to about one round trip ago, plus the wait for the server's next network
+    // update. The state the client predicted at that time is the acknowledged state.
+    const float latency = serverConnection_->Statistics().roundTripTime + 0.5f * updatePeriod_;
+    const kNet::tick_t ackTime = kNet::Clock::Tick() - (kNet::tick_t)(latency * kNet::Clock::TicksPerSec());
+    size_t ack = 0;
+    while(ack + 1 < prediction.history.size() && prediction.history[ack + 1].time <= ackTime)
+        ++ack;
+    const float3 error = serverPos - prediction.history[ack].pos;
+    // The states older than the acknowledged one are not needed anymore
+    prediction.history.erase(prediction.history.begin(), prediction.history.begin() + ack);
+    if (error.LengthSq() < 1e-6f)
+        return;
+
+    // Replay the motion predicted since the acknowledged state on top of the server state, i.e. move the later states by the error.
+    // The entity itself is moved by PredictRigidBodies(), which smooths out the correction.
+    for(size_t i = 0; i < prediction.history.size(); ++i)
+        prediction.history[i].pos += error;
+    prediction.positionError += error;
 }
 
 void SyncManager::HandleRigidBodyChanges(UserConnection* source, kNet::packet_id_t packetId, const char* data, size_t numBytes)
@@ -1213,6 +1956,15 @@ void SyncManager::HandleRigidBodyChanges(UserConnection* source, kNet::packet_id
     {
         u32 entityID = dd.ReadVLE<kNet::VLE8_16_32>();
         EntityPtr e = scene->GetEntity(entityID);
+        // An entity still waiting to be created is created now, so that its update is applied instead of dropped
+        if (!e && queuedEntities_.find(entityID) != queuedEntities_.end())
+        {
+            CreateQueuedEntity(entityID);
+            // Handling a message may have removed the scene.
+            if (scene_.expired())
+                return;
+            e = scene->GetEntity(entityID);
+        }
         shared_ptr<EC_Placeable> placeable = e ? e->GetComponent<EC_Placeable>() : shared_ptr<EC_Placeable>();
         shared_ptr<EC_RigidBody> rigidBody = e ? e->GetComponent<EC_RigidBody>() : shared_ptr<EC_RigidBody>();
         Transform t = e ? placeable->transform.Get() : Transform();
@@ -1270,6 +2022,23 @@ void SyncManager::HandleRigidBodyChanges(UserConnection* source, kNet::packet_id
         if (!e) // Discard this message - we don't have the entity in our scene to which the message applies to.
             continue;
 
+        // Predicted entities are moved locally, and the server state is only used to correct the prediction.
+        std::map<entity_id_t, RigidBodyPredictionState>::iterator prediction = serverConnection_->syncState->entityPredictions.find(entityID);
+        if (prediction != serverConnection_->syncState->entityPredictions.end())
+        {
+            RigidBodyPredictionState &predictionState = prediction->second;
+            KNetUserConnection* kNetSource = dynamic_cast<KNetUserConnection*>(source);
+            kNet::MessageConnection* conn = kNetSource ? kNetSource->connection.ptr() : (kNet::MessageConnection*)0;
+            if (predictionState.hasReceivedPacket && conn && conn->GetSocket() && conn->GetSocket()->TransportLayer() == kNet::SocketOverUDP &&
+                kNet::PacketIDIsNewerThan(predictionState.lastReceivedPacketCounter, packetId))
+                continue; // This is an out-of-order received packet. Ignore it. (latest-data-guarantee)
+            predictionState.lastReceivedPacketCounter = packetId;
+            predictionState.hasReceivedPacket = true;
+            if (posSendType != 0)
+                ReconcilePrediction(predictionState, t.pos);
+            continue;
+        }
+
         // Did anything change?
         if (posSendType != 0 || rotSendType != 0 || scaleSendType != 0 || velSendType != 0 || angVelSendType != 0)
         {
@@ -1473,9 +2242,10 @@ void SyncManager::HandleRegisterComponentType(UserConnection* source, const char
         return;
 
     kNet::DataDeserializer ds(data, numBytes);
+    const StringTable* strings = ReceivedStrings(source);
     ComponentDesc desc;
     desc.typeId = ds.ReadVLE<kNet::VLE8_16_32>();
-    desc.typeName = QString::fromStdString(ds.ReadString());
+    desc.typeName = QString::fromStdString(ReadName(ds, strings));
 
     // On client, remember the component types server has sent, so that we don't unnecessarily echo them back
     if (!isServer)
@@ -1493,8 +2263,8 @@ void SyncManager::HandleRegisterComponentType(UserConnection* source, const char
         AttributeDesc attrDesc;
         attrDesc.typeName = sceneAPI->GetAttributeTypeName(ds.Read<u8>());
         /// \todo Use UTF-8 encoding
-        attrDesc.id = QString::fromStdString(ds.ReadString());
-        attrDesc.name = QString::fromStdString(ds.ReadString());
+        attrDesc.id = QString::fromStdString(ReadName(ds, strings));
+        attrDesc.name = QString::fromStdString(ReadName(ds, strings));
         desc.attributes.push_back(attrDesc);
     }
 
@@ -1504,423 +2274,545 @@ void SyncManager::HandleRegisterComponentType(UserConnection* source, const char
     componentTypeSender_ = 0;
 }
 
-void SyncManager::ProcessSyncState(UserConnection* user)
+void SyncManager::SendPlaceholderComponentTypes(SyncContext& ctx, UserConnection* user)
 {
-    PROFILE(SyncManager_ProcessSyncState);
-    
-    unsigned sceneId = 0; ///\todo Replace with proper scene ID once multiscene support is in place.
-    
-    ScenePtr scene = scene_.lock();
-    int numMessagesSent = 0; /**< @todo debug variable, can be removed (or enable only in debug build?) */
-    const bool isServer = owner_->IsServer();
     SceneSyncState* state = user->syncState.get();
-    
-    // Send knowledge of registered placeholder components to the remote peer
     if (user->ProtocolVersion() >= ProtocolCustomComponents && state->NeedSendPlaceholderComponents())
     {
+        const bool isServer = owner_->IsServer();
         SceneAPI* sceneAPI = framework_->Scene();
         const SceneAPI::PlaceholderComponentTypeMap& descs = sceneAPI->GetPlaceholderComponentTypes();
         for (SceneAPI::PlaceholderComponentTypeMap::const_iterator i = descs.begin(); i != descs.end(); ++i)
         {
             if (isServer || componentTypesFromServer_.find(i->first) == componentTypesFromServer_.end())
-                ReplicateComponentType(i->first, user);
+                ReplicateComponentType(i->first, user, &ctx);
         }
         state->MarkPlaceholderComponentsSent();
     }
+}
+
+void SyncManager::ProcessSyncState(SyncContext& ctx, UserConnection* user)
+{
+    ScenePtr scene = scene_.lock();
+    const bool isServer = owner_->IsServer();
+    SceneSyncState* state = user->syncState.get();
+    
+    // Send knowledge of registered placeholder components to the remote peer
+    SendPlaceholderComponentTypes(ctx, user);
 
-    // Interest management sync priorization performed only on the server
-    const bool serverImEnabled = (isServer && interestManagementEnabled_);
+    // Queue the entities whose rate limited attribute changes have waited long enough
+    state->QueueDeferredEntities();
 
     // Process the state's dirty entity queue.
-    std::list<EntitySyncState*>::iterator it = state->dirtyQueue.begin();
-    while(it != state->dirtyQueue.end())
+    if (!isServer || (!interestManagementEnabled_ && syncByteBudget_ <= 0))
     {
-        EntitySyncState& entityState = **it;
-        // See if we need to sync yet.
-        float timeSinceLastSend = kNet::Clock::SecondsSinceF(entityState.lastNetworkSendTime);
-        if (serverImEnabled && timeSinceLastSend < entityState.ComputePrioritizedUpdateInterval(updatePeriod_))
+        // Everything in queue order.
+        EntitySyncState *it = state->dirtyQueue.Front();
+        while(it)
+            it = ProcessEntitySyncState(ctx, user, scene.get(), it);
+    }
+    else
+    {
+        // Highest scoring entities first, until the byte budget of this update is used.
+        ctx.schedule.clear();
+        for(EntitySyncState *it = state->dirtyQueue.Front(); it; it = state->dirtyQueue.Next(it))
         {
-            ++it;
-            continue;
+            const float timeSinceLastSync = kNet::Clock::SecondsSinceF(it->lastSyncTime);
+            const bool starving = maxStarvationTime_ > 0.f && timeSinceLastSync >= maxStarvationTime_;
+            // With interest management, see if we need to sync yet.
+            if (interestManagementEnabled_ && !starving && timeSinceLastSync < it->ComputePrioritizedUpdateInterval(state->updatePeriod))
+                continue;
+            SyncContext::ScheduledEntity entry;
+            entry.state = it;
+            entry.starving = starving;
+            entry.score = it->SchedulingScore(timeSinceLastSync, state->updatePeriod);
+            ctx.schedule.push_back(entry);
         }
+        std::make_heap(ctx.schedule.begin(), ctx.schedule.end());
 
-        entityState.isInQueue = false;
-        EntityPtr entity = scene->GetEntity(entityState.id);
-        bool removeState = false;
-        if (!entity)
+        const size_t bytesAtStart = ctx.BytesSent();
+        while(!ctx.schedule.empty())
         {
-            if (!entityState.removed)
-                LogWarning("Entity " + QString::number(entityState.id) + " has gone missing from the scene without the remove properly signalled. Removing from replication state");
-            entityState.isNew = false;
-            removeState = true;
+            std::pop_heap(ctx.schedule.begin(), ctx.schedule.end());
+            const SyncContext::ScheduledEntity entry = ctx.schedule.back();
+            ctx.schedule.pop_back();
+            // The rest roll over to the next update, where they have waited longer and thus score higher. Starving entities
+            // are at the top of the heap and are always sent.
+            if (syncByteBudget_ > 0 && !entry.starving && ctx.BytesSent() - bytesAtStart >= (size_t)syncByteBudget_)
+                break;
+            ProcessEntitySyncState(ctx, user, scene.get(), entry.state);
+        }
+        ctx.schedule.clear();
+    }
+
+    // Send queued entity actions after scene sync
+    if (state->queuedActions.size())
+    {
+        for (size_t i = 0; i < state->queuedActions.size(); ++i)
+            SendEntityAction(user, state->queuedActions[i], &ctx);
+
+        state->queuedActions.clear();
+    }
+
+    ctx.FlushBatch();
+}
+
+void SyncManager::AdaptUpdatePeriod(UserConnection* user)
+{
+    // Outbound queue lengths above which the connection is considered congested
+    const size_t cCongestedQueuedMessages = 128;
+    const size_t cCongestedQueuedBytes = 64 * 1024;
+
+    SceneSyncState* state = user->syncState.get();
+    const UserConnectionStats stats = user->Statistics();
+
+    // Updates faster than a fraction of the round trip time gain little, and on lossy links they mostly add resends
+    float target = std::max(minAdaptiveUpdatePeriod_, stats.roundTripTime * 0.25f);
+    target *= 1.f + 10.f * Clamp(stats.packetLossRate, 0.f, 1.f);
+
+    float period = state->updatePeriod > 0.f ? state->updatePeriod : updatePeriod_;
+    if (stats.queuedMessages > cCongestedQueuedMessages || stats.queuedBytes > cCongestedQueuedBytes)
+        period *= 1.5f; // Back off quickly while the queue is congested
+    else if (period > target)
+        period -= 0.25f * (period - target); // Recover gradually, so that the rate does not oscillate around the congestion point
+    else
+        period = target;
+    state->updatePeriod = Clamp(period, minAdaptiveUpdatePeriod_, maxAdaptiveUpdatePeriod_);
+}
+
+EntitySyncState* SyncManager::ProcessEntitySyncState(SyncContext& ctx, UserConnection* user, Scene* scene, EntitySyncState* it)
+{
+    unsigned sceneId = 0; ///\todo Replace with proper scene ID once multiscene support is in place.
+    
+    EntitySyncState& entityState = *it;
+    SceneSyncState* state = user->syncState.get();
+    entityState.lastSyncTime = kNet::Clock::Tick();
+
+    EntityPtr entity = scene->GetEntity(entityState.id);
+    bool removeState = false;
+    if (!entity)
+    {
+        if (!entityState.removed)
+            ctx.LogWarning("Entity " + QString::number(entityState.id) + " has gone missing from the scene without the remove properly signalled. Removing from replication state");
+        entityState.isNew = false;
+        removeState = true;
+    }
+    else
+    {
+        // Make sure we don't send data for local entities, or unacked entities after the create
+        if (entity->IsLocal() || (!entityState.isNew && entity->IsUnacked()))
+            return state->dirtyQueue.Remove(it);
+    }
+    
+    // Remove entity
+    if (entityState.removed)
+    {
+        // If we have both new & removed flags on the entity, it will probably result in buggy behaviour
+        if (entityState.isNew)
+        {
+            ctx.LogWarning("Entity " + QString::number(entityState.id) + " queued for both deletion and creation. Buggy behaviour will possibly result!");
+            // The delete has been processed. Do not remember it anymore, but requeue the state for creation
+            entityState.removed = false;
+            removeState = false;
+            // The receiver forgets the attribute baselines of the entity when it receives the delete
+            entityState.ClearAttributeBaselines();
+            // Continue from the next entity, or revisit this one if it was the last in the queue
+            it = state->dirtyQueue.Next(it) ? state->dirtyQueue.Next(it) : it;
+            state->dirtyQueue.MoveToBack(&entityState);
         }
         else
         {
-            // Make sure we don't send data for local entities, or unacked entities after the create
-            if (entity->IsLocal() || (!entityState.isNew && entity->IsUnacked()))
-            {
-                it = state->dirtyQueue.erase(it);
-                continue;
-            }
+            removeState = true;
+            it = state->dirtyQueue.Remove(it);
         }
         
-        // Remove entity
-        if (entityState.removed)
+        kNet::DataSerializer ds(ctx.removeEntityBuffer, 1024);
+        ds.AddVLE<kNet::VLE8_16_32>(sceneId);
+        ds.AddVLE<kNet::VLE8_16_32>(entityState.id & UniqueIdGenerator::LAST_REPLICATED_ID);
+        ctx.Send(user, cRemoveEntityMessage, true, true, ds);
+    }
+    // New entity
+    else if (entityState.isNew)
+    {
+        kNet::DataSerializer ds(ctx.createEntityBuffer, 64 * 1024);
+        WriteEntityFullUpdate(ctx, ds, entity.get(), user->ProtocolVersion() >= ProtocolHierarchicScene);
+        
+        // Mark the components undirty in the receiver's syncstate
+        const Entity::ComponentMap& components = entity->Components();
+        for (Entity::ComponentMap::const_iterator i = components.begin(); i != components.end(); ++i)
         {
-            // If we have both new & removed flags on the entity, it will probably result in buggy behaviour
-            if (entityState.isNew)
-            {
-                LogWarning("Entity " + QString::number(entityState.id) + " queued for both deletion and creation. Buggy behaviour will possibly result!");
-                // The delete has been processed. Do not remember it anymore, but requeue the state for creation
-                entityState.removed = false;
-                removeState = false;
-                state->dirtyQueue.push_back(&entityState);
-                entityState.isInQueue = true;
-            }
-            else
-                removeState = true;
-            
-            kNet::DataSerializer ds(removeEntityBuffer_, 1024);
-            ds.AddVLE<kNet::VLE8_16_32>(sceneId);
-            ds.AddVLE<kNet::VLE8_16_32>(entityState.id & UniqueIdGenerator::LAST_REPLICATED_ID);
-            user->Send(cRemoveEntityMessage, true, true, ds);
-            ++numMessagesSent;
-            it = state->dirtyQueue.erase(it);
+            if (i->second->IsReplicated())
+                state->MarkComponentProcessed(entity->Id(), i->second->Id());
         }
-        // New entity
-        else if (entityState.isNew)
+        
+        ctx.Send(user, cCreateEntityMessage, true, true, ds);
+        it = state->dirtyQueue.Remove(it);
+        // The create has been processed fully. Clear dirty flags.
+        state->MarkEntityProcessed(entity->Id());
+    }
+    else if (entity)
+    {
+        if (entityState.HasDirtyComponents())
         {
-            kNet::DataSerializer ds(createEntityBuffer_, 64 * 1024);
-            
-            // Entity identification and temporary flag
-            ds.AddVLE<kNet::VLE8_16_32>(sceneId);
-            ds.AddVLE<kNet::VLE8_16_32>(entityState.id & UniqueIdGenerator::LAST_REPLICATED_ID);
-            // Do not write the temporary flag as a bit to not desync the byte alignment at this point, as a lot of data potentially follows
-            ds.Add<u8>(entity->IsTemporary() ? 1 : 0);
-            // If hierarchic scene is supported, send parent entity ID or 0 if unparented. Note that this is a full 32bit ID to handle the unacked range if necessary
-            if (user->ProtocolVersion() >= ProtocolHierarchicScene)
-            {
-                if (entity->Parent() && entity->Parent()->IsLocal())
-                    LogWarning("Replicated entity " + QString::number(entityState.id) + " is parented to a local entity, can not replicate parenting properly over the network");
-
-                ds.Add<u32>(entity->Parent() ? entity->Parent()->Id() : 0);
-            }
-            
-            const Entity::ComponentMap& components = entity->Components();
-            // Count the amount of replicated components
-            uint numReplicatedComponents = 0;
-            for (Entity::ComponentMap::const_iterator i = components.begin(); i != components.end(); ++i)
-            {
-                if (i->second->IsReplicated())
-                    ++numReplicatedComponents;
-            }
-            ds.AddVLE<kNet::VLE8_16_32>(numReplicatedComponents);
+            // Components or attributes have been added, changed, or removed. Prepare the dataserializers
+            kNet::DataSerializer removeCompsDs(ctx.removeCompsBuffer, 1024);
+            kNet::DataSerializer removeAttrsDs(ctx.removeAttrsBuffer, 1024);
+            kNet::DataSerializer createCompsDs(ctx.createCompsBuffer, 64 * 1024);
+            kNet::DataSerializer createAttrsDs(ctx.createAttrsBuffer, 16 * 1024);
+            kNet::DataSerializer editAttrsDs(ctx.editAttrsBuffer, 64 * 1024);
+            const bool kNetUser = dynamic_cast<KNetUserConnection*>(user) != 0;
             
-            // Serialize each replicated component
-            for (Entity::ComponentMap::const_iterator i = components.begin(); i != components.end(); ++i)
+            for (size_t compIndex = 0; compIndex < entityState.components.size() && entityState.HasDirtyComponents(); ++compIndex)
             {
-                ComponentPtr comp = i->second;
-                if (!comp->IsReplicated())
+                ComponentSyncState& compState = entityState.components[compIndex];
+                if (!compState.isInQueue)
                     continue;
-                WriteComponentFullUpdate(ds, comp);
-                // Mark the component undirty in the receiver's syncstate
-                state->MarkComponentProcessed(entity->Id(), comp->Id());
-            }
-            
-            user->Send(cCreateEntityMessage, true, true, ds);
-            ++numMessagesSent;
-            it = state->dirtyQueue.erase(it);
-            // The create has been processed fully. Clear dirty flags.
-            state->MarkEntityProcessed(entity->Id());
-        }
-        else if (entity)
-        {
-            if (!entityState.dirtyQueue.empty())
-            {
-                // Components or attributes have been added, changed, or removed. Prepare the dataserializers
-                kNet::DataSerializer removeCompsDs(removeCompsBuffer_, 1024);
-                kNet::DataSerializer removeAttrsDs(removeAttrsBuffer_, 1024);
-                kNet::DataSerializer createCompsDs(createCompsBuffer_, 64 * 1024);
-                kNet::DataSerializer createAttrsDs(createAttrsBuffer_, 16 * 1024);
-                kNet::DataSerializer editAttrsDs(editAttrsBuffer_, 64 * 1024);
+                compState.isInQueue = false;
+                --entityState.numDirtyComponents;
+                
+                ComponentPtr comp = entity->GetComponentById(compState.id);
+                bool removeCompState = false;
+                if (!comp)
+                {
+                    if (!compState.removed)
+                        ctx.LogWarning("Component " + QString::number(compState.id) + " of " + entity->ToString() + " has gone missing from the scene without the remove properly signalled. Removing from client replication state->");
+                    compState.isNew = false;
+                    removeCompState = true;
+                }
+                else
+                {
+                    // Make sure we don't send data for local components, or unacked components after the create
+                    if (comp->IsLocal() || (!compState.isNew && comp->IsUnacked()))
+                        continue;
+                }
                 
-                while (!entityState.dirtyQueue.empty())
+                // Remove component
+                if (compState.removed)
                 {
-                    ComponentSyncState& compState = *entityState.dirtyQueue.front();
-                    entityState.dirtyQueue.pop_front();
-                    compState.isInQueue = false;
+                    removeCompState = true;
                     
-                    ComponentPtr comp = entity->GetComponentById(compState.id);
-                    bool removeCompState = false;
-                    if (!comp)
+                    // If first component, write the entity ID first
+                    if (!removeCompsDs.BytesFilled())
                     {
-                        if (!compState.removed)
-                            LogWarning("Component " + QString::number(compState.id) + " of " + entity->ToString() + " has gone missing from the scene without the remove properly signalled. Removing from client replication state->");
-                        compState.isNew = false;
-                        removeCompState = true;
+                        removeCompsDs.AddVLE<kNet::VLE8_16_32>(sceneId);
+                        removeCompsDs.AddVLE<kNet::VLE8_16_32>(entityState.id & UniqueIdGenerator::LAST_REPLICATED_ID);
                     }
-                    else
+                    // Then add component ID
+                    removeCompsDs.AddVLE<kNet::VLE8_16_32>(compState.id & UniqueIdGenerator::LAST_REPLICATED_ID);
+                }
+                // New component
+                else if (compState.isNew)
+                {
+                    // If first component, write the entity ID first
+                    if (!createCompsDs.BytesFilled())
                     {
-                        // Make sure we don't send data for local components, or unacked components after the create
-                        if (comp->IsLocal() || (!compState.isNew && comp->IsUnacked()))
-                            continue;
+                        createCompsDs.AddVLE<kNet::VLE8_16_32>(sceneId);
+                        createCompsDs.AddVLE<kNet::VLE8_16_32>(entityState.id & UniqueIdGenerator::LAST_REPLICATED_ID);
                     }
+                    // Then add the component data
+                    WriteComponentFullUpdate(ctx, createCompsDs, comp, SentStrings(user));
+                    // Mark the component undirty in the receiver's syncstate
+                    state->MarkComponentProcessed(entity->Id(), comp->Id());
+                }
+                // Added/removed/edited attributes
+                else if (comp)
+                {
+                    const AttributeVector& attrs = comp->Attributes();
                     
-                    // Remove component
-                    if (compState.removed)
+                    for (unsigned i = 0; i < 256; ++i)
                     {
-                        removeCompState = true;
+                        // Skip quickly over groups of 8 attributes with no creates or removes
+                        if (!(compState.newAttributes[i >> 3] | compState.removedAttributes[i >> 3]))
+                        {
+                            i |= 7;
+                            continue;
+                        }
+                        u8 attrIndex = (u8)i;
+                        const u8 attrBit = (u8)(1 << (attrIndex & 7));
+                        if (!((compState.newAttributes[attrIndex >> 3] | compState.removedAttributes[attrIndex >> 3]) & attrBit))
+                            continue;
+                        // Clear the corresponding dirty flags, so that we don't redundantly send attribute edited data.
+                        compState.dirtyAttributes[attrIndex >> 3] &= ~attrBit;
                         
-                        // If first component, write the entity ID first
-                        if (!removeCompsDs.BytesFilled())
+                        if (compState.newAttributes[attrIndex >> 3] & attrBit)
                         {
-                            removeCompsDs.AddVLE<kNet::VLE8_16_32>(sceneId);
-                            removeCompsDs.AddVLE<kNet::VLE8_16_32>(entityState.id & UniqueIdGenerator::LAST_REPLICATED_ID);
+                            // Create attribute. Make sure it exists and is dynamic.
+                            if (attrIndex >= attrs.size() || !attrs[attrIndex])
+                                ctx.LogError("CreateAttribute for nonexisting attribute index " + QString::number(attrIndex) + " was queued for component " + comp->TypeName() + " in " + entity->ToString() + ". Discarding.");
+                            else if (!attrs[attrIndex]->IsDynamic())
+                                ctx.LogError("CreateAttribute for a static attribute index " + QString::number(attrIndex) + " was queued for component " + comp->TypeName() + " in " + entity->ToString() + ". Discarding.");
+                            else
+                            {
+                                // If first attribute, write the entity ID first
+                                if (!createAttrsDs.BytesFilled())
+                                {
+                                    createAttrsDs.AddVLE<kNet::VLE8_16_32>(sceneId);
+                                    createAttrsDs.AddVLE<kNet::VLE8_16_32>(entityState.id & UniqueIdGenerator::LAST_REPLICATED_ID);
+                                }
+                                
+                                IAttribute* attr = attrs[attrIndex];
+                                createAttrsDs.AddVLE<kNet::VLE8_16_32>(compState.id & UniqueIdGenerator::LAST_REPLICATED_ID);
+                                createAttrsDs.Add<u8>(attrIndex); // Index
+                                createAttrsDs.Add<u8>(attr->TypeId());
+                                WriteName(createAttrsDs, attr->Name().toStdString(), SentStrings(user));
+                                ctx.WriteAttribute(createAttrsDs, entity->Id(), comp->Id(), attr);
+                            }
                         }
-                        // Then add component ID
-                        removeCompsDs.AddVLE<kNet::VLE8_16_32>(compState.id & UniqueIdGenerator::LAST_REPLICATED_ID);
-                    }
-                    // New component
-                    else if (compState.isNew)
-                    {
-                        // If first component, write the entity ID first
-                        if (!createCompsDs.BytesFilled())
+                        else
                         {
-                            createCompsDs.AddVLE<kNet::VLE8_16_32>(sceneId);
-                            createCompsDs.AddVLE<kNet::VLE8_16_32>(entityState.id & UniqueIdGenerator::LAST_REPLICATED_ID);
+                            // Remove attribute
+                            // If first attribute, write the entity ID first
+                            if (!removeAttrsDs.BytesFilled())
+                            {
+                                removeAttrsDs.AddVLE<kNet::VLE8_16_32>(sceneId);
+                                removeAttrsDs.AddVLE<kNet::VLE8_16_32>(entityState.id & UniqueIdGenerator::LAST_REPLICATED_ID);
+                            }
+                            removeAttrsDs.AddVLE<kNet::VLE8_16_32>(compState.id & UniqueIdGenerator::LAST_REPLICATED_ID);
+                            removeAttrsDs.Add<u8>(attrIndex);
                         }
-                        // Then add the component data
-                        WriteComponentFullUpdate(createCompsDs, comp);
-                        // Mark the component undirty in the receiver's syncstate
-                        state->MarkComponentProcessed(entity->Id(), comp->Id());
                     }
-                    // Added/removed/edited attributes
-                    else if (comp)
+                    compState.ClearAttributesCreatedOrRemoved();
+                    
+                    // Now, if remaining dirty bits exist, they must be sent in the edit attributes message. These are the majority of our network data.
+                    ctx.changedAttributes.clear();
+                    unsigned numBytes = ((unsigned)attrs.size() + 7) >> 3;
+                    for (unsigned i = 0; i < numBytes; ++i)
                     {
-                        const AttributeVector& attrs = comp->Attributes();
-                        
-                        for (std::map<u8, bool>::iterator i = compState.newAndRemovedAttributes.begin(); i != compState.newAndRemovedAttributes.end(); ++i)
+                        u8 byte = compState.dirtyAttributes[i];
+                        if (byte)
                         {
-                            u8 attrIndex = i->first;
-                            // Clear the corresponding dirty flags, so that we don't redundantly send attribute edited data.
-                            compState.dirtyAttributes[attrIndex >> 3] &= ~(1 << (attrIndex & 7));
-                            
-                            if (i->second)
+                            for (unsigned j = 0; j < 8; ++j)
                             {
-                                // Create attribute. Make sure it exists and is dynamic.
-                                if (attrIndex >= attrs.size() || !attrs[attrIndex])
-                                    LogError("CreateAttribute for nonexisting attribute index " + QString::number(attrIndex) + " was queued for component " + comp->TypeName() + " in " + entity->ToString() + ". Discarding.");
-                                else if (!attrs[attrIndex]->IsDynamic())
-                                    LogError("CreateAttribute for a static attribute index " + QString::number(attrIndex) + " was queued for component " + comp->TypeName() + " in " + entity->ToString() + ". Discarding.");
-                                else
+                                if (byte & (1 << j))
                                 {
-                                    // If first attribute, write the entity ID first
-                                    if (!createAttrsDs.BytesFilled())
-                                    {
-                                        createAttrsDs.AddVLE<kNet::VLE8_16_32>(sceneId);
-                                        createAttrsDs.AddVLE<kNet::VLE8_16_32>(entityState.id & UniqueIdGenerator::LAST_REPLICATED_ID);
-                                    }
-                                    
-                                    IAttribute* attr = attrs[attrIndex];
-                                    createAttrsDs.AddVLE<kNet::VLE8_16_32>(compState.id & UniqueIdGenerator::LAST_REPLICATED_ID);
-                                    createAttrsDs.Add<u8>(attrIndex); // Index
-                                    createAttrsDs.Add<u8>(attr->TypeId());
-                                    createAttrsDs.AddString(attr->Name().toStdString());
-                                    attr->ToBinary(createAttrsDs);
+                                    u8 attrIndex = i * 8 + j;
+                                    if (attrIndex < attrs.size() && attrs[attrIndex])
+                                        ctx.changedAttributes.push_back(attrIndex);
+                                    else
+                                        ctx.LogError("Attribute change for a nonexisting attribute index " + QString::number(attrIndex) + " was queued for component " + comp->TypeName() + " in " + entity->ToString() + ". Discarding.");
                                 }
                             }
-                            else
+                        }
+                    }
+                    // Changes of rate limited attributes are held back until their replication interval has passed since the previous send
+                    for (size_t i = 0; i < ctx.changedAttributes.size(); ++i)
+                    {
+                        const u8 attrIndex = ctx.changedAttributes[i];
+                        const AttributeMetadata *metadata = attrs[attrIndex]->Metadata();
+                        if (!metadata || !(metadata->maxReplicationRate > 0.f))
+                            continue;
+                        ComponentSyncState::RateLimitedAttribute &rateLimited = compState.RateLimitedAttributeState(attrIndex);
+                        const kNet::tick_t now = kNet::Clock::Tick();
+                        const kNet::tick_t dueTime = rateLimited.lastSendTime + (kNet::tick_t)(kNet::Clock::TicksPerSec() / metadata->maxReplicationRate);
+                        if (rateLimited.lastSendTime && now < dueTime)
+                        {
+                            state->DeferAttribute(entityState, compState, attrIndex, dueTime);
+                            compState.dirtyAttributes[attrIndex >> 3] &= ~(u8)(1 << (attrIndex & 7));
+                            ctx.changedAttributes.erase(ctx.changedAttributes.begin() + i--);
+                        }
+                        else
+                            rateLimited.lastSendTime = now;
+                    }
+                    // Attributes whose latest value wins are sent to kNet users in separate messages, so that kNet can drop the outdated ones
+                    if (kNetUser)
+                    {
+                        for (size_t i = 0; i < ctx.changedAttributes.size(); ++i)
+                        {
+                            const u8 attrIndex = ctx.changedAttributes[i];
+                            const AttributeMetadata *metadata = attrs[attrIndex]->Metadata();
+                            if (metadata && metadata->latestValueWins && LatestValueContentId(entityState.id, compState.id, attrIndex))
                             {
-                                // Remove attribute
-                                // If first attribute, write the entity ID first
-                                if (!removeAttrsDs.BytesFilled())
-                                {
-                                    removeAttrsDs.AddVLE<kNet::VLE8_16_32>(sceneId);
-                                    removeAttrsDs.AddVLE<kNet::VLE8_16_32>(entityState.id & UniqueIdGenerator::LAST_REPLICATED_ID);
-                                }
-                                removeAttrsDs.AddVLE<kNet::VLE8_16_32>(compState.id & UniqueIdGenerator::LAST_REPLICATED_ID);
-                                removeAttrsDs.Add<u8>(attrIndex);
+                                SyncContext::LatestValueAttribute latest = { compState.id, attrIndex, attrs[attrIndex] };
+                                ctx.latestValueAttributes.push_back(latest);
+                                compState.dirtyAttributes[attrIndex >> 3] &= ~(u8)(1 << (attrIndex & 7));
+                                ctx.changedAttributes.erase(ctx.changedAttributes.begin() + i--);
                             }
                         }
-                        compState.newAndRemovedAttributes.clear();
-                        
-                        // Now, if remaining dirty bits exist, they must be sent in the edit attributes message. These are the majority of our network data.
-                        changedAttributes_.clear();
-                        unsigned numBytes = ((unsigned)attrs.size() + 7) >> 3;
-                        for (unsigned i = 0; i < numBytes; ++i)
+                        if (ctx.changedAttributes.empty())
+                            for (unsigned i = 0; i < numBytes; ++i)
+                                compState.dirtyAttributes[i] = 0;
+                    }
+                    if (ctx.changedAttributes.size())
+                    {
+                        /// Hack for web clients that don't support ReplicateRigidBodyChanges()
+                        /// Don't send out minuscule pos/rot/scale changes as it spams the network.
+                        bool sendChanges = true;
+                        if (dynamic_cast<KNetUserConnection*>(user) == 0 && user->protocolVersion < ProtocolWebClientRigidBodyMessage)
                         {
-                            u8 byte = compState.dirtyAttributes[i];
-                            if (byte)
+                            if (comp->TypeId() == EC_Placeable::TypeIdStatic() && ctx.changedAttributes.size() == 1 && ctx.changedAttributes[0] == 0)
                             {
-                                for (unsigned j = 0; j < 8; ++j)
+                                // EC_Placeable::Transform is the only change!
+                                EC_Placeable *placeable = dynamic_cast<EC_Placeable*>(comp.get());
+                                if (placeable)
                                 {
-                                    if (byte & (1 << j))
+                                    const Transform &t = placeable->transform.Get();
+                                    bool posChanged = (t.pos.DistanceSq(entityState.transform.pos) > 1e-3f);
+                                    bool rotChanged = (t.rot.DistanceSq(entityState.transform.rot) > 1e-1f);
+                                    bool scaleChanged = (t.scale.DistanceSq(entityState.transform.scale) > 1e-3f);
+                            
+                                    if (!posChanged && !rotChanged && !scaleChanged) // Dont send anything!
                                     {
-                                        u8 attrIndex = i * 8 + j;
-                                        if (attrIndex < attrs.size() && attrs[attrIndex])
-                                            changedAttributes_.push_back(attrIndex);
-                                        else
-                                            LogError("Attribute change for a nonexisting attribute index " + QString::number(attrIndex) + " was queued for component " + comp->TypeName() + " in " + entity->ToString() + ". Discarding.");
+                                        //qDebug() << "EC_Placeable too small changes: " << t.pos.DistanceSq(entityState.transform.pos) << t.rot.DistanceSq(entityState.transform.rot) << t.scale.DistanceSq(entityState.transform.scale);
+                                        sendChanges = false;
                                     }
+                                    else
+                                        entityState.transform = t; // Lets send the update. Update transform for the next above comparison.
                                 }
                             }
                         }
-                        if (changedAttributes_.size())
+
+                        if (sendChanges)
                         {
-                            /// Hack for web clients that don't support ReplicateRigidBodyChanges()
-                            /// Don't send out minuscule pos/rot/scale changes as it spams the network.
-                            bool sendChanges = true;
-                            if (dynamic_cast<KNetUserConnection*>(user) == 0 && user->protocolVersion < ProtocolWebClientRigidBodyMessage)
+                            // If first component for which attribute changes are sent, write the entity ID first
+                            if (!editAttrsDs.BytesFilled())
                             {
-                                if (comp->TypeId() == EC_Placeable::TypeIdStatic() && changedAttributes_.size() == 1 && changedAttributes_[0] == 0)
-                                {
-                                    // EC_Placeable::Transform is the only change!
-                                    EC_Placeable *placeable = dynamic_cast<EC_Placeable*>(comp.get());
-                                    if (placeable)
-                                    {
-                                        const Transform &t = placeable->transform.Get();
-                                        bool posChanged = (t.pos.DistanceSq(entityState.transform.pos) > 1e-3f);
-                                        bool rotChanged = (t.rot.DistanceSq(entityState.transform.rot) > 1e-1f);
-                                        bool scaleChanged = (t.scale.DistanceSq(entityState.transform.scale) > 1e-3f);
-                                
-                                        if (!posChanged && !rotChanged && !scaleChanged) // Dont send anything!
-                                        {
-                                            //qDebug() << "EC_Placeable too small changes: " << t.pos.DistanceSq(entityState.transform.pos) << t.rot.DistanceSq(entityState.transform.rot) << t.scale.DistanceSq(entityState.transform.scale);
-                                            sendChanges = false;
-                                        }
-                                        else
-                                            entityState.transform = t; // Lets send the update. Update transform for the next above comparison.
-                                    }
-                                }
+                                editAttrsDs.AddVLE<kNet::VLE8_16_32>(sceneId);
+                                editAttrsDs.AddVLE<kNet::VLE8_16_32>(entityState.id & UniqueIdGenerator::LAST_REPLICATED_ID);
                             }
+                            editAttrsDs.AddVLE<kNet::VLE8_16_32>(compState.id & UniqueIdGenerator::LAST_REPLICATED_ID);
+                        
+                            // Create a nested dataserializer for the actual attribute data, so we can skip components
+                            kNet::DataSerializer attrDataDs(ctx.attrDataBuffer, 16 * 1024);
 
-                            if (sendChanges)
+                            // If supported, delta-encode the attribute values against the values previously sent to the user
+                            const bool useDeltas = user->ProtocolVersion() >= ProtocolAttributeDeltas;
+                            if (useDeltas && compState.attributeBaselines.size() < attrs.size())
+                                compState.attributeBaselines.resize(attrs.size());
+                        
+                            // There are changed attributes. Check if it is more optimal to send attribute indices, or the whole bitmask
+                            unsigned bitsMethod1 = (unsigned)ctx.changedAttributes.size() * 8 + 8;
+                            unsigned bitsMethod2 = (unsigned)attrs.size();
+                            // Method 1: indices
+                            if (bitsMethod1 <= bitsMethod2)
                             {
-                                // If first component for which attribute changes are sent, write the entity ID first
-                                if (!editAttrsDs.BytesFilled())
-                                {
-                                    editAttrsDs.AddVLE<kNet::VLE8_16_32>(sceneId);
-                                    editAttrsDs.AddVLE<kNet::VLE8_16_32>(entityState.id & UniqueIdGenerator::LAST_REPLICATED_ID);
-                                }
-                                editAttrsDs.AddVLE<kNet::VLE8_16_32>(compState.id & UniqueIdGenerator::LAST_REPLICATED_ID);
-                            
-                                // Create a nested dataserializer for the actual attribute data, so we can skip components
-                                kNet::DataSerializer attrDataDs(attrDataBuffer_, 16 * 1024);
-                            
-                                // There are changed attributes. Check if it is more optimal to send attribute indices, or the whole bitmask
-                                unsigned bitsMethod1 = (unsigned)changedAttributes_.size() * 8 + 8;
-                                unsigned bitsMethod2 = (unsigned)attrs.size();
-                                // Method 1: indices
-                                if (bitsMethod1 <= bitsMethod2)
+                                attrDataDs.Add<kNet::bit>(0);
+                                attrDataDs.Add<u8>((u8)ctx.changedAttributes.size());
+                                for (unsigned i = 0; i < ctx.changedAttributes.size(); ++i)
                                 {
-                                    attrDataDs.Add<kNet::bit>(0);
-                                    attrDataDs.Add<u8>((u8)changedAttributes_.size());
-                                    for (unsigned i = 0; i < changedAttributes_.size(); ++i)
-                                    {
-                                        attrDataDs.Add<u8>(changedAttributes_[i]);
-                                        attrs[changedAttributes_[i]]->ToBinary(attrDataDs);
-                                    }
+                                    const u8 attrIndex = ctx.changedAttributes[i];
+                                    attrDataDs.Add<u8>(attrIndex);
+                                    if (useDeltas)
+                                        ctx.WriteAttributeDelta(attrDataDs, entity->Id(), comp->Id(), attrs[attrIndex], compState.attributeBaselines[attrIndex]);
+                                    else
+                                        ctx.WriteAttribute(attrDataDs, entity->Id(), comp->Id(), attrs[attrIndex]);
                                 }
-                                // Method 2: bitmask
-                                else
+                            }
+                            // Method 2: bitmask
+                            else
+                            {
+                                attrDataDs.Add<kNet::bit>(1);
+                                for (unsigned i = 0; i < attrs.size(); ++i)
                                 {
-                                    attrDataDs.Add<kNet::bit>(1);
-                                    for (unsigned i = 0; i < attrs.size(); ++i)
+                                    if (compState.dirtyAttributes[i >> 3] & (1 << (i & 7)))
                                     {
-                                        if (compState.dirtyAttributes[i >> 3] & (1 << (i & 7)))
-                                        {
-                                            attrDataDs.Add<kNet::bit>(1);
-                                            attrs[i]->ToBinary(attrDataDs);
-                                        }
+                                        attrDataDs.Add<kNet::bit>(1);
+                                        if (useDeltas)
+                                            ctx.WriteAttributeDelta(attrDataDs, entity->Id(), comp->Id(), attrs[i], compState.attributeBaselines[i]);
                                         else
-                                            attrDataDs.Add<kNet::bit>(0);
+                                            ctx.WriteAttribute(attrDataDs, entity->Id(), comp->Id(), attrs[i]);
                                     }
+                                    else
+                                        attrDataDs.Add<kNet::bit>(0);
                                 }
-                            
-                                // Add the attribute data array to the main serializer
-                                editAttrsDs.AddVLE<kNet::VLE8_16_32>((u32)attrDataDs.BytesFilled());
-                                editAttrsDs.AddArray<u8>((unsigned char*)attrDataBuffer_, (u32)attrDataDs.BytesFilled());
                             }
-
-                            // Now zero out all remaining dirty bits
-                            for (unsigned i = 0; i < numBytes; ++i)
-                                compState.dirtyAttributes[i] = 0;
+                        
+                            // Add the attribute data array to the main serializer
+                            editAttrsDs.AddVLE<kNet::VLE8_16_32>((u32)attrDataDs.BytesFilled());
+                            editAttrsDs.AddArray<u8>((unsigned char*)ctx.attrDataBuffer, (u32)attrDataDs.BytesFilled());
                         }
+
+                        // Now zero out all remaining dirty bits
+                        for (unsigned i = 0; i < numBytes; ++i)
+                            compState.dirtyAttributes[i] = 0;
                     }
-                    
-                    if (removeCompState)
-                        entityState.components.erase(compState.id);
                 }
                 
-                // Send the messages which have data
-                if (removeCompsDs.BytesFilled())
-                {
-                    user->Send(cRemoveComponentsMessage, true, true, removeCompsDs);
-                    ++numMessagesSent;
-                }
-                if (removeAttrsDs.BytesFilled())
-                {
-                    user->Send(cRemoveAttributesMessage, true, true, removeAttrsDs);
-                    ++numMessagesSent;
-                }
-                if (createCompsDs.BytesFilled())
-                {
-                    user->Send(cCreateComponentsMessage, true, true, createCompsDs);
-                    ++numMessagesSent;
-                }
-                if (createAttrsDs.BytesFilled())
-                {
-                    user->Send(cCreateAttributesMessage, true, true, createAttrsDs);
-                    ++numMessagesSent;
-                }
-                if (editAttrsDs.BytesFilled())
-                {
-                    user->Send(cEditAttributesMessage, true, true, editAttrsDs);
-                    ++numMessagesSent;
-                }
+                if (removeCompState)
+                    entityState.RemoveComponentAt(compIndex--); // The last component state was moved to this index, process it next
             }
             
-            // Check if entity has other property changes (temporary flag)
-            if (entityState.hasPropertyChanges)
+            // Send the messages which have data
+            if (removeCompsDs.BytesFilled())
             {
-                kNet::DataSerializer editPropertiesDs(editAttrsBuffer_, 1024);
-                editPropertiesDs.AddVLE<kNet::VLE8_16_32>(sceneId);
-                editPropertiesDs.AddVLE<kNet::VLE8_16_32>(entityState.id & UniqueIdGenerator::LAST_REPLICATED_ID);
-                editPropertiesDs.Add<u8>(entity->IsTemporary() ? 1 : 0);
-                user->Send(cEditEntityPropertiesMessage, true, true, editPropertiesDs);
-                ++numMessagesSent;
+                ctx.Send(user, cRemoveComponentsMessage, true, true, removeCompsDs);
             }
-            if (entityState.hasParentChange && user->ProtocolVersion() >= ProtocolHierarchicScene)
+            if (removeAttrsDs.BytesFilled())
             {
-                EntityPtr parent = entity->Parent();
-                kNet::DataSerializer editParentDs(editAttrsBuffer_, 1024);
-                editParentDs.AddVLE<kNet::VLE8_16_32>(sceneId);
-                editParentDs.Add<u32>(entityState.id);
-                editParentDs.Add<u32>(parent ? parent->Id() : 0);
-                user->Send(cSetEntityParentMessage, true, true, editParentDs);
-                ++numMessagesSent;
+                ctx.Send(user, cRemoveAttributesMessage, true, true, removeAttrsDs);
             }
-
-            it = state->dirtyQueue.erase(it);
-            // The entity has been processed fully. Clear dirty flags.
-            state->MarkEntityProcessed(entity->Id());
+            if (createCompsDs.BytesFilled() || createAttrsDs.BytesFilled())
+                SendNewStrings(user, &ctx);
+            if (createCompsDs.BytesFilled())
+            {
+                ctx.Send(user, cCreateComponentsMessage, true, true, createCompsDs);
+            }
+            if (createAttrsDs.BytesFilled())
+            {
+                ctx.Send(user, cCreateAttributesMessage, true, true, createAttrsDs);
+            }
+            if (editAttrsDs.BytesFilled())
+            {
+                ctx.Send(user, cEditAttributesMessage, true, true, editAttrsDs);
+            }
+            // The latest value wins attributes are always sent in full, as a delta would depend on the updates that may be dropped
+            for (size_t i = 0; i < ctx.latestValueAttributes.size(); ++i)
+            {
+                const SyncContext::LatestValueAttribute &latest = ctx.latestValueAttributes[i];
+                kNet::DataSerializer attrDataDs(ctx.attrDataBuffer, 16 * 1024);
+                attrDataDs.Add<kNet::bit>(0);
+                attrDataDs.Add<u8>(1);
+                attrDataDs.Add<u8>(latest.index);
+                if (user->ProtocolVersion() >= ProtocolAttributeDeltas)
+                {
+                    ctx.latestValueBaseline.clear();
+                    ctx.WriteAttributeDelta(attrDataDs, entity->Id(), latest.componentId, latest.attribute, ctx.latestValueBaseline);
+                }
+                else
+                    ctx.WriteAttribute(attrDataDs, entity->Id(), latest.componentId, latest.attribute);
+
+                kNet::DataSerializer latestDs(ctx.editAttrsBuffer, 64 * 1024);
+                latestDs.AddVLE<kNet::VLE8_16_32>(sceneId);
+                latestDs.AddVLE<kNet::VLE8_16_32>(entityState.id & UniqueIdGenerator::LAST_REPLICATED_ID);
+                latestDs.AddVLE<kNet::VLE8_16_32>(latest.componentId & UniqueIdGenerator::LAST_REPLICATED_ID);
+                latestDs.AddVLE<kNet::VLE8_16_32>((u32)attrDataDs.BytesFilled());
+                latestDs.AddArray<u8>((unsigned char*)ctx.attrDataBuffer, (u32)attrDataDs.BytesFilled());
+                ctx.Send(user, cEditAttributesMessage, true, true, latestDs, 100, LatestValueContentId(entityState.id, latest.componentId, latest.index));
+            }
+            ctx.latestValueAttributes.clear();
         }
         
-        if (removeState)
-            state->entities.erase(entityState.id);
-    }
-
-    // Send queued entity actions after scene sync
-    if (state->queuedActions.size())
-    {
-        for (size_t i = 0; i < state->queuedActions.size(); ++i)
-            user->Send(state->queuedActions[i]);
+        // Check if entity has other property changes (temporary flag)
+        if (entityState.hasPropertyChanges)
+        {
+            kNet::DataSerializer editPropertiesDs(ctx.editAttrsBuffer, 1024);
+            editPropertiesDs.AddVLE<kNet::VLE8_16_32>(sceneId);
+            editPropertiesDs.AddVLE<kNet::VLE8_16_32>(entityState.id & UniqueIdGenerator::LAST_REPLICATED_ID);
+            editPropertiesDs.Add<u8>(entity->IsTemporary() ? 1 : 0);
+            ctx.Send(user, cEditEntityPropertiesMessage, true, true, editPropertiesDs);
+        }
+        if (entityState.hasParentChange && user->ProtocolVersion() >= ProtocolHierarchicScene)
+        {
+            EntityPtr parent = entity->Parent();
+            kNet::DataSerializer editParentDs(ctx.editAttrsBuffer, 1024);
+            editParentDs.AddVLE<kNet::VLE8_16_32>(sceneId);
+            editParentDs.Add<u32>(entityState.id);
+            editParentDs.Add<u32>(parent ? parent->Id() : 0);
+            ctx.Send(user, cSetEntityParentMessage, true, true, editParentDs);
+        }
 
-        state->queuedActions.clear();
+        it = state->dirtyQueue.Remove(it);
+        // The entity has been processed fully. Clear dirty flags.
+        state->MarkEntityProcessed(entity->Id());
     }
-
-    //if (numMessagesSent)
-    //    std::cout << "Sent " << numMessagesSent << " scenesync messages" << std::endl;
+    else
+    {
+        // The entity has gone missing without a remove, nothing to send
+        it = state->dirtyQueue.Remove(it);
+    }
+    
+    if (removeState)
+        state->RemoveEntityState(entityState.id);
+    return it;
 }
 
 bool SyncManager::ValidateAction(UserConnection* source, unsigned /*messageID*/, entity_id_t /*entityID*/)
@@ -1938,6 +2830,221 @@ bool SyncManager::ValidateAction(UserConnection* source, unsigned /*messageID*/,
     return true;
 }
 
+void SyncManager::HandleSceneSnapshot(UserConnection* source, const char* data, size_t numBytes)
+{
+    if (owner_->IsServer())
+    {
+        LogWarning("Received a scene snapshot from a client, disregarding SceneSnapshot message");
+        return;
+    }
+
+    QByteArray snapshot = qUncompress((const uchar*)data, (int)numBytes);
+    if (snapshot.isEmpty() && numBytes > 4)
+        throw kNet::NetException("Malformed SceneSnapshot message");
+
+    // The snapshot consists of create entity messages, each prefixed with its size
+    kNet::DataDeserializer ds(snapshot.constData(), (size_t)snapshot.size());
+    while(ds.BytesLeft() > 0)
+    {
+        const u32 size = ds.ReadVLE<kNet::VLE8_16_32>();
+        if (size > ds.BytesLeft())
+            throw kNet::NetException("Malformed SceneSnapshot message");
+        if (!QueueEntityMessage(source, cCreateEntityMessage, snapshot.constData() + ds.BytePos(), size))
+            HandleCreateEntity(source, snapshot.constData() + ds.BytePos(), size);
+        ds.SkipBytes(size);
+    }
+}
+
+bool SyncManager::QueueEntityMessage(UserConnection* source, kNet::message_id_t messageId, const char* data, size_t numBytes)
+{
+    // If the budget was just disabled, keep queueing until the queue is emptied on the next frame, so that the order is retained
+    if (createTimeBudget_ <= 0.f && queuedEntities_.empty())
+        return false;
+    if (owner_->IsServer())
+        return false;
+
+    kNet::DataDeserializer ds(data, numBytes);
+    switch(messageId)
+    {
+    case cCreateEntityMessage:
+    {
+        ds.ReadVLE<kNet::VLE8_16_32>(); // Scene ID
+        const entity_id_t entityID = ds.ReadVLE<kNet::VLE8_16_32>();
+        // A new create replaces a queued entity with the same ID, as HandleCreateEntity() would replace an existing entity
+        QueuedEntity &entity = queuedEntities_[entityID];
+        entity = QueuedEntity();
+        entity.order = queuedEntityOrder_++;
+        ds.Read<u8>(); // Temporary flag
+        if (source->ProtocolVersion() >= ProtocolHierarchicScene)
+            entity.parentId = ds.Read<u32>();
+        // Find the position of the placeable for creating the nearest entities first
+        const unsigned numComponents = ds.ReadVLE<kNet::VLE8_16_32>();
+        for(unsigned i = 0; i < numComponents && !entity.hasPosition; ++i)
+        {
+            ds.ReadVLE<kNet::VLE8_16_32>(); // Component ID
+            const u32 typeID = ds.ReadVLE<kNet::VLE8_16_32>();
+            ds.ReadString();
+            const u32 attrDataSize = ds.ReadVLE<kNet::VLE8_16_32>();
+            if (typeID == EC_Placeable::TypeIdStatic() && attrDataSize >= 3 * sizeof(float))
+            {
+                // The transform is the first attribute of the placeable, and starts with the position
+                entity.position.x = ds.Read<float>();
+                entity.position.y = ds.Read<float>();
+                entity.position.z = ds.Read<float>();
+                entity.hasPosition = true;
+            }
+            else
+                ds.SkipBytes(attrDataSize);
+        }
+        entity.messages.push_back(std::make_pair(messageId, QByteArray(data, (int)numBytes)));
+        return true;
+    }
+    case cRemoveEntityMessage:
+    {
+        ds.ReadVLE<kNet::VLE8_16_32>(); // Scene ID
+        // The entity has not been created yet, so it can be simply forgotten
+        return queuedEntities_.erase(ds.ReadVLE<kNet::VLE8_16_32>()) > 0;
+    }
+    case cCreateComponentsMessage:
+    case cCreateAttributesMessage:
+    case cEditAttributesMessage:
+    case cRemoveAttributesMessage:
+    case cRemoveComponentsMessage:
+    case cEditEntityPropertiesMessage:
+    {
+        ds.ReadVLE<kNet::VLE8_16_32>(); // Scene ID
+        std::map<entity_id_t, QueuedEntity>::iterator entity = queuedEntities_.find(ds.ReadVLE<kNet::VLE8_16_32>());
+        if (entity == queuedEntities_.end())
+            return false;
+        entity->second.messages.push_back(std::make_pair(messageId, QByteArray(data, (int)numBytes)));
+        return true;
+    }
+    case cSetEntityParentMessage:
+    {
+        ds.ReadVLE<kNet::VLE8_16_32>(); // Scene ID
+        const entity_id_t entityID = ds.Read<u32>();
+        const entity_id_t parentEntityID = ds.Read<u32>();
+        std::map<entity_id_t, QueuedEntity>::iterator entity = queuedEntities_.find(entityID);
+        if (entity != queuedEntities_.end())
+        {
+            entity->second.parentId = parentEntityID;
+            entity->second.messages.push_back(std::make_pair(messageId, QByteArray(data, (int)numBytes)));
+            return true;
+        }
+        // The new parent must exist before the entity is parented to it
+        if (queuedEntities_.find(parentEntityID) != queuedEntities_.end())
+            CreateQueuedEntity(parentEntityID);
+        return false;
+    }
+    case cEntityActionMessage:
+    {
+        // Actions are executed right away, so create the target entity first
+        kNet::DataDeserializer ds(data, numBytes);
+        const entity_id_t entityID = ds.Read<u32>();
+        if (queuedEntities_.find(entityID) != queuedEntities_.end())
+            CreateQueuedEntity(entityID);
+        return false;
+    }
+    }
+    return false;
+}
+
+void SyncManager::CreateQueuedEntities()
+{
+    PROFILE(SyncManager_CreateQueuedEntities);
+
+    if (scene_.expired())
+    {
+        queuedEntities_.clear();
+        return;
+    }
+
+    // Nearest to the observer first, or in the order received if there is no observer. Children are ordered by their parent's position.
+    EC_Placeable *observer = !observer_.expired() ? observer_.lock()->Component<EC_Placeable>().get() : 0;
+    const float3 observerPos = observer ? observer->WorldPosition() : float3::zero;
+    ScenePtr scene = scene_.lock();
+    queuedEntityHeap_.clear();
+    for(std::map<entity_id_t, QueuedEntity>::const_iterator i = queuedEntities_.begin(); i != queuedEntities_.end(); ++i)
+    {
+        float key = (float)i->second.order;
+        if (observer)
+        {
+            const QueuedEntity *entity = &i->second;
+            float3 pos = entity->position;
+            bool hasPosition = entity->hasPosition;
+            if (entity->parentId)
+            {
+                std::map<entity_id_t, QueuedEntity>::const_iterator parent = queuedEntities_.find(entity->parentId);
+                EntityPtr parentEntity = parent == queuedEntities_.end() ? scene->EntityById(entity->parentId) : EntityPtr();
+                EC_Placeable *parentPlaceable = parentEntity ? parentEntity->Component<EC_Placeable>().get() : 0;
+                if (parent != queuedEntities_.end())
+                {
+                    pos = parent->second.position;
+                    hasPosition = parent->second.hasPosition;
+                }
+                else if (parentPlaceable)
+                {
+                    pos = parentPlaceable->WorldPosition();
+                    hasPosition = true;
+                }
+            }
+            // Entities without a position, such as scripts and environment settings, go first
+            key = hasPosition ? pos.DistanceSq(observerPos) : 0.f;
+        }
+        queuedEntityHeap_.push_back(std::make_pair(key, i->first));
+    }
+    std::make_heap(queuedEntityHeap_.begin(), queuedEntityHeap_.end(), std::greater<std::pair<float, entity_id_t> >());
+
+    const kNet::tick_t startTime = kNet::Clock::Tick();
+    int numCreated = 0;
+    try
+    {
+        // At least one entity is created on each frame
+        while(!queuedEntityHeap_.empty())
+        {
+            std::pop_heap(queuedEntityHeap_.begin(), queuedEntityHeap_.end(), std::greater<std::pair<float, entity_id_t> >());
+            const entity_id_t id = queuedEntityHeap_.back().second;
+            queuedEntityHeap_.pop_back();
+            numCreated += CreateQueuedEntity(id); // Does nothing if the entity was already created as a parent
+            // Handling a message may have removed the scene.
+            if (scene_.expired())
+            {
+                queuedEntities_.clear();
+                break;
+            }
+            if (createTimeBudget_ > 0.f && kNet::Clock::TimespanToMillisecondsD(startTime, kNet::Clock::Tick()) >= createTimeBudget_)
+                break;
+        }
+    }
+    catch (kNet::NetException& e)
+    {
+        LogError("Exception while creating queued entities: " + QString(e.what()));
+        queuedEntities_.clear();
+        serverConnection_->Disconnect();
+    }
+    queuedEntityHeap_.clear();
+
+    if (numCreated)
+        emit QueuedEntitiesCreated(numCreated, NumQueuedEntities());
+}
+
+int SyncManager::CreateQueuedEntity(entity_id_t id)
+{
+    std::map<entity_id_t, QueuedEntity>::iterator entity = queuedEntities_.find(id);
+    if (entity == queuedEntities_.end())
+        return 0;
+    // Remove from the queue first, so that the messages are handled instead of queued again
+    const entity_id_t parentId = entity->second.parentId;
+    std::vector<std::pair<kNet::message_id_t, QByteArray> > messages;
+    messages.swap(entity->second.messages);
+    queuedEntities_.erase(entity);
+
+    int numCreated = (parentId && parentId != id) ? CreateQueuedEntity(parentId) : 0;
+    for(size_t i = 0; i < messages.size() && !scene_.expired(); ++i)
+        DispatchNetworkMessage(serverConnection_.get(), 0, messages[i].first, messages[i].second.constData(), (size_t)messages[i].second.size());
+    return numCreated + 1;
+}
+
 void SyncManager::HandleCreateEntity(UserConnection* source, const char* data, size_t numBytes)
 {
     assert(source);
@@ -2146,6 +3253,7 @@ void SyncManager::HandleCreateEntity(UserConnection* source, const char* data, s
     }
     
     // Mark the entity processed (undirty) in the sender's syncstate so that create is not echoed back
+    ProcessAttributeChanges();
     state->MarkEntityProcessed(entityID);
 }
 
@@ -2164,6 +3272,7 @@ void SyncManager::HandleCreateComponents(UserConnection* source, const char* dat
     bool isServer = owner_->IsServer();
     // For clients, the change type is LocalOnly. For server, the change type is Replicate, so that it will get replicated to all clients in turn
     AttributeChange::Type change = isServer ? AttributeChange::Replicate : AttributeChange::LocalOnly;
+    const StringTable* strings = ReceivedStrings(source);
     
     std::vector<std::pair<component_id_t, component_id_t> > componentIdRewrites;
     std::vector<ComponentPtr> addedComponents;
@@ -2199,7 +3308,7 @@ void SyncManager::HandleCreateComponents(UserConnection* source, const char* dat
             if (isServer) compID = 0;
             
             u32 typeID = ds.ReadVLE<kNet::VLE8_16_32>();
-            QString name = QString::fromStdString(ds.ReadString());
+            QString name = QString::fromStdString(ReadName(ds, strings));
             unsigned attrDataSize = ds.ReadVLE<kNet::VLE8_16_32>();
             ds.ReadArray<u8>((u8*)&attrDataBuffer_[0], attrDataSize);
             kNet::DataDeserializer attrDs(attrDataBuffer_, attrDataSize);
@@ -2256,7 +3365,7 @@ void SyncManager::HandleCreateComponents(UserConnection* source, const char* dat
                 {
                     u8 index = attrDs.Read<u8>();
                     u8 typeId = attrDs.Read<u8>();
-                    QString name = QString::fromStdString(attrDs.ReadString());
+                    QString name = QString::fromStdString(ReadName(attrDs, strings));
                     IAttribute* newAttr = comp->CreateAttribute(index, typeId, name, change);
                     if (!newAttr)
                     {
@@ -2323,6 +3432,8 @@ void SyncManager::HandleRemoveEntity(UserConnection* source, const char* data, s
     unsigned sceneID = ds.ReadVLE<kNet::VLE8_16_32>(); ///\todo Dummy ID. Lookup scene once multiscene is properly supported
     UNREFERENCED_PARAM(sceneID)
     entity_id_t entityID = ds.ReadVLE<kNet::VLE8_16_32>();
+    // The sender has forgotten the attribute baselines of the entity
+    state->receivedAttributeBaselines.erase(entityID);
     
     if (!ValidateAction(source, cRemoveEntityMessage, entityID))
         return;
@@ -2340,8 +3451,7 @@ void SyncManager::HandleRemoveEntity(UserConnection* source, const char* data, s
     
     scene->RemoveEntity(entityID, change);
     // Delete from the sender's syncstate so that we don't echo the delete back needlessly
-    state->RemoveFromQueue(entityID); // Be sure to erase from dirty queue so that we don't invoke UDB
-    state->entities.erase(entityID);
+    state->RemoveEntityState(entityID);
 }
 
 void SyncManager::HandleRemoveComponents(UserConnection* source, const char* data, size_t numBytes)
@@ -2379,9 +3489,13 @@ void SyncManager::HandleRemoveComponents(UserConnection* source, const char* dat
         return;
     }
     
+    std::map<entity_id_t, std::map<component_id_t, AttributeBaselines> >::iterator baselinesIt = state->receivedAttributeBaselines.find(entityID);
     while (ds.BitsLeft() >= 8)
     {
         component_id_t compID = ds.ReadVLE<kNet::VLE8_16_32>();
+        // The sender has forgotten the attribute baselines of the component
+        if (baselinesIt != state->receivedAttributeBaselines.end())
+            baselinesIt->second.erase(compID);
         ComponentPtr comp = entity->GetComponentById(compID);
         if (!comp)
         {
@@ -2390,11 +3504,9 @@ void SyncManager::HandleRemoveComponents(UserConnection* source, const char* dat
         }
         entity->RemoveComponent(comp, change);
         // Delete from the sender's syncstate, so that we don't echo the delete back needlessly
-        if (state->entities.find(entityID) != state->entities.end())
-        {
-            state->entities[entityID].RemoveFromQueue(compID); // Be sure to erase from dirty queue so that we don't invoke UDB
-            state->entities[entityID].components.erase(compID);
-        }
+        EntitySyncState *entityState = state->entities.Find(entityID);
+        if (entityState)
+            entityState->RemoveComponent(compID);
     }
 }
 
@@ -2413,6 +3525,7 @@ void SyncManager::HandleCreateAttributes(UserConnection* source, const char* dat
     bool isServer = owner_->IsServer();
     // For clients, the change type is LocalOnly. For server, the change type is Replicate, so that it will get replicated to all clients in turn
     AttributeChange::Type change = isServer ? AttributeChange::Replicate : AttributeChange::LocalOnly;
+    const StringTable* strings = ReceivedStrings(source);
     
     kNet::DataDeserializer ds(data, numBytes);
     unsigned sceneID = ds.ReadVLE<kNet::VLE8_16_32>(); ///\todo Dummy ID. Lookup scene once multiscene is properly supported
@@ -2445,7 +3558,7 @@ void SyncManager::HandleCreateAttributes(UserConnection* source, const char* dat
         
         u8 attrIndex = ds.Read<u8>();
         u8 typeId = ds.Read<u8>();
-        QString name = QString::fromStdString(ds.ReadString());
+        QString name = QString::fromStdString(ReadName(ds, strings));
         
         if (isServer)
         {
@@ -2477,17 +3590,18 @@ void SyncManager::HandleCreateAttributes(UserConnection* source, const char* dat
         }
         
         // Remove the corresponding add command from the sender's syncstate, so that the attribute add is not echoed back
-        state->entities[entityID].components[compID].newAndRemovedAttributes.erase(attrIndex);
+        state->entities[entityID].ComponentState(compID).ClearAttributeCreatedOrRemoved(attrIndex);
     }
     
     // Signal attribute changes after creating and reading all
+    for (unsigned i = 0; i < addedAttrs.size(); ++i)
+        addedAttrs[i]->Owner()->EmitAttributeChanged(addedAttrs[i], change);
+    // Mark the changes dirty now, and remove the dirty bits from sender's syncstate so that we do not echo the changes back
+    ProcessAttributeChanges();
     for (unsigned i = 0; i < addedAttrs.size(); ++i)
     {
-        IComponent* owner = addedAttrs[i]->Owner();
         u8 attrIndex = addedAttrs[i]->Index();
-        owner->EmitAttributeChanged(addedAttrs[i], change);
-        // Remove the dirty bit from sender's syncstate so that we do not echo the change back
-        state->entities[entityID].components[owner->Id()].dirtyAttributes[attrIndex >> 3] &= ~(1 << (attrIndex & 7));
+        state->entities[entityID].ComponentState(addedAttrs[i]->Owner()->Id()).dirtyAttributes[attrIndex >> 3] &= ~(1 << (attrIndex & 7));
     }
 }
 
@@ -2540,7 +3654,7 @@ void SyncManager::HandleRemoveAttributes(UserConnection* source, const char* dat
         
         comp->RemoveAttribute(attrIndex, change);
         // Remove the corresponding remove command from the sender's syncstate, so that the attribute remove is not echoed back
-        state->entities[entityID].components[compID].newAndRemovedAttributes.erase(attrIndex);
+        state->entities[entityID].ComponentState(compID).ClearAttributeCreatedOrRemoved(attrIndex);
     }
 }
 
@@ -2560,6 +3674,15 @@ void SyncManager::HandleEditAttributes(UserConnection* source, const char* data,
     // For clients, the change type is LocalOnly. For server, the change type is Replicate, so that it will get replicated to all clients in turn
     AttributeChange::Type change = isServer ? AttributeChange::Replicate : AttributeChange::LocalOnly;
     
+    // Decode the attribute deltas first, as the baselines must be updated even if the edits are not applied.
+    kNet::DataSerializer decodedDs(editAttrsBuffer_, 64 * 1024);
+    if (source->ProtocolVersion() >= ProtocolAttributeDeltas)
+    {
+        DecodeAttributeDeltas(state, data, numBytes, decodedDs);
+        data = decodedDs.GetData();
+        numBytes = decodedDs.BytesFilled();
+    }
+
     kNet::DataDeserializer ds(data, numBytes);
     unsigned sceneID = ds.ReadVLE<kNet::VLE8_16_32>(); ///\todo Dummy ID. Lookup scene once multiscene is properly supported
     UNREFERENCED_PARAM(sceneID)
@@ -2581,17 +3704,18 @@ void SyncManager::HandleEditAttributes(UserConnection* source, const char* data,
     
     // Record the update time for calculating the update interval
     float updateInterval = updatePeriod_; // Default update interval if state not found or interval not measured yet
-    std::map<entity_id_t, EntitySyncState>::iterator it = state->entities.find(entityID);
-    if (it != state->entities.end())
+    EntitySyncState *entityState = state->entities.Find(entityID);
+    if (entityState)
     {
-        it->second.RefreshAvgUpdateInterval();
-        if (it->second.avgUpdateInterval > 0.0f)
-            updateInterval = it->second.avgUpdateInterval;
+        entityState->RefreshAvgUpdateInterval();
+        if (entityState->avgUpdateInterval > 0.0f)
+            updateInterval = entityState->avgUpdateInterval;
     }
     // Add a fudge factor in case there is jitter in packet receipt or the server is too taxed
     updateInterval *= 1.25f;
 
     std::vector<IAttribute*> changedAttrs;
+    std::vector<IAttribute*> interpolatedAttrs;
     while (ds.BitsLeft() >= 8)
     {
         component_id_t compID = ds.ReadVLE<kNet::VLE8_16_32>();
@@ -2637,7 +3761,8 @@ void SyncManager::HandleEditAttributes(UserConnection* source, const char* data,
                 {
                     IAttribute* endValue = attr->Clone();
                     endValue->FromBinary(attrDs, AttributeChange::Disconnected);
-                    scene->StartAttributeInterpolation(attr, endValue, updateInterval);
+                    if (scene->StartAttributeInterpolation(attr, endValue, updateInterval))
+                        interpolatedAttrs.push_back(attr);
                 }
             }
         }
@@ -2669,7 +3794,8 @@ void SyncManager::HandleEditAttributes(UserConnection* source, const char* data,
                     {
                         IAttribute* endValue = attr->Clone();
                         endValue->FromBinary(attrDs, AttributeChange::Disconnected);
-                        scene->StartAttributeInterpolation(attr, endValue, updateInterval);
+                        if (scene->StartAttributeInterpolation(attr, endValue, updateInterval))
+                            interpolatedAttrs.push_back(attr);
                     }
                 }
             }
@@ -2677,13 +3803,70 @@ void SyncManager::HandleEditAttributes(UserConnection* source, const char* data,
     }
     
     // Signal attribute changes after reading all
+    for (unsigned i = 0; i < changedAttrs.size(); ++i)
+        changedAttrs[i]->Owner()->EmitAttributeChanged(changedAttrs[i], change);
+    // Mark the changes dirty now, and remove the dirty bits from sender's syncstate so that we do not echo the changes back
+    ProcessAttributeChanges();
     for (unsigned i = 0; i < changedAttrs.size(); ++i)
     {
-        IComponent* owner = changedAttrs[i]->Owner();
         u8 attrIndex = changedAttrs[i]->Index();
-        owner->EmitAttributeChanged(changedAttrs[i], change);
-        // Remove the dirty bit from sender's syncstate so that we do not echo the change back
-        state->entities[entityID].components[owner->Id()].dirtyAttributes[attrIndex >> 3] &= ~(1 << (attrIndex & 7));
+        state->entities[entityID].ComponentState(changedAttrs[i]->Owner()->Id()).dirtyAttributes[attrIndex >> 3] &= ~(1 << (attrIndex & 7));
+    }
+
+#ifdef _DEBUG
+    // Handling the changes, including the snapping done when starting an interpolation, must not end the interpolations just started
+    for (unsigned i = 0; i < interpolatedAttrs.size(); ++i)
+        assert(scene->IsAttributeInterpolating(interpolatedAttrs[i]));
+#endif
+}
+
+void SyncManager::DecodeAttributeDeltas(SceneSyncState* state, const char* data, size_t numBytes, kNet::DataSerializer& dest)
+{
+    kNet::DataDeserializer ds(data, numBytes);
+    dest.AddVLE<kNet::VLE8_16_32>(ds.ReadVLE<kNet::VLE8_16_32>()); // Scene ID
+    entity_id_t entityID = ds.ReadVLE<kNet::VLE8_16_32>();
+    dest.AddVLE<kNet::VLE8_16_32>(entityID);
+    std::map<component_id_t, AttributeBaselines>& entityBaselines = state->receivedAttributeBaselines[entityID];
+
+    while (ds.BitsLeft() >= 8)
+    {
+        component_id_t compID = ds.ReadVLE<kNet::VLE8_16_32>();
+        unsigned attrDataSize = ds.ReadVLE<kNet::VLE8_16_32>();
+        ds.ReadArray<u8>((u8*)&attrDataBuffer_[0], attrDataSize);
+        kNet::DataDeserializer attrDs(attrDataBuffer_, attrDataSize);
+        kNet::DataSerializer decodedAttrDs(decodedAttrDataBuffer_, 16 * 1024);
+        AttributeBaselines& baselines = entityBaselines[compID];
+
+        int indexingMethod = attrDs.Read<kNet::bit>();
+        decodedAttrDs.Add<kNet::bit>(indexingMethod);
+        if (!indexingMethod)
+        {
+            // Method 1: indices
+            u8 numChangedAttrs = attrDs.Read<u8>();
+            decodedAttrDs.Add<u8>(numChangedAttrs);
+            for (unsigned i = 0; i < numChangedAttrs; ++i)
+            {
+                u8 attrIndex = attrDs.Read<u8>();
+                decodedAttrDs.Add<u8>(attrIndex);
+                DecodeAttributeValue(attrDs, baselines, attrIndex, decodedAttrValue_, decodedAttrDs);
+            }
+        }
+        else
+        {
+            // Method 2: bitmask. The number of attributes is not known without the component, so read until the data ends;
+            // the padding bits at the end are zero, i.e. unchanged.
+            for (unsigned i = 0; attrDs.BitsLeft() > 0; ++i)
+            {
+                int changed = attrDs.Read<kNet::bit>();
+                decodedAttrDs.Add<kNet::bit>(changed);
+                if (changed)
+                    DecodeAttributeValue(attrDs, baselines, i, decodedAttrValue_, decodedAttrDs);
+            }
+        }
+
+        dest.AddVLE<kNet::VLE8_16_32>(compID);
+        dest.AddVLE<kNet::VLE8_16_32>((u32)decodedAttrDs.BytesFilled());
+        dest.AddArray<u8>((const u8*)decodedAttrDataBuffer_, (u32)decodedAttrDs.BytesFilled());
     }
 }
 
@@ -2711,10 +3894,7 @@ void SyncManager::HandleCreateEntityReply(UserConnection* source, const char* da
     entity_id_t senderEntityID = ds.ReadVLE<kNet::VLE8_16_32>() | UniqueIdGenerator::FIRST_UNACKED_ID;
     entity_id_t entityID = ds.ReadVLE<kNet::VLE8_16_32>();
     scene->ChangeEntityId(senderEntityID, entityID);
-    state->RemoveFromQueue(senderEntityID); // Make sure we don't have stale pointers in the dirty queue
-    state->entities[entityID] = state->entities[senderEntityID]; // Copy the sync state to the new ID
-    state->entities[entityID].id = entityID; // Must remember to change ID manually
-    state->entities.erase(senderEntityID);
+    state->ChangeEntityId(senderEntityID, entityID);
     
     //std::cout << "CreateEntityReply, entity " << senderEntityID << " -> " << entityID << std::endl;
     
@@ -2736,9 +3916,7 @@ void SyncManager::HandleCreateEntityReply(UserConnection* source, const char* da
         //std::cout << "CreateEntityReply, component " << senderCompID << " -> " << compID << std::endl;
         
         entity->ChangeComponentId(senderCompID, compID);
-        entityState.components[compID] = entityState.components[senderCompID]; // Copy the sync state to the new ID
-        entityState.components[compID].id = compID; // Must remember to change ID manually
-        entityState.components.erase(senderCompID);
+        entityState.ChangeComponentId(senderCompID, compID);
         
         // Send notification
         IComponent* comp = entity->GetComponentById(compID).get();
@@ -2748,10 +3926,10 @@ void SyncManager::HandleCreateEntityReply(UserConnection* source, const char* da
     // Send notification
     scene->EmitEntityAcked(entity.get(), senderEntityID);
     
-    for (std::map<component_id_t, ComponentSyncState>::iterator i = entityState.components.begin(); i != entityState.components.end(); ++i)
+    for (size_t i = 0; i < entityState.components.size(); ++i)
     {
         // Now mark every component dirty so they will be inspected for changes on the next update
-        state->MarkComponentDirty(entityID, i->first);
+        state->MarkComponentDirty(entityID, entityState.components[i].id);
     }
 }
 
@@ -2796,19 +3974,17 @@ void SyncManager::HandleCreateComponentsReply(UserConnection* source, const char
         //std::cout << "CreateComponentReply, component " << senderCompID << " -> " << compID << std::endl;
         
         entity->ChangeComponentId(senderCompID, compID);
-        entityState.components[compID] = entityState.components[senderCompID]; // Copy the sync state to the new ID
-        entityState.components[compID].id = compID; // Must remember to change ID manually
-        entityState.components.erase(senderCompID);
+        entityState.ChangeComponentId(senderCompID, compID);
         
         // Send notification
         IComponent* comp = entity->GetComponentById(compID).get();
         scene->EmitComponentAcked(comp, senderCompID);
     }
     
-    for (std::map<component_id_t, ComponentSyncState>::iterator i = entityState.components.begin(); i != entityState.components.end(); ++i)
+    for (size_t i = 0; i < entityState.components.size(); ++i)
     {
         // Now mark every component dirty so they will be inspected for changes on the next update
-        state->MarkComponentDirty(entityID, i->first);
+        state->MarkComponentDirty(entityID, entityState.components[i].id);
     }
 }
 
@@ -2865,6 +4041,61 @@ void SyncManager::HandleEntityAction(UserConnection* source, MsgEntityAction& ms
     server->SetActionSender(UserConnectionPtr()); // Clear the action sender after action handling
 }
 
+void SyncManager::ReadEntityAction(UserConnection* source, const char* data, size_t numBytes, MsgEntityAction& msg)
+{
+    kNet::DataDeserializer ds(data, numBytes);
+    const StringTable* strings = ReceivedStrings(source);
+    if (strings)
+        ReadInternedEntityAction(ds, msg, *strings);
+    else
+        msg.DeserializeFrom(ds);
+}
+
+void SyncManager::SendEntityAction(UserConnection* user, const MsgEntityAction& msg, SyncContext* ctx)
+{
+    StringTable* strings = SentStrings(user);
+    if (!strings)
+    {
+        if (ctx)
+            ctx->Send(user, msg);
+        else
+            user->Send(msg);
+        return;
+    }
+
+    // The interned encoding is at most a few bytes larger than the original
+    kNet::DataSerializer ds(msg.Size() + 8 + 4 * msg.parameters.size());
+    WriteInternedEntityAction(ds, msg, *strings);
+    SendNewStrings(user, ctx);
+    if (ctx)
+        ctx->Send(user, cEntityActionMessage, msg.reliable, msg.inOrder, ds);
+    else
+        user->Send(cEntityActionMessage, msg.reliable, msg.inOrder, ds);
+}
+
+void SyncManager::SendNewStrings(UserConnection* user, SyncContext* ctx)
+{
+    if (!user->sentStrings.HasNewStrings())
+        return;
+    kNet::DataSerializer ds(user->sentStrings.NewStringsSize());
+    user->sentStrings.WriteNewStrings(ds);
+    if (ctx)
+        ctx->Send(user, cStringTableMessage, true, true, ds);
+    else
+        user->Send(cStringTableMessage, true, true, ds);
+}
+
+void SyncManager::HandleStringTable(UserConnection* source, const char* data, size_t numBytes)
+{
+    if (source->ProtocolVersion() < ProtocolStringTable)
+    {
+        LogWarning("SyncManager: Ignoring StringTable message from a peer that does not use string interning");
+        return;
+    }
+    kNet::DataDeserializer ds(data, numBytes);
+    source->receivedStrings.ReadNewStrings(ds);
+}
+
 void SyncManager::SendObserverPosition(UserConnection *connection, SceneSyncState *senderState)
 {
     EC_Placeable *placeable = !observer_.expired() ? observer_.lock()->Component<EC_Placeable>().get() : 0;
@@ -2892,24 +4123,25 @@ void SyncManager::SendObserverPosition(UserConnection *connection, SceneSyncStat
 
             ds.AddArithmeticEncoded(8, posSendType, 3, rotSendType, 4);
 
-            WriteOptimizedPosAndRot(ds, posSendType, pos, rotSendType, rot3x3);
+            WriteOptimizedPosAndRot(dest, posSendType, pos, rotSendType, rot3x3);
 
             connection->Send(cObserverPositionMessage, false, false, ds);
         }
     }
 }
 
-void SyncManager::ComputePriorityForEntitySyncState(SceneSyncState *sceneState, EntitySyncState &entityState, Entity *entity) const
+void SyncManager::MarkPriorityInfoDirty(entity_id_t id)
 {
-    if (!sceneState)
-        return;
-    if (!sceneState->observerPos.IsFinite() || !sceneState->observerRot.IsFinite())
-        return; // camera information not received yet.
-    if (!entity)
-        entity = scene_.lock()->EntityById(entityState.id).get(); /**< @todo store weak_ptr to Entity in EntitySyncState */
-    if (!entity)
-        return; // we (might) end up here e.g. when entity was just deleted
+    EntityPriorityInfo &info = priorityInfos_[id];
+    if (!info.dirty)
+    {
+        info.dirty = true;
+        dirtyPriorityInfos_.push_back(id);
+    }
+}
 
+bool SyncManager::ComputeEntityPriorityInfo(EntityPriorityInfo &info, Entity *entity)
+{
     shared_ptr<EC_Placeable> placeable = entity->Component<EC_Placeable>();
     shared_ptr<EC_Mesh> mesh = entity->Component<EC_Mesh>();
     shared_ptr<EC_RigidBody> rigidBody = entity->Component<EC_RigidBody>();
@@ -2933,23 +4165,8 @@ void SyncManager::ComputePriorityForEntitySyncState(SceneSyncState *sceneState,
 //    shared_ptr<EC_Terrain> terrain = entity->Component<EC_Terrain>();
 //    if (terrain) { ... }
 
-    if (!placeable)
-    {
-        /// @todo Should handle special case entities with rigid body but no placeable?
-        //if (rigidBody)
-        // Non-spatial (probably), use max priority
-        /// @todo Can have f.ex. Terrain component that has its own transform, but it can use Placeable too.
-        entityState.priority = inf;
-    }
-    else if (placeable && !mesh)
-    {
-        // Spatial, but no mesh, for now use a harcoded priority of 20 (updateInterval = 1 / (priority * relevance),
-        // so will probably yield the default SyncManager's update period 1/20th of a second
-        entityState.priority = 20.f;
-        /// @todo retrieve/calculate bounding volumes of possible billboards, particle systems, lights, etc.
-        /// Not going to be easy with Ogre though, especially when running in headless mode.
-    }
-    else if (placeable && mesh)
+    float sizeSq = 0.f;
+    if (placeable && mesh)
     {
         OBB worldObb;
         if (framework_->IsHeadless())
@@ -2958,7 +4175,7 @@ void SyncManager::ComputePriorityForEntitySyncState(SceneSyncState *sceneState,
             if (!mesh->MeshAsset() && !mesh->meshRef.Get().ref.trimmed().isEmpty())
             {
                 mesh->ForceMeshLoad();
-                return; // compute the priority next time when mesh asset is available
+                return false; // compute the priority next time when mesh asset is available
             }
             // EC_Mesh::WorldOBB not usable in headless mode (no Ogre::Entity available),
             // so we must dig the bounding volume information from OgreMeshAsset (Ogre::Mesh) instead.
@@ -2966,33 +4183,184 @@ void SyncManager::ComputePriorityForEntitySyncState(SceneSyncState *sceneState,
             // between the OBB values when running as headless or not. Investigate.
             Ogre::MeshPtr ogreMesh = mesh->MeshAsset() ? mesh->MeshAsset()->ogreMesh : Ogre::MeshPtr();
             if (ogreMesh.isNull())
-                LogWarning("SyncManager::ComputePriorityForEntitySyncState: " + entity->ToString().toStdString() + " has null Ogre mesh " + mesh->GetMeshName());
+                LogWarning("SyncManager::ComputeEntityPriorityInfo: " + entity->ToString().toStdString() + " has null Ogre mesh " + mesh->GetMeshName());
             worldObb = !ogreMesh.isNull() ? AABB(ogreMesh->getBounds()) : OBB();
             worldObb.Transform(placeable->LocalToWorld());
         }
         else
+        {
+            // The mesh load completing is not signaled, so poll until the Ogre entity exists.
+            if (!mesh->OgreEntity() && !mesh->meshRef.Get().ref.trimmed().isEmpty())
+                return false;
             worldObb = mesh->WorldOBB();
-        float sizeSq = worldObb.SurfaceArea();
+        }
+        sizeSq = worldObb.SurfaceArea();
         sizeSq *= sizeSq;
-        float distanceSq = sceneState->observerPos.DistanceSq(placeable->WorldPosition());
-        entityState.priority = sizeSq/distanceSq;
-//        LogDebug(QString("%1 sizeSq %2 distanceSq %3").arg(entity->ToString()).arg(sizeSq).arg(distanceSq));
+    }
+
+    const bool hasPlaceable = placeable.get() != 0;
+    const bool hasMesh = hasPlaceable && mesh;
+    const bool hasRigidBody = rigidBody.get() != 0;
+    const float3 worldPos = hasPlaceable ? placeable->WorldPosition() : float3::zero;
+    info.parented = hasPlaceable && (!placeable->parentRef.Get().IsEmpty() || entity->Parent());
+
+    if (!info.valid || hasPlaceable != info.hasPlaceable || hasMesh != info.hasMesh || hasRigidBody != info.hasRigidBody ||
+        sizeSq != info.sizeSq || !worldPos.Equals(info.worldPos))
+    {
+        info.hasPlaceable = hasPlaceable;
+        info.hasMesh = hasMesh;
+        info.hasRigidBody = hasRigidBody;
+        info.sizeSq = sizeSq;
+        info.worldPos = worldPos;
+        info.valid = true;
+        if (++priorityInfoGeneration_ == 0)
+            ++priorityInfoGeneration_; // 0 is reserved for "never computed"
+        info.generation = priorityInfoGeneration_;
+    }
+    return true;
+}
+
+void SyncManager::UpdatePriorityInfos()
+{
+    PROFILE(SyncManager_UpdatePriorityInfos);
+
+    changedPriorityInfos_.clear();
+    ScenePtr scene = scene_.lock();
+    if (!scene)
+        return;
+
+    // Parented placeables move along with their parent without signaling it, so poll them.
+    for(std::set<entity_id_t>::const_iterator it = parentedPriorityInfos_.begin(); it != parentedPriorityInfos_.end(); ++it)
+        MarkPriorityInfoDirty(*it);
+
+    size_t numPending = 0;
+    for(size_t i = 0; i < dirtyPriorityInfos_.size(); ++i)
+    {
+        const entity_id_t id = dirtyPriorityInfos_[i];
+        EntityPriorityInfo *info = priorityInfos_.Find(id);
+        if (!info || !info->dirty)
+            continue; // Removed or already handled
+        Entity *entity = scene->EntityById(id).get();
+        if (!entity)
+        {
+            priorityInfos_.Erase(id);
+            parentedPriorityInfos_.erase(id);
+            continue;
+        }
+
+        const u32 oldGeneration = info->generation;
+        if (!ComputeEntityPriorityInfo(*info, entity))
+        {
+            dirtyPriorityInfos_[numPending++] = id; // Mesh bounds not available yet, retry on the next update.
+            continue;
+        }
+        info->dirty = false;
+        if (info->parented)
+            parentedPriorityInfos_.insert(id);
+        else
+            parentedPriorityInfos_.erase(id);
+        if (info->generation != oldGeneration)
+            changedPriorityInfos_.push_back(id);
+    }
+    dirtyPriorityInfos_.resize(numPending);
+}
+
+const EntityPriorityInfo *SyncManager::PriorityInfo(entity_id_t id, Entity *entity)
+{
+    EntityPriorityInfo *info = priorityInfos_.Find(id);
+    if (info && info->valid)
+        return info; // If dirty, the previous information is used until the next priority update.
+
+    if (!entity)
+    {
+        ScenePtr scene = scene_.lock();
+        entity = scene ? scene->EntityById(id).get() : 0;
+    }
+    if (!entity)
+        return 0; // we (might) end up here e.g. when entity was just deleted
+
+    if (!info)
+        info = &priorityInfos_[id];
+    if (!ComputeEntityPriorityInfo(*info, entity))
+    {
+        MarkPriorityInfoDirty(id);
+        return 0;
+    }
+    if (info->parented)
+        parentedPriorityInfos_.insert(id);
+    return info;
+}
+
+void SyncManager::ComputePriorityForEntitySyncState(SceneSyncState *sceneState, EntitySyncState &entityState, Entity *entity)
+{
+    if (!sceneState)
+        return;
+    if (!sceneState->observerPos.IsFinite() || !sceneState->observerRot.IsFinite())
+        return; // camera information not received yet.
+    const EntityPriorityInfo *info = PriorityInfo(entityState.id, entity);
+    if (!info)
+        return;
+
+    // Only the integer log2 of the squared distance is tracked, so the priority is recomputed when the distance to the
+    // observer changes by a factor of about 1.4, or when the entity's spatial information changes.
+    const float distanceSq = sceneState->observerPos.DistanceSq(info->worldPos);
+    const int band = info->hasMesh ? (int)Log2(distanceSq + 1.f) : 0;
+    if (entityState.priority >= 0.f && entityState.priorityGeneration == info->generation && entityState.priorityBand == band)
+        return;
+    entityState.priorityGeneration = info->generation;
+    entityState.priorityBand = band;
+
+    if (!info->hasPlaceable)
+    {
+        /// @todo Should handle special case entities with rigid body but no placeable?
+        //if (rigidBody)
+        // Non-spatial (probably), use max priority
+        /// @todo Can have f.ex. Terrain component that has its own transform, but it can use Placeable too.
+        entityState.priority = inf;
+    }
+    else if (!info->hasMesh)
+    {
+        // Spatial, but no mesh, for now use a harcoded priority of 20 (updateInterval = 1 / (priority * relevance),
+        // so will probably yield the default SyncManager's update period 1/20th of a second
+        entityState.priority = 20.f;
+        /// @todo retrieve/calculate bounding volumes of possible billboards, particle systems, lights, etc.
+        /// Not going to be easy with Ogre though, especially when running in headless mode.
+    }
+    else
+    {
+        entityState.priority = info->sizeSq / distanceSq;
     }
 
     /// @todo Take direction and velocity of rigid bodies into account
         //if (rigibBody)
     /// @todo Hardcoded relevancy of 10 for entities with RigidBody component and 1 for others for now.
     /// @todo Movement of non-physical entities is too jerky.
-    entityState.relevancy = rigidBody /*entity->Component("EC_Avatar")*/ ? 10.f : 1.f;
-    LogDebug(QString("%1 P %2 R %3 P*R %4 syncRate %5").arg(entity->ToString()).arg(
-        entityState.priority).arg(entityState.relevancy).arg(entityState.FinalPriority()).arg(entityState.ComputePrioritizedUpdateInterval(updatePeriod_)));
+    entityState.relevancy = info->hasRigidBody /*entity->Component("EC_Avatar")*/ ? 10.f : 1.f;
 }
 
-void SyncManager::ComputePrioritiesForEntitySyncStates(SceneSyncState *sceneState) const
+void SyncManager::ComputePrioritiesForEntitySyncStates(SceneSyncState *sceneState)
 {
     PROFILE(SyncManager_ComputePrioritiesForEntitySyncStates);
-    for(std::map<entity_id_t, EntitySyncState>::iterator it = sceneState->entities.begin(); it != sceneState->entities.end(); ++it)
-        ComputePriorityForEntitySyncState(sceneState, it->second, 0);
+    if (!sceneState->observerPos.IsFinite() || !sceneState->observerRot.IsFinite())
+        return; // camera information not received yet.
+
+    // Squared distance the observer must move before the distance bands of all entities are checked.
+    const float cObserverMoveThresholdSq = 0.01f;
+    if (!sceneState->priorityObserverPos.IsFinite() || sceneState->observerPos.DistanceSq(sceneState->priorityObserverPos) > cObserverMoveThresholdSq)
+    {
+        sceneState->priorityObserverPos = sceneState->observerPos;
+        for(SyncStateTable<EntitySyncState>::Iterator it = sceneState->entities.Begin(); it != sceneState->entities.End(); ++it)
+            ComputePriorityForEntitySyncState(sceneState, *it, 0);
+    }
+    else
+    {
+        for(size_t i = 0; i < changedPriorityInfos_.size(); ++i)
+        {
+            EntitySyncState *entityState = sceneState->entities.Find(changedPriorityInfos_[i]);
+            if (entityState)
+                ComputePriorityForEntitySyncState(sceneState, *entityState, 0);
+        }
+    }
 }
 
 void SyncManager::HandleObserverPosition(UserConnection* source, const char* data, size_t numBytes)
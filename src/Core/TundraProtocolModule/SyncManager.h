@@ -6,6 +6,8 @@
 #include "TundraProtocolModuleApi.h"
 
 #include "SyncState.h"
+#include "SyncContext.h"
+#include "AttributeEncodingCache.h"
 #include "SceneFwd.h"
 #include "AttributeChangeType.h"
 #include "EntityAction.h"
@@ -14,11 +16,17 @@
 #include <kNet/Types.h>
 
 #include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QByteArray>
 
 class Framework;
+class QThreadPool;
 
 namespace TundraLogic
 {
+class StringTable;
+
 /// Performs synchronization of the changes in a scene between the server and the client.
 /** @todo Interest management functionality description.
 
@@ -31,6 +39,17 @@ class TUNDRAPROTOCOL_MODULE_API SyncManager : public QObject
     Q_PROPERTY(bool interestManagementEnabled READ IsInterestManagementEnabled WRITE SetInterestManagementEnabled) /**< @copydoc interestManagementEnabled */
     Q_PROPERTY(EntityPtr observer READ Observer WRITE SetObserver) /**< @copydoc observer */
     Q_PROPERTY(float priorityUpdatePeriod READ PriorityUpdatePeriod WRITE SetPriorityUpdatePeriod) /**< @copydoc priorityUpdatePeriod_ */
+    Q_PROPERTY(int syncByteBudget READ SyncByteBudget WRITE SetSyncByteBudget) /**< @copydoc syncByteBudget_ */
+    Q_PROPERTY(float maxStarvationTime READ MaxStarvationTime WRITE SetMaxStarvationTime) /**< @copydoc maxStarvationTime_ */
+    Q_PROPERTY(bool parallelSyncEnabled READ IsParallelSyncEnabled WRITE SetParallelSyncEnabled) /**< @copydoc parallelSyncEnabled_ */
+    Q_PROPERTY(int syncThreadCount READ SyncThreadCount WRITE SetSyncThreadCount) /**< @copydoc syncThreadCount_ */
+    Q_PROPERTY(bool adaptiveUpdateRateEnabled READ IsAdaptiveUpdateRateEnabled WRITE SetAdaptiveUpdateRateEnabled) /**< @copydoc adaptiveUpdateRateEnabled_ */
+    Q_PROPERTY(float minAdaptiveUpdatePeriod READ MinAdaptiveUpdatePeriod WRITE SetMinAdaptiveUpdatePeriod) /**< @copydoc minAdaptiveUpdatePeriod_ */
+    Q_PROPERTY(float maxAdaptiveUpdatePeriod READ MaxAdaptiveUpdatePeriod WRITE SetMaxAdaptiveUpdatePeriod) /**< @copydoc maxAdaptiveUpdatePeriod_ */
+    Q_PROPERTY(float createTimeBudget READ CreateTimeBudget WRITE SetCreateTimeBudget) /**< @copydoc createTimeBudget_ */
+    Q_PROPERTY(int numQueuedEntities READ NumQueuedEntities) /**< @copydoc queuedEntities_ */
+    Q_PROPERTY(float predictionSmoothingTime READ PredictionSmoothingTime WRITE SetPredictionSmoothingTime) /**< @copydoc predictionSmoothingTime_ */
+    Q_PROPERTY(float predictionSnapDistance READ PredictionSnapDistance WRITE SetPredictionSnapDistance) /**< @copydoc predictionSnapDistance_ */
 
 public:
     explicit SyncManager(TundraLogicModule* owner);
@@ -46,7 +65,7 @@ public:
     void NewUserConnected(const UserConnectionPtr &user);
 
     /// Enables or disables the interest management. @remark Interest management
-    void SetInterestManagementEnabled(bool enabled) { interestManagementEnabled_ = enabled; }
+    void SetInterestManagementEnabled(bool enabled);
     /// Returns is the interest management enabled. @remark Interest management
     bool IsInterestManagementEnabled() const { return interestManagementEnabled_; }
 
@@ -61,6 +80,64 @@ public:
     /// Returns priority update period. @copydoc priorityUpdatePeriod_ @remark Interest management
     float PriorityUpdatePeriod() const { return priorityUpdatePeriod_; }
 
+    /// Sets the per-connection byte budget of a sync update, 0 for unlimited. @copydoc syncByteBudget_
+    void SetSyncByteBudget(int bytes) { syncByteBudget_ = std::max(bytes, 0); }
+    /// Returns the per-connection byte budget of a sync update. @copydoc syncByteBudget_
+    int SyncByteBudget() const { return syncByteBudget_; }
+
+    /// Sets the maximum time in seconds a dirty entity can be deferred, 0 for no limit. @copydoc maxStarvationTime_
+    void SetMaxStarvationTime(float seconds) { maxStarvationTime_ = std::max(seconds, 0.f); }
+    /// Returns the maximum time in seconds a dirty entity can be deferred. @copydoc maxStarvationTime_
+    float MaxStarvationTime() const { return maxStarvationTime_; }
+
+    /// Sets the dead reckoning error threshold of rigid body replication in world units, 0 to disable. @copydoc rigidBodyErrorThreshold_
+    void SetRigidBodyErrorThreshold(float threshold) { rigidBodyErrorThreshold_ = std::max(threshold, 0.f); }
+    /// Returns the dead reckoning error threshold of rigid body replication. @copydoc rigidBodyErrorThreshold_
+    float RigidBodyErrorThreshold() const { return rigidBodyErrorThreshold_; }
+
+    /// Enables or disables processing the user connections' sync states in parallel worker threads (server only).
+    void SetParallelSyncEnabled(bool enabled) { parallelSyncEnabled_ = enabled; }
+    /// Returns whether the user connections' sync states are processed in parallel worker threads.
+    bool IsParallelSyncEnabled() const { return parallelSyncEnabled_; }
+
+    /// Sets the number of worker threads used for parallel sync. Values < 1 use QThread::idealThreadCount().
+    void SetSyncThreadCount(int count);
+    /// Returns the number of worker threads used for parallel sync.
+    int SyncThreadCount() const { return syncThreadCount_; }
+
+    /// Enables or disables adapting the update periods of the user connections to their link statistics (server only). @copydoc adaptiveUpdateRateEnabled_
+    void SetAdaptiveUpdateRateEnabled(bool enabled) { adaptiveUpdateRateEnabled_ = enabled; }
+    /// Returns whether the update periods of the user connections are adapted to their link statistics.
+    bool IsAdaptiveUpdateRateEnabled() const { return adaptiveUpdateRateEnabled_; }
+
+    /// Sets the shortest update period of the adaptive update rate in seconds, 0.01 at fastest. @copydoc minAdaptiveUpdatePeriod_
+    void SetMinAdaptiveUpdatePeriod(float period) { minAdaptiveUpdatePeriod_ = Clamp(period, 0.01f, maxAdaptiveUpdatePeriod_); }
+    /// Returns the shortest update period of the adaptive update rate in seconds.
+    float MinAdaptiveUpdatePeriod() const { return minAdaptiveUpdatePeriod_; }
+
+    /// Sets the longest update period of the adaptive update rate in seconds. @copydoc maxAdaptiveUpdatePeriod_
+    void SetMaxAdaptiveUpdatePeriod(float period) { maxAdaptiveUpdatePeriod_ = std::max(period, minAdaptiveUpdatePeriod_); }
+    /// Returns the longest update period of the adaptive update rate in seconds.
+    float MaxAdaptiveUpdatePeriod() const { return maxAdaptiveUpdatePeriod_; }
+
+    /// Sets the per-frame time budget in milliseconds for creating the entities received from the server, 0 to create them immediately (client only). @copydoc createTimeBudget_
+    void SetCreateTimeBudget(float milliseconds) { createTimeBudget_ = std::max(milliseconds, 0.f); }
+    /// Returns the per-frame time budget in milliseconds for creating the entities received from the server.
+    float CreateTimeBudget() const { return createTimeBudget_; }
+
+    /// Returns the number of entities received from the server that are waiting to be created (client only).
+    int NumQueuedEntities() const { return (int)queuedEntities_.size(); }
+
+    /// Sets the time in seconds over which the server corrections of predicted entities are smoothed out. @copydoc predictionSmoothingTime_
+    void SetPredictionSmoothingTime(float seconds) { predictionSmoothingTime_ = std::max(seconds, 0.f); }
+    /// Returns the time in seconds over which the server corrections of predicted entities are smoothed out.
+    float PredictionSmoothingTime() const { return predictionSmoothingTime_; }
+
+    /// Sets the distance above which a predicted entity is moved to the corrected position at once. @copydoc predictionSnapDistance_
+    void SetPredictionSnapDistance(float distance) { predictionSnapDistance_ = std::max(distance, 0.f); }
+    /// Returns the distance above which a predicted entity is moved to the corrected position at once.
+    float PredictionSnapDistance() const { return predictionSnapDistance_; }
+
 public slots:
     /// Set update period (seconds), 0.01 at fastest.
     void SetUpdatePeriod(float period);
@@ -68,6 +145,13 @@ public slots:
     /// Get update period
     float GetUpdatePeriod() const { return updatePeriod_; }
 
+    /// Enables or disables client-side prediction of an entity the client controls (client only).
+    /** A predicted entity is moved locally, by the client physics or scripts, instead of interpolating it towards the states received
+        from the server. The server states are used only to correct the prediction. @sa RigidBodyPredictionState */
+    void SetEntityPredicted(entity_id_t id, bool enabled);
+    /// Returns whether the entity is predicted by the client.
+    bool IsEntityPredicted(entity_id_t id) const;
+
     // DEPRECATED
     SceneSyncState* SceneState(u32 connectionId) const;/**< @deprecated Use UserConnection::syncState property from script @note This slot is only usable when running as server, otherwise will return null ptr. */
     SceneSyncState* SceneState(const UserConnectionPtr &connection) const; /**< @deprecated Use UserConnection::syncState property from script @overload*/
@@ -77,14 +161,17 @@ signals:
     /// @note See signals of the SceneSyncState object to build prioritization logic how the sync state is filled.
     /// @remark Enables a 'pending' logic in SyncManager, with which a script can throttle the sending of entities to clients.
     void SceneStateCreated(UserConnection *user, SceneSyncState *state);
+
+    /// This signal is emitted on each frame in which queued entities received from the server were created (client only).
+    /** @param numCreated Number of entities created on this frame.
+        @param numRemaining Number of entities still waiting to be created.
+        @sa SetCreateTimeBudget */
+    void QueuedEntitiesCreated(int numCreated, int numRemaining);
     
 private slots:
     /// Network message received from an user connection
     void HandleNetworkMessage(UserConnection* user, kNet::packet_id_t packetId, kNet::message_id_t messageId, const char* data, size_t numBytes);
 
-    /// Trigger EC sync because of component attributes changing
-    void OnAttributeChanged(IComponent* comp, IAttribute* attr, AttributeChange::Type change);
-
     /// Trigger EC sync because of component attribute added
     void OnAttributeAdded(IComponent* comp, IAttribute* attr, AttributeChange::Type change);
 
@@ -119,18 +206,69 @@ private slots:
     void OnPlaceholderComponentTypeRegistered(u32 typeId, const QString& typeName, AttributeChange::Type change);
 
 private:
+    friend class SyncWorkerTask;
+
+    /// Handles the attribute changes recorded in the attribute change journal of the scene since the last call.
+    /** Called every frame, and by the message handlers that need the changes marked dirty right away. */
+    void ProcessAttributeChanges();
+    /// Trigger EC sync because of component attributes changing
+    void OnAttributeChanged(IComponent* comp, IAttribute* attr, AttributeChange::Type change);
+
     /// Craft a component full update, with all static and dynamic attributes.
-    void WriteComponentFullUpdate(kNet::DataSerializer& ds, ComponentPtr comp);
+    /** @param strings Table to intern the component and attribute names with, or null to write them in full. */
+    void WriteComponentFullUpdate(SyncContext& ctx, kNet::DataSerializer& ds, ComponentPtr comp, StringTable* strings = 0);
+    /// Craft an entity full update, i.e. the contents of the create entity message.
+    void WriteEntityFullUpdate(SyncContext& ctx, kNet::DataSerializer& ds, Entity* entity, bool writeParent);
+    /// Sends the registered placeholder component types to the user, if not sent yet.
+    void SendPlaceholderComponentTypes(SyncContext& ctx, UserConnection* user);
+    /// Marks all replicated entities of the scene dirty in the user's sync state, so that they will be sent one by one.
+    void MarkSceneDirty(UserConnection* user);
+    /// Sends the initial scene to a just connected user as the scene snapshot, or queues the entities to be sent one by one if the snapshot can not be used (server only).
+    void SendSceneSnapshot(UserConnection* user);
+    /// Returns the compressed scene snapshot, updating it first if the scene has changed (server only).
+    const QByteArray& SceneSnapshot();
+    /// Marks an entity to be reserialized in the scene snapshot.
+    void InvalidateSnapshotEntity(entity_id_t id);
+    /// Forgets the scene snapshot and stops tracking the changes until the next time it is needed.
+    void ClearSceneSnapshot();
     /// Handle entity action message.
     void HandleEntityAction(UserConnection* source, MsgEntityAction& msg);
+    /// Reads an entity action message, in the format of the protocol version of the user.
+    void ReadEntityAction(UserConnection* source, const char* data, size_t numBytes, MsgEntityAction& msg);
+    /// Sends an entity action message to the user, through the sync context if one is given.
+    void SendEntityAction(UserConnection* user, const MsgEntityAction& msg, SyncContext* ctx = 0);
+    /// Announces the strings newly interned for the user in a string table message, through the sync context if one is given.
+    /** Must be called before sending a message that may have interned new strings. */
+    void SendNewStrings(UserConnection* user, SyncContext* ctx = 0);
+    /// Handle string table message.
+    void HandleStringTable(UserConnection* source, const char* data, size_t numBytes);
     /// Handle create entity message.
     void HandleCreateEntity(UserConnection* source, const char* data, size_t numBytes);
     /// Handle create components message.
     void HandleCreateComponents(UserConnection* source, const char* data, size_t numBytes);
     /// Handle create attributes message.
     void HandleCreateAttributes(UserConnection* source, const char* data, size_t numBytes);
+    /// Calls the handler of a scene sync message.
+    void DispatchNetworkMessage(UserConnection* user, kNet::packet_id_t packetId, kNet::message_id_t messageId, const char* data, size_t numBytes);
+    /// Handle batched scene message, by dispatching each of the contained messages in order.
+    void HandleBatchedSceneMessage(UserConnection* user, kNet::packet_id_t packetId, const char* data, size_t numBytes);
+    /// Handle scene snapshot message.
+    void HandleSceneSnapshot(UserConnection* source, const char* data, size_t numBytes);
+    /// Queues a create entity message, or a message that refers to an entity that is waiting to be created (client only).
+    /** @return True if the message was queued or is obsolete, false if it should be handled now. @sa createTimeBudget_ */
+    bool QueueEntityMessage(UserConnection* source, kNet::message_id_t messageId, const char* data, size_t numBytes);
+    /// Creates queued entities until the time budget of the frame is used, nearest to the observer first (client only).
+    void CreateQueuedEntities();
+    /// Handles the queued messages of an entity, after creating its queued parent entity first. Returns the number of entities created.
+    int CreateQueuedEntity(entity_id_t id);
+    /// Smooths out the corrections of the predicted entities and records their predicted positions (client only).
+    void PredictRigidBodies(f64 frametime, SceneSyncState* state);
+    /// Corrects the prediction of an entity with the position received from the server (client only).
+    void ReconcilePrediction(RigidBodyPredictionState& prediction, const float3& serverPos);
     /// Handle edit attributes message.
     void HandleEditAttributes(UserConnection* source, const char* data, size_t numBytes);
+    /// Converts a delta-encoded edit attributes message to the original format, updating the attribute baselines of the sync state.
+    void DecodeAttributeDeltas(SceneSyncState* state, const char* data, size_t numBytes, kNet::DataSerializer& dest);
     /// Handle remove attributes message.
     void HandleRemoveAttributes(UserConnection* source, const char* data, size_t numBytes);
     /// Handle remove components message.
@@ -150,18 +288,34 @@ private:
 
     void HandleRigidBodyChanges(UserConnection* source, kNet::packet_id_t packetId, const char* data, size_t numBytes);
     
-    void ReplicateRigidBodyChanges(UserConnection* user);
+    void ReplicateRigidBodyChanges(SyncContext& ctx, UserConnection* user);
 
     void InterpolateRigidBodies(f64 frametime, SceneSyncState* state);
 
-    void ReplicateComponentType(u32 typeId, UserConnection* connection = 0);
+    void ReplicateComponentType(u32 typeId, UserConnection* connection = 0, SyncContext* ctx = 0);
+    /// Sends a component type registration message to the user, through the sync context if one is given.
+    void SendComponentType(const ComponentDesc& desc, UserConnection* user, SyncContext* ctx = 0);
 
     /// Read client extrapolation time parameter from command line and match it to the current sync period.
     void GetClientExtrapolationTime();
 
     /// Process one user connection's sync state for changes in the scene. Note that on the client the server is a "virtual" user
-    /** @param user User connection to process */
-    void ProcessSyncState(UserConnection* user);
+    /** @param ctx Context providing the scratch buffers and the message sink
+        @param user User connection to process */
+    void ProcessSyncState(SyncContext& ctx, UserConnection* user);
+
+    /// Adjusts the update period of the user connection from its link statistics. @sa adaptiveUpdateRateEnabled_
+    void AdaptUpdatePeriod(UserConnection* user);
+    /// Processes and sends the changes of one dirty entity in the user's sync state.
+    /** @return The entity following it in the dirty queue, i.e. the next one to process when processing the queue in order. */
+    EntitySyncState* ProcessEntitySyncState(SyncContext& ctx, UserConnection* user, Scene* scene, EntitySyncState* entityState);
+
+    /// Replicates the rigid body changes and processes the sync state of an user connection (server only).
+    /** Called either from the main thread or from a sync worker thread. In the latter case the scene must not be modified meanwhile. */
+    void SyncUser(SyncContext& ctx, UserConnection* user);
+
+    /// Processes the given user connections in the sync worker threads, waits for them to finish, and sends out the produced messages.
+    void SyncUsersParallel(const std::vector<UserConnection*>& users);
     
     /// Validate the scene manipulation action. If returns false, it is ignored
     /** @param source Where the action came from
@@ -177,9 +331,22 @@ private:
     void SendObserverPosition(UserConnection* connection, SceneSyncState *senderState);
     /// (Re)computes priority for entity. @remark Interest management
     /** @param entity Entity pointer, if available, otherwise retrieved from Scene by ID. */
-    void ComputePriorityForEntitySyncState(SceneSyncState *sceneState, EntitySyncState &entityState, Entity *entity) const;
-    /// (Re)computes priorities for all entities in the scene. @remark Interest management
-    void ComputePrioritiesForEntitySyncStates(SceneSyncState *sceneState) const;
+    void ComputePriorityForEntitySyncState(SceneSyncState *sceneState, EntitySyncState &entityState, Entity *entity);
+    /// Recomputes the priorities of a user's entities whose spatial information or distance band to the observer has changed. @remark Interest management
+    /** If the observer has not moved since the last call, only the entities in changedPriorityInfos_ are visited. */
+    void ComputePrioritiesForEntitySyncStates(SceneSyncState *sceneState);
+    /// Returns the up-to-date priority information of an entity, computing it if necessary. @remark Interest management
+    /** @param entity Entity pointer, if available, otherwise retrieved from Scene by ID.
+        @return Null if the entity does not exist or its information cannot be computed yet. */
+    const EntityPriorityInfo *PriorityInfo(entity_id_t id, Entity *entity);
+    /// Computes the spatial information of an entity. Returns false if the mesh bounds are not available yet. @remark Interest management
+    bool ComputeEntityPriorityInfo(EntityPriorityInfo &info, Entity *entity);
+    /// Queues the entity's priority information for recomputation on the next priority update. @remark Interest management
+    void MarkPriorityInfoDirty(entity_id_t id);
+    /// Recomputes the dirty and parented entities' priority information, and collects the changed ones to changedPriorityInfos_. @remark Interest management
+    void UpdatePriorityInfos();
+    /// Forgets all entity priority information. @remark Interest management
+    void ClearPriorityInfos();
 
     /// Owning module
     TundraLogicModule* owner_;
@@ -194,6 +361,8 @@ private:
     float updatePeriod_;
     /// Time accumulator for update
     float updateAcc_;
+    /// Time of the latest network update tick.
+    kNet::tick_t lastUpdateTime_;
     
     /// Physics client interpolation/extrapolation period length as number of network update intervals (default 3)
     float maxLinExtrapTime_;
@@ -203,16 +372,18 @@ private:
     /// "User" representing the server connection (client only)
     UserConnectionPtr serverConnection_;
     
-    /// Fixed buffers for crafting messages
+    /// Fixed buffers for crafting reply messages and reading incoming attribute data
     char createEntityBuffer_[64 * 1024];
-    char createCompsBuffer_[64 * 1024];
-    char editAttrsBuffer_[64 * 1024];
-    char createAttrsBuffer_[16 * 1024];
     char attrDataBuffer_[16 * 1024];
-    char removeCompsBuffer_[1024];
-    char removeEntityBuffer_[1024];
-    char removeAttrsBuffer_[1024];
-    std::vector<u8> changedAttributes_;
+    /// Fixed buffers for decoding delta-encoded edit attributes messages
+    char editAttrsBuffer_[64 * 1024];
+    char decodedAttrDataBuffer_[16 * 1024];
+    std::vector<u8> decodedAttrValue_;
+
+    /// Buffers and message sink for sync state processing on the main thread
+    SyncContext syncContext_;
+    /// Attribute encodings shared by all user connections during a sync tick.
+    AttributeEncodingCache encodingCache_;
 
     /// The sender of a component type. Used to avoid sending component description back to sender
     UserConnection* componentTypeSender_;
@@ -233,6 +404,92 @@ private:
     /// If interestManagementEnabled_ is true, on client this entity's position information is sent to the server.
     /** @remark Interest management */
     EntityWeakPtr observer_;
+
+    /// Spatial information of the entities, shared by all user connections (server only). @remark Interest management
+    SyncStateTable<EntityPriorityInfo> priorityInfos_;
+    /// Entities whose priority information needs to be recomputed. @remark Interest management
+    std::vector<entity_id_t> dirtyPriorityInfos_;
+    /// Entities with a parented placeable, whose world position is polled on each priority update. @remark Interest management
+    std::set<entity_id_t> parentedPriorityInfos_;
+    /// Entities whose priority information changed on the latest priority update. @remark Interest management
+    std::vector<entity_id_t> changedPriorityInfos_;
+    /// Generation counter for EntityPriorityInfo. @remark Interest management
+    u32 priorityInfoGeneration_;
+
+    /// Serialized create entity messages of the scene snapshot, by entity ID (server only).
+    QHash<entity_id_t, QByteArray> snapshotEntities_;
+    /// Entities to reserialize before the next use of the scene snapshot.
+    QSet<entity_id_t> dirtySnapshotEntities_;
+    /// The compressed scene snapshot, null if it needs to be rebuilt.
+    QByteArray snapshotData_;
+    /// Are the scene changes tracked for the scene snapshot. Enabled when the snapshot is first needed.
+    bool snapshotTracking_;
+
+    /// Maximum number of bytes sent to a user connection by the scene sync per update, 0 for unlimited (server only).
+    /** When the budget is set or interest management is enabled, the dirty entities are sent highest score first, where the score is
+        the entity's priority multiplied by how long it has waited relative to its prioritized update interval. Entities that do
+        not fit in the budget roll over to the next update. Set with the --syncByteBudget command line parameter. */
+    int syncByteBudget_;
+    /// Dirty entities that have waited this many seconds are sent regardless of the byte budget, 0 for no limit (server only).
+    /** Set with the --syncMaxStarvationTime command line parameter. Default 2 seconds. */
+    float maxStarvationTime_;
+    /// Dead reckoning error threshold of rigid body replication in world units, 0 if dead reckoning is disabled (server only).
+    /** When enabled, a moving entity's position is sent only when the client's extrapolation of the last sent position and velocity
+        has drifted further than this from the actual position, or at least once per second while the entity keeps changing.
+        With interest management, entities that are updated less often tolerate a proportionally larger error, up to 10 times
+        the threshold. Set with the --rigidBodyErrorThreshold command line parameter. */
+    float rigidBodyErrorThreshold_;
+
+    /// Are the user connections' sync states processed in parallel worker threads (server only).
+    /** While the workers run, the main thread waits and the scene is not modified. Only the sending of the produced
+        messages happens afterwards on the main thread. Enabled with the --parallelSync command line parameter. */
+    bool parallelSyncEnabled_;
+    /// Number of sync worker threads, set with the --syncThreads command line parameter. Defaults to QThread::idealThreadCount().
+    int syncThreadCount_;
+    /// Thread pool for the sync workers, created on first use.
+    QThreadPool* syncThreadPool_;
+    /// Per-worker contexts. Reused between updates to avoid reallocating the buffers.
+    std::vector<shared_ptr<SyncContext> > workerContexts_;
+
+    /// Are the update periods of the user connections adapted to their link statistics (server only).
+    /** The network update tick then runs at minAdaptiveUpdatePeriod_, and each user connection is updated at its own period,
+        SceneSyncState::updatePeriod. The period follows a quarter of the connection's round trip time, lengthened on lossy links,
+        and backs off while the outbound queue of the connection is congested, so that the changes are sent less often in
+        larger batches. Enabled with the --adaptiveNetrate command line parameter. */
+    bool adaptiveUpdateRateEnabled_;
+    /// Shortest update period of the adaptive update rate in seconds, default 1/60. Set with the --adaptiveNetrate command line parameter.
+    float minAdaptiveUpdatePeriod_;
+    /// Longest update period of the adaptive update rate in seconds, default 1/4.
+    float maxAdaptiveUpdatePeriod_;
+
+    /// Per-frame time budget in milliseconds for creating the entities received from the server, 0 to create them immediately (client only).
+    /** When set, the create entity messages and the later messages that refer to the entities are queued, and the entities are created
+        on the following frames, nearest to the observer first, or in the order they were received if there is no observer. This keeps
+        the client responsive while joining a large scene. An entity action or a rigid body update creates its target entity
+        right away. Set with the --createTimeBudget command line parameter. */
+    float createTimeBudget_;
+    /// Entity received from the server, waiting to be created (client only).
+    struct QueuedEntity
+    {
+        QueuedEntity() : parentId(0), order(0), hasPosition(false) {}
+
+        entity_id_t parentId; ///< Parent entity ID, 0 if none.
+        u32 order; ///< Order in which the entity was received.
+        bool hasPosition; ///< Does the entity have a placeable.
+        float3 position; ///< Position of the entity's placeable, relative to its parent.
+        std::vector<std::pair<kNet::message_id_t, QByteArray> > messages; ///< The create entity message and the later messages that refer to the entity.
+    };
+    /// Entities waiting to be created, by entity ID (client only). @sa createTimeBudget_
+    std::map<entity_id_t, QueuedEntity> queuedEntities_;
+    /// Receive order counter of the queued entities.
+    u32 queuedEntityOrder_;
+    /// Heap of the queued entities by distance or receive order, reused between frames.
+    std::vector<std::pair<float, entity_id_t> > queuedEntityHeap_;
+
+    /// Time in seconds over which the server corrections of predicted entities are smoothed out, default 0.1 (client only).
+    float predictionSmoothingTime_;
+    /// Corrections of predicted entities larger than this distance are applied at once, 0 to always smooth them out. Default 4 (client only).
+    float predictionSnapDistance_;
 };
 
 }
@@ -10,6 +10,8 @@
 
 #include "LoggingFunctions.h"
 
+#include <kNet/Clock.h>
+
 /// @remark Enables a 'pending' logic in SyncManager, with which a script can throttle the sending of entities to clients.
 typedef std::vector<entity_id_t> EntityIdList;
 typedef EntityIdList::const_iterator PendingConstIter;
@@ -24,7 +26,11 @@ SceneSyncState::SceneSyncState(u32 userConnectionID, bool isServer) :
     isServer_(isServer),
     placeholderComponentsSent_(false),
     observerPos(float3::nan),
-    observerRot(float3::nan)
+    observerRot(float3::nan),
+    priorityObserverPos(float3::nan),
+    updatePeriod(0.f),
+    updateAcc(0.f),
+    sceneSnapshotPending(false)
 {
 }
 
@@ -84,8 +90,7 @@ void SceneSyncState::MarkEntityPending(entity_id_t id)
 
     // If user does not have the entity in the first place, do nothing.
     // Its going to be asked to be added to the state via the permission signals later.
-    std::map<entity_id_t, EntitySyncState>::iterator i = entities.find(id);
-    if (i == entities.end())
+    if (!entities.Find(id))
         return;
 
     MarkEntityRemoved(id);  // Remove from current sync state (removes entity from client)
@@ -136,53 +141,68 @@ void SceneSyncState::SetParentScene(SceneWeakPtr scene)
 
 void SceneSyncState::Clear()
 {
-    dirtyQueue.clear();
-    entities.clear();
+    dirtyQueue.Clear();
+    entities.Clear();
     pendingEntities_.clear();
     changeRequest_.Reset();
     scene_.reset();
     placeholderComponentsSent_ = false;
+    receivedAttributeBaselines.clear();
+    pendingRigidBodies.clear();
+    deferredEntities.clear();
+    entityPredictions.clear();
+}
+
+bool SceneSyncState::HasEntityFilter() const
+{
+    return receivers(SIGNAL(AboutToDirtyEntity(StateChangeRequest*))) > 0;
 }
 
 void SceneSyncState::RemoveFromQueue(entity_id_t id)
 {
-    std::map<entity_id_t, EntitySyncState>::iterator i = entities.find(id);
-    if (i != entities.end())
+    EntitySyncState *entityState = entities.Find(id);
+    if (entityState && entityState->isInQueue)
     {
-        if (i->second.isInQueue)
-        {
-            for (std::list<EntitySyncState*>::iterator j = dirtyQueue.begin(); j != dirtyQueue.end(); ++j)
-            {
-                if ((*j) == &i->second)
-                {
-                    dirtyQueue.erase(j);
-                    break;
-                }
-            }
-            i->second.isInQueue = false;
-            for (std::map<component_id_t, ComponentSyncState>::iterator j = i->second.components.begin(); j != i->second.components.end(); ++j)
-                j->second.isInQueue = false;
-            i->second.dirtyQueue.clear();
-        }
+        dirtyQueue.Remove(entityState);
+        entityState->ClearComponentQueue();
+    }
+}
+
+void SceneSyncState::RemoveEntityState(entity_id_t id)
+{
+    EntitySyncState *entityState = entities.Find(id);
+    if (entityState)
+    {
+        dirtyQueue.Remove(entityState);
+        entities.Erase(id);
     }
 }
 
+void SceneSyncState::ChangeEntityId(entity_id_t oldId, entity_id_t newId)
+{
+    if (oldId == newId)
+        return;
+    RemoveFromQueue(oldId);
+    RemoveEntityState(newId);
+    EntitySyncState &oldState = entities[oldId];
+    EntitySyncState &newState = entities[newId];
+    newState = oldState; // Copy the sync state to the new ID. Both states are out of the dirty queue, so no links are copied.
+    newState.id = newId;
+    entities.Erase(oldId);
+    if (newState.deferredSyncTime)
+        deferredEntities.push_back(newId);
+}
+
 void SceneSyncState::MarkEntityProcessed(entity_id_t id)
 {
     EntitySyncState& entityState = entities[id];
-    if (!entityState.id)
-        entityState.id = id;
     entityState.DirtyProcessed();
 }
 
 void SceneSyncState::MarkComponentProcessed(entity_id_t id, component_id_t compId)
 {
     EntitySyncState& entityState = entities[id];
-    if (!entityState.id)
-        entityState.id = id;
-    ComponentSyncState& compState = entityState.components[compId];
-    if (!compState.id)
-        compState.id = compId;
+    ComponentSyncState& compState = entityState.ComponentState(compId);
     compState.DirtyProcessed();
 }
 
@@ -196,13 +216,7 @@ void SceneSyncState::MarkEntityDirty(entity_id_t id, bool hasPropertyChanges, bo
         return;
 
     EntitySyncState& entityState = entities[id]; // Creates new if did not exist
-    if (!entityState.id)
-        entityState.id = id;
-    if (!entityState.isInQueue)
-    {
-        dirtyQueue.push_back(&entityState);
-        entityState.isInQueue = true;
-    }
+    dirtyQueue.PushBack(&entityState);
     if (hasPropertyChanges)
         entityState.hasPropertyChanges = true;
     if (hasParentChange)
@@ -216,23 +230,18 @@ void SceneSyncState::MarkEntityRemoved(entity_id_t id)
         RemovePendingEntity(id);
 
     // If user did not have the entity in the first place, do nothing
-    std::map<entity_id_t, EntitySyncState>::iterator i = entities.find(id);
-    if (i == entities.end())
+    EntitySyncState *entityState = entities.Find(id);
+    if (!entityState)
         return;
     // If entity is marked new, it was not sent yet and can be simply removed from the sync state
-    if (i->second.isNew)
+    if (entityState->isNew)
     {
-        RemoveFromQueue(id);
-        entities.erase(id);
+        RemoveEntityState(id);
         return;
     }
     // Else mark as removed and queue the update
-    i->second.removed = true;
-    if (!i->second.isInQueue)
-    {
-        dirtyQueue.push_back(&i->second);
-        i->second.isInQueue = true;
-    }
+    entityState->removed = true;
+    dirtyQueue.PushBack(entityState);
 }
 
 void SceneSyncState::MarkComponentDirty(entity_id_t id, component_id_t compId)
@@ -242,27 +251,34 @@ void SceneSyncState::MarkComponentDirty(entity_id_t id, component_id_t compId)
 
     MarkEntityDirty(id);
     EntitySyncState& entityState = entities[id]; // Creates new if did not exist
-    if (!entityState.id)
-        entityState.id = id;
     entityState.MarkComponentDirty(compId);
 }
 
 void SceneSyncState::MarkComponentRemoved(entity_id_t id, component_id_t compId)
 {
     // If user did not have the entity or component in the first place, do nothing
-    std::map<entity_id_t, EntitySyncState>::iterator i = entities.find(id);
-    if (i == entities.end())
+    EntitySyncState *entityState = entities.Find(id);
+    if (!entityState)
         return;
     MarkEntityDirty(id);
-    i->second.MarkComponentRemoved(compId);
+    entityState->MarkComponentRemoved(compId);
 }
 
 void SceneSyncState::MarkAttributeDirty(entity_id_t id, component_id_t compId, u8 attrIndex)
 {
+    // If changes of the attribute are already held back by its rate limit, the new value is sent when the interval expires
+    EntitySyncState *deferredState = entities.Find(id);
+    if (deferredState && deferredState->deferredSyncTime)
+    {
+        ComponentSyncState *compState = deferredState->FindComponent(compId);
+        if (compState && compState->IsAttributeDeferred(attrIndex))
+            return;
+    }
+
     MarkEntityDirty(id);
     EntitySyncState& entityState = entities[id];
     entityState.MarkComponentDirty(compId);
-    ComponentSyncState& compState = entityState.components[compId];
+    ComponentSyncState& compState = entityState.ComponentState(compId);
     compState.MarkAttributeDirty(attrIndex);
 }
 
@@ -271,7 +287,7 @@ void SceneSyncState::MarkAttributeCreated(entity_id_t id, component_id_t compId,
     MarkEntityDirty(id);
     EntitySyncState& entityState = entities[id];
     entityState.MarkComponentDirty(compId);
-    ComponentSyncState& compState = entityState.components[compId];
+    ComponentSyncState& compState = entityState.ComponentState(compId);
     compState.MarkAttributeCreated(attrIndex);
 }
 
@@ -280,10 +296,64 @@ void SceneSyncState::MarkAttributeRemoved(entity_id_t id, component_id_t compId,
     MarkEntityDirty(id);
     EntitySyncState& entityState = entities[id];
     entityState.MarkComponentDirty(compId);
-    ComponentSyncState& compState = entityState.components[compId];
+    ComponentSyncState& compState = entityState.ComponentState(compId);
     compState.MarkAttributeRemoved(attrIndex);
 }
 
+void SceneSyncState::DeferAttribute(EntitySyncState &entityState, ComponentSyncState &compState, u8 attrIndex, kNet::tick_t dueTime)
+{
+    compState.RateLimitedAttributeState(attrIndex).deferred = true;
+    if (!entityState.deferredSyncTime)
+    {
+        deferredEntities.push_back(entityState.id);
+        entityState.deferredSyncTime = dueTime;
+    }
+    else if (dueTime < entityState.deferredSyncTime)
+        entityState.deferredSyncTime = dueTime;
+}
+
+void SceneSyncState::QueueDeferredEntities()
+{
+    if (deferredEntities.empty())
+        return;
+
+    const kNet::tick_t now = kNet::Clock::Tick();
+    for(size_t i = 0; i < deferredEntities.size();)
+    {
+        EntitySyncState *entityState = entities.Find(deferredEntities[i]);
+        if (entityState && entityState->deferredSyncTime && now < entityState->deferredSyncTime)
+        {
+            ++i;
+            continue;
+        }
+        deferredEntities[i] = deferredEntities.back();
+        deferredEntities.pop_back();
+        if (!entityState || !entityState->deferredSyncTime)
+            continue;
+
+        // Attributes that are not due yet are held back again when the entity is processed
+        entityState->deferredSyncTime = 0;
+        for(size_t j = 0; j < entityState->components.size(); ++j)
+        {
+            ComponentSyncState &compState = entityState->components[j];
+            bool dirty = false;
+            for(size_t k = 0; k < compState.rateLimitedAttributes.size(); ++k)
+            {
+                ComponentSyncState::RateLimitedAttribute &attr = compState.rateLimitedAttributes[k];
+                if (attr.deferred)
+                {
+                    attr.deferred = false;
+                    compState.MarkAttributeDirty(attr.index);
+                    dirty = true;
+                }
+            }
+            if (dirty)
+                entityState->MarkComponentDirty(compState.id);
+        }
+        dirtyQueue.PushBack(entityState);
+    }
+}
+
 // Private
 
 bool SceneSyncState::ShouldMarkAsDirty(entity_id_t id)
@@ -298,8 +368,7 @@ bool SceneSyncState::ShouldMarkAsDirty(entity_id_t id)
     // Only request if this entity does not have a sync state yet.
     // Otherwise this id will spam the signal handler on every change if
     // the addition to sync state was accepted.
-    std::map<entity_id_t, EntitySyncState>::iterator i = entities.find(id);
-    if (i == entities.end())
+    if (!entities.Find(id))
     {
         PROFILE(SyncState_Emit_AboutToDirtyEntity);
         
@@ -386,12 +455,6 @@ void SceneSyncState::AddPendingEntity(entity_id_t id)
 EntitySyncState& SceneSyncState::MarkEntityDirtySilent(entity_id_t id)
 {
     EntitySyncState& entityState = entities[id]; // Creates new if did not exist
-    if (!entityState.id)
-        entityState.id = id;
-    if (!entityState.isInQueue)
-    {
-        dirtyQueue.push_back(&entityState);
-        entityState.isInQueue = true;
-    }
+    dirtyQueue.PushBack(&entityState);
     return entityState;
 }
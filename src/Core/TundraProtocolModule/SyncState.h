@@ -9,21 +9,36 @@
 #include "Transform.h"
 #include "Math/float3.h"
 #include "MsgEntityAction.h"
+#include "SyncStateContainers.h"
 
 #include <QObject>
 #include <QVariant>
 
+#include <deque>
 #include <list>
 #include <map>
 #include <set>
+#include <vector>
 
 #include <kNet/PolledTimer.h>
 #include <kNet/Types.h>
 
+/// Binary encodings of the attribute values last sent or received in EditAttributes messages, indexed by attribute index.
+/** Used as the baselines of delta-encoded attribute values. An empty encoding means no baseline. @sa TundraLogic::AttributeDelta */
+typedef std::vector<std::vector<u8> > AttributeBaselines;
+
 /// Component's per-user network sync state
 /* @sa EntitySyncState, SceneSyncState */
 struct ComponentSyncState
 {
+    /// Replication state of an attribute with a replication rate limit. @sa AttributeMetadata::maxReplicationRate
+    struct RateLimitedAttribute
+    {
+        u8 index; ///< Attribute index.
+        bool deferred; ///< The attribute has changes that are held back until its replication interval expires.
+        kNet::tick_t lastSendTime; ///< Time the changes of the attribute were last sent to the user, 0 if never.
+    };
+
     ComponentSyncState() :
         removed(false),
         isNew(true),
@@ -31,7 +46,11 @@ struct ComponentSyncState
         id(0)
     {
         for (unsigned i = 0; i < 32; ++i)
+        {
             dirtyAttributes[i] = 0;
+            newAttributes[i] = 0;
+            removedAttributes[i] = 0;
+        }
     }
     
     void MarkAttributeDirty(u8 attrIndex)
@@ -41,28 +60,71 @@ struct ComponentSyncState
     
     void MarkAttributeCreated(u8 attrIndex)
     {
-        newAndRemovedAttributes[attrIndex] = true;
+        newAttributes[attrIndex >> 3] |= (1 << (attrIndex & 7));
+        removedAttributes[attrIndex >> 3] &= ~(1 << (attrIndex & 7));
     }
     
     void MarkAttributeRemoved(u8 attrIndex)
     {
-        newAndRemovedAttributes[attrIndex] = false;
+        removedAttributes[attrIndex >> 3] |= (1 << (attrIndex & 7));
+        newAttributes[attrIndex >> 3] &= ~(1 << (attrIndex & 7));
+    }
+
+    /// Forgets a pending create or remove of a dynamic attribute.
+    void ClearAttributeCreatedOrRemoved(u8 attrIndex)
+    {
+        newAttributes[attrIndex >> 3] &= ~(1 << (attrIndex & 7));
+        removedAttributes[attrIndex >> 3] &= ~(1 << (attrIndex & 7));
+    }
+
+    /// Forgets all pending creates and removes of dynamic attributes.
+    void ClearAttributesCreatedOrRemoved()
+    {
+        for (unsigned i = 0; i < 32; ++i)
+        {
+            newAttributes[i] = 0;
+            removedAttributes[i] = 0;
+        }
     }
     
     void DirtyProcessed()
     {
         for (unsigned i = 0; i < 32; ++i)
             dirtyAttributes[i] = 0;
-        newAndRemovedAttributes.clear();
+        ClearAttributesCreatedOrRemoved();
         isNew = false;
     }
+
+    /// Returns the replication state of a rate limited attribute, creating it if it does not exist.
+    RateLimitedAttribute &RateLimitedAttributeState(u8 attrIndex)
+    {
+        for (size_t i = 0; i < rateLimitedAttributes.size(); ++i)
+            if (rateLimitedAttributes[i].index == attrIndex)
+                return rateLimitedAttributes[i];
+        RateLimitedAttribute attr = { attrIndex, false, 0 };
+        rateLimitedAttributes.push_back(attr);
+        return rateLimitedAttributes.back();
+    }
+
+    /// Returns whether the attribute has changes held back by its replication rate limit.
+    bool IsAttributeDeferred(u8 attrIndex) const
+    {
+        for (size_t i = 0; i < rateLimitedAttributes.size(); ++i)
+            if (rateLimitedAttributes[i].index == attrIndex)
+                return rateLimitedAttributes[i].deferred;
+        return false;
+    }
     
     u8 dirtyAttributes[32]; ///< Dirty attributes bitfield. A maximum of 256 attributes are supported.
-    std::map<u8, bool> newAndRemovedAttributes; ///< Dynamic attributes by index that have been removed or created since last update. True = create, false = delete
-    component_id_t id; ///< Component ID. Duplicated here intentionally to allow recognizing the component without the parent map.
+    u8 newAttributes[32]; ///< Dynamic attributes that have been created since last update, bitfield.
+    u8 removedAttributes[32]; ///< Dynamic attributes that have been removed since last update, bitfield.
+    component_id_t id; ///< Component ID. Duplicated here intentionally to allow recognizing the component without the parent entity state.
+    AttributeBaselines attributeBaselines; ///< Attribute values last sent to the user, for protocol version ProtocolAttributeDeltas and newer.
+    /// Rate limited attributes that have been sent to the user. Only a few attributes are rate limited, so a flat array is fastest to search.
+    std::vector<RateLimitedAttribute> rateLimitedAttributes;
     bool removed; ///< The component has been removed since last update
     bool isNew; ///< The client does not have the component and it must be serialized in full
-    bool isInQueue; ///< The component is already in the entity's dirty queue
+    bool isInQueue; ///< The component is dirty and will be processed on the next update of the entity
 };
 
 /// Entity's per-user network sync state
@@ -76,74 +138,145 @@ struct EntitySyncState
         hasPropertyChanges(false),
         hasParentChange(false),
         id(0),
+        numDirtyComponents(0),
+        prevDirty(0),
+        nextDirty(0),
         avgUpdateInterval(0.0f),
+        lastNetworkSendTime(0),
+        transformPending(false),
+        lastSyncTime(0),
+        deferredSyncTime(0),
         priority(-1.f),
-        relevancy(-1.f)
+        relevancy(-1.f),
+        priorityGeneration(0),
+        priorityBand(0)
     {
     }
-    
-    void RemoveFromQueue(component_id_t id)
+
+    /// Returns the component sync state with the ID, or null if it does not exist.
+    ComponentSyncState *FindComponent(component_id_t id)
+    {
+        for (size_t i = 0; i < components.size(); ++i)
+            if (components[i].id == id)
+                return &components[i];
+        return 0;
+    }
+
+    /// Returns the component sync state with the ID, creating it if it does not exist.
+    /** @note Creating a component sync state invalidates pointers to the other component sync states of the entity. */
+    ComponentSyncState &ComponentState(component_id_t id)
     {
-        std::map<component_id_t, ComponentSyncState>::iterator i = components.find(id);
-        if (i != components.end())
+        ComponentSyncState *compState = FindComponent(id);
+        if (compState)
+            return *compState;
+        components.push_back(ComponentSyncState());
+        components.back().id = id;
+        return components.back();
+    }
+
+    /// Removes the component sync state at @c index by moving the last component sync state in its place.
+    void RemoveComponentAt(size_t index)
+    {
+        if (components[index].isInQueue)
+            --numDirtyComponents;
+        if (index + 1 < components.size())
         {
-            if (i->second.isInQueue)
+            // Move the attribute baselines instead of copying them
+            AttributeBaselines baselines;
+            baselines.swap(components.back().attributeBaselines);
+            components[index] = components.back();
+            components[index].attributeBaselines.swap(baselines);
+        }
+        components.pop_back();
+    }
+
+    /// Removes the component sync state with the ID, if it exists.
+    void RemoveComponent(component_id_t id)
+    {
+        for (size_t i = 0; i < components.size(); ++i)
+            if (components[i].id == id)
             {
-                for (std::list<ComponentSyncState*>::iterator j = dirtyQueue.begin(); j != dirtyQueue.end(); ++j)
-                {
-                    if ((*j) == &i->second)
-                    {
-                        dirtyQueue.erase(j);
-                        break;
-                    }
-                }
-                i->second.isInQueue = false;
+                RemoveComponentAt(i);
+                return;
             }
+    }
+
+    /// Moves the component sync state to a new ID, replacing an existing sync state with the new ID.
+    void ChangeComponentId(component_id_t oldId, component_id_t newId)
+    {
+        if (oldId == newId)
+            return;
+        RemoveComponent(newId);
+        ComponentState(oldId).id = newId;
+    }
+
+    /// Returns whether some components are waiting to be processed.
+    bool HasDirtyComponents() const { return numDirtyComponents > 0; }
+
+    void RemoveFromQueue(component_id_t id)
+    {
+        ComponentSyncState *compState = FindComponent(id);
+        if (compState && compState->isInQueue)
+        {
+            compState->isInQueue = false;
+            --numDirtyComponents;
         }
     }
     
     void MarkComponentDirty(component_id_t id)
     {
-        ComponentSyncState& compState = components[id]; // Creates new if did not exist
-        if (!compState.id)
-            compState.id = id;
+        ComponentSyncState& compState = ComponentState(id); // Creates new if did not exist
         if (!compState.isInQueue)
         {
-            dirtyQueue.push_back(&compState);
             compState.isInQueue = true;
+            ++numDirtyComponents;
         }
     }
     
     void MarkComponentRemoved(component_id_t id)
     {
         // If user did not have the component in the first place, do nothing
-        std::map<component_id_t, ComponentSyncState>::iterator i = components.find(id);
-        if (i == components.end())
+        ComponentSyncState *compState = FindComponent(id);
+        if (!compState)
             return;
         // If component is marked new, it was not sent yet and can be simply removed from the sync state
-        if (i->second.isNew)
+        if (compState->isNew)
         {
-            RemoveFromQueue(id);
-            components.erase(id);
+            RemoveComponent(id);
             return;
         }
         // Else mark as removed and queue the update
-        i->second.removed = true;
-        if (!i->second.isInQueue)
+        compState->removed = true;
+        if (!compState->isInQueue)
         {
-            dirtyQueue.push_back(&i->second);
-            i->second.isInQueue = true;
+            compState->isInQueue = true;
+            ++numDirtyComponents;
         }
     }
+
+    /// Forgets the attribute values last sent to the user, so that the next values are sent in full.
+    void ClearAttributeBaselines()
+    {
+        for (size_t i = 0; i < components.size(); ++i)
+            components[i].attributeBaselines.clear();
+    }
+
+    /// Removes all components from the queue without processing them.
+    void ClearComponentQueue()
+    {
+        for (size_t i = 0; i < components.size(); ++i)
+            components[i].isInQueue = false;
+        numDirtyComponents = 0;
+    }
     
     void DirtyProcessed()
     {
-        for (std::map<component_id_t, ComponentSyncState>::iterator i = components.begin(); i != components.end(); ++i)
+        for (size_t i = 0; i < components.size(); ++i)
         {
-            i->second.DirtyProcessed();
-            i->second.isInQueue = false;
+            components[i].DirtyProcessed();
+            components[i].isInQueue = false;
         }
-        dirtyQueue.clear();
+        numDirtyComponents = 0;
         isNew = false;
         hasPropertyChanges = false;
         hasParentChange = false;
@@ -167,6 +300,7 @@ struct EntitySyncState
         return FinalPriority() < rhs.FinalPriority();
     }
 
+
     /// Computes prioritized network update interval in seconds.
     /*  @remark Interest management */
 //    float ComputePrioritizedUpdateInterval(float maxUpdateRate) const { return Clamp(maxUpdateRate / FinalPriority(), maxUpdateRate, MinUpdateRate); }
@@ -176,17 +310,36 @@ struct EntitySyncState
     /*  @remark Interest management */
     float FinalPriority() const { return priority * relevancy; }
 
+    /// Returns the scheduling score of this sync state: the priority weighted by how overdue the entity's update is.
+    /** Entities that have not been sent for a long time gain score, so that low priority entities are not starved.
+        @param timeSinceLastSync Seconds since the entity's changes were last sent.
+        @param maxUpdateRate Update period of the sync manager in seconds.
+        @remark Interest management */
+    float SchedulingScore(float timeSinceLastSync, float maxUpdateRate) const
+    {
+        float p = FinalPriority();
+        if (!(p > 0.f))
+            p = 1.f; // Priority not computed yet
+        p = Min(p, 1e6f); // Non-spatial entities have infinite priority
+        const float interval = Clamp(maxUpdateRate * Log2(100.f / p), maxUpdateRate, MinUpdateRate);
+        return p * timeSinceLastSync / interval;
+    }
+
     static const float MinUpdateRate; ///< 5 (in seconds)
 //    static const float MaxUpdateRate; ///< 0.005 (in seconds)
 
-    std::list<ComponentSyncState*> dirtyQueue; ///< Dirty components
-    std::map<component_id_t, ComponentSyncState> components; ///< Component syncstates
-    entity_id_t id; ///< Entity ID. Duplicated here intentionally to allow recognizing the entity without the parent map.
+    /// Component syncstates. Entities have only a handful of components, so a flat array is faster to search than a tree.
+    /** Dirty components are flagged with ComponentSyncState::isInQueue. The order of the array is not significant. */
+    std::vector<ComponentSyncState> components;
+    entity_id_t id; ///< Entity ID. Duplicated here intentionally to allow recognizing the entity without the parent table.
     bool removed; ///< The entity has been removed since last update
     bool isNew; ///< The client does not have the entity and it must be serialized in full
-    bool isInQueue; ///< The entity is already in the scene's dirty queue
+    bool isInQueue; ///< The entity is already in the scene's dirty queue. Managed by the queue.
     bool hasPropertyChanges; ///< The entity has changes into its other properties, such as temporary flag
     bool hasParentChange; ///> The entity's parent has changed
+    uint numDirtyComponents; ///< Number of components that have isInQueue set.
+    EntitySyncState *prevDirty; ///< Previous entity in the scene's dirty queue. Managed by the queue.
+    EntitySyncState *nextDirty; ///< Next entity in the scene's dirty queue. Managed by the queue.
 
     kNet::PolledTimer updateTimer; ///< Last update received timer, for calculating avgUpdateInterval.
     float avgUpdateInterval; ///< Average network update interval in seconds, used for interpolation.
@@ -197,6 +350,9 @@ struct EntitySyncState
     float3 linearVelocity;
     float3 angularVelocity;
     kNet::tick_t lastNetworkSendTime; /**< @note Shared usage by rigid body optimization and interest management. */
+    bool transformPending; ///< The transform has changes that dead reckoning has not sent yet. @sa SceneSyncState::pendingRigidBodies
+    kNet::tick_t lastSyncTime; ///< Time the entity's changes were last sent by the generic sync. Used for scheduling the dirty entities.
+    kNet::tick_t deferredSyncTime; ///< Time the held back changes of rate limited attributes are due, 0 if none. @sa SceneSyncState::deferredEntities
 
     /// Priority = size / distance for visible entities, inf for non-visible.
     /** Larger number means larger importancy. If this value has not been yet calculated it's < 0.
@@ -210,6 +366,42 @@ struct EntitySyncState
         Used to determinate the prioritized update interval of the entity together with priority.
         @remark Interest management */
     float relevancy;
+
+    /// EntityPriorityInfo::generation the priority was last computed from. @remark Interest management
+    u32 priorityGeneration;
+    /// Distance band (integer log2 of the squared distance) to the observer the priority was last computed for. @remark Interest management
+    int priorityBand;
+};
+
+/// Spatial information of an entity used for computing its priority, shared by all user connections.
+/** Recomputed by the server only when the entity's placeable, mesh or components change.
+    @remark Interest management */
+struct EntityPriorityInfo
+{
+    EntityPriorityInfo() :
+        id(0),
+        sizeSq(0.f),
+        worldPos(float3::zero),
+        generation(0),
+        valid(false),
+        dirty(false),
+        parented(false),
+        hasPlaceable(false),
+        hasMesh(false),
+        hasRigidBody(false)
+    {
+    }
+
+    entity_id_t id;
+    float sizeSq; ///< Squared surface area of the world space bounding box of the mesh.
+    float3 worldPos; ///< World position of the placeable.
+    u32 generation; ///< Incremented each time the information changes.
+    bool valid; ///< Has the information been computed.
+    bool dirty; ///< Is the information queued for recomputation.
+    bool parented; ///< Is the placeable parented, in which case the world position is polled as the parent's movement is not signaled.
+    bool hasPlaceable;
+    bool hasMesh;
+    bool hasRigidBody;
 };
 
 struct RigidBodyInterpolationState
@@ -237,6 +429,38 @@ struct RigidBodyInterpolationState
     kNet::packet_id_t lastReceivedPacketCounter;
 };
 
+/// Client-side prediction state of an entity the client controls. @sa SyncManager::SetEntityPredicted
+/** The entity is moved locally, and the positions received from the server are compared against the positions the client predicted
+    for the time the server state corresponds to. The difference is smoothed out, keeping the motion predicted since then. */
+struct RigidBodyPredictionState
+{
+    RigidBodyPredictionState() :
+        positionError(float3::zero),
+        lastReceivedPacketCounter(0),
+        hasReceivedPacket(false)
+    {
+    }
+
+    /// Predicted position of the entity at a point of time.
+    struct PredictedState
+    {
+        kNet::tick_t time;
+        float3 pos;
+    };
+
+    /// Maximum number of predicted states remembered.
+    static const size_t cMaxHistorySize = 128;
+
+    /// Predicted positions on the recent frames, oldest first. The positions include the correction that is not yet smoothed out.
+    std::deque<PredictedState> history;
+    /// Correction from the server that has not been applied to the entity yet.
+    float3 positionError;
+    /// Packet id of the most recently received movement packet, for ignoring the out-of-order ones.
+    kNet::packet_id_t lastReceivedPacketCounter;
+    /// Has a movement packet been received.
+    bool hasReceivedPacket;
+};
+
 /// State change request to permit/deny changes.
 class TUNDRAPROTOCOL_MODULE_API StateChangeRequest : public QObject
 {
@@ -294,23 +518,28 @@ class TUNDRAPROTOCOL_MODULE_API SceneSyncState : public QObject
     Q_OBJECT
     Q_PROPERTY(float3 observerPos READ ObserverPos) /**< @copydoc observerPos */
     Q_PROPERTY(float3 observerRot READ ObserverRot) /**< @copydoc observerRot */
+    Q_PROPERTY(float updatePeriod READ UpdatePeriod) /**< @copydoc updatePeriod */
     // Q_PROPERTY machinery
     const float3 &ObserverPos() const { return observerPos; }
     const float3 &ObserverRot() const { return observerRot; }
+    float UpdatePeriod() const { return updatePeriod; }
 
 public:
     SceneSyncState(u32 userConnectionID = 0, bool isServer = false);
     virtual ~SceneSyncState();
 
     /// Dirty entities pending processing
-    std::list<EntitySyncState*> dirtyQueue; 
+    DirtyList<EntitySyncState> dirtyQueue;
 
     /// Entity sync states
-    std::map<entity_id_t, EntitySyncState> entities; 
+    SyncStateTable<EntitySyncState> entities;
 
     /// Entity interpolations
     std::map<entity_id_t, RigidBodyInterpolationState> entityInterpolations;
 
+    /// Entities the client predicts locally (client only). @sa SyncManager::SetEntityPredicted
+    std::map<entity_id_t, RigidBodyPredictionState> entityPredictions;
+
     /// Queued EntityAction messages. These will be sent to the user on the next network update tick.
     std::vector<MsgEntityAction> queuedActions;
 
@@ -320,6 +549,33 @@ public:
     /// Last sent (client) or received (server) observer orientation in world coordinates, Euler ZYX in degrees.
     /** If !IsFinite() ObserverPosition message has not been been received from the client. */
     float3 observerRot;
+    /// Observer position the entity priorities were last computed for (server only).
+    /** If !IsFinite() the priorities have not been computed yet. @remark Interest management */
+    float3 priorityObserverPos;
+
+    /// Attribute values last received from the user, keyed by entity and component ID (protocol version ProtocolAttributeDeltas and newer).
+    /** The IDs are as received, i.e. they are not converted from unacked to real IDs. */
+    std::map<entity_id_t, std::map<component_id_t, AttributeBaselines> > receivedAttributeBaselines;
+
+    /// Entities whose transform changes dead reckoning has not sent yet (server only). They are rechecked on each update,
+    /// even if they are no longer in the dirty queue. @sa EntitySyncState::transformPending
+    std::vector<entity_id_t> pendingRigidBodies;
+
+    /// Entities with rate limited attribute changes that are held back until their replication interval expires.
+    /// They are queued again by QueueDeferredEntities() when due. @sa EntitySyncState::deferredSyncTime
+    std::vector<entity_id_t> deferredEntities;
+
+    /// Network update period of the user in seconds, 0 until the first update.
+    /** The SyncManager's update period, unless the adaptive update rate adjusts it from the link statistics of the connection. */
+    float updatePeriod;
+    /// Time accumulator for the network updates of the user (server only, adaptive update rate).
+    float updateAcc;
+
+    /// Is the initial scene yet to be sent to the user as the scene snapshot (server only, protocol version ProtocolSceneSnapshot and newer).
+    bool sceneSnapshotPending;
+
+    /// Returns whether the entities sent to the user are filtered with the AboutToDirtyEntity signal.
+    bool HasEntityFilter() const;
 
 signals:
     /// This signal is emitted when an entity is being added to the client sync state.
@@ -366,6 +622,12 @@ public:
     
     void RemoveFromQueue(entity_id_t id);
 
+    /// Removes the entity from the dirty queue and erases its sync state.
+    void RemoveEntityState(entity_id_t id);
+
+    /// Moves the entity sync state to a new ID, replacing an existing sync state with the new ID. The state is removed from the dirty queue.
+    void ChangeEntityId(entity_id_t oldId, entity_id_t newId);
+
     void MarkEntityProcessed(entity_id_t id);
     void MarkComponentProcessed(entity_id_t id, component_id_t compId);
 
@@ -379,6 +641,11 @@ public:
     void MarkAttributeCreated(entity_id_t id, component_id_t compId, u8 attrIndex);
     void MarkAttributeRemoved(entity_id_t id, component_id_t compId, u8 attrIndex);
 
+    /// Holds back the changes of a rate limited attribute until @c dueTime. @sa AttributeMetadata::maxReplicationRate
+    void DeferAttribute(EntitySyncState &entityState, ComponentSyncState &compState, u8 attrIndex, kNet::tick_t dueTime);
+    /// Marks the held back attribute changes dirty again and queues their entities, if they are due.
+    void QueueDeferredEntities();
+
     /// Silently does the same as MarkEntityDirty without emitting change request signal.
     /// @remark Enables a 'pending' logic in SyncManager, with which a script can throttle the sending of entities to clients.
     EntitySyncState& MarkEntityDirtySilent(entity_id_t id);
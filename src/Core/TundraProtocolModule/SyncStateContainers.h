@@ -0,0 +1,298 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "CoreTypes.h"
+
+#include <vector>
+#include <algorithm>
+#include <cassert>
+
+/// Intrusive doubly-linked list of dirty sync states.
+/** T must have the members T *prevDirty, T *nextDirty and bool isInQueue, which are managed by the list.
+    Pushing, removing and iterating never allocate memory, and removing an arbitrary item is O(1).
+    The list does not own its items.
+    @sa SyncStateTable */
+template<typename T>
+class DirtyList
+{
+public:
+    DirtyList() : first_(0), last_(0), size_(0) {}
+
+    /// Returns whether the list is empty.
+    bool Empty() const { return first_ == 0; }
+    /// Returns the number of items in the list.
+    size_t Size() const { return size_; }
+    /// Returns the first item of the list, or null if the list is empty.
+    T *Front() const { return first_; }
+    /// Returns the item following @c item, or null if @c item is the last one.
+    static T *Next(const T *item) { return item->nextDirty; }
+
+    /// Appends an item to the end of the list. Does nothing if the item is already in the list.
+    void PushBack(T *item)
+    {
+        if (item->isInQueue)
+            return;
+        item->prevDirty = last_;
+        item->nextDirty = 0;
+        if (last_)
+            last_->nextDirty = item;
+        else
+            first_ = item;
+        last_ = item;
+        item->isInQueue = true;
+        ++size_;
+    }
+
+    /// Removes an item from the list.
+    /** @return The item that followed the removed item, or null if it was the last one or not in the list. */
+    T *Remove(T *item)
+    {
+        if (!item->isInQueue)
+            return 0;
+        T *next = item->nextDirty;
+        if (item->prevDirty)
+            item->prevDirty->nextDirty = next;
+        else
+            first_ = next;
+        if (next)
+            next->prevDirty = item->prevDirty;
+        else
+            last_ = item->prevDirty;
+        item->prevDirty = 0;
+        item->nextDirty = 0;
+        item->isInQueue = false;
+        --size_;
+        return next;
+    }
+
+    /// Moves an item to the end of the list, inserting it if it was not in the list.
+    void MoveToBack(T *item)
+    {
+        Remove(item);
+        PushBack(item);
+    }
+
+    /// Removes all items from the list.
+    void Clear()
+    {
+        for(T *item = first_; item;)
+        {
+            T *next = item->nextDirty;
+            item->prevDirty = 0;
+            item->nextDirty = 0;
+            item->isInQueue = false;
+            item = next;
+        }
+        first_ = last_ = 0;
+        size_ = 0;
+    }
+
+private:
+    T *first_;
+    T *last_;
+    size_t size_;
+
+    DirtyList(const DirtyList &);
+    void operator =(const DirtyList &);
+};
+
+/// Table of sync states keyed by a nonzero 32-bit ID, such as an entity ID.
+/** The states are stored in fixed-size chunks, so their addresses stay valid until they are erased, and they can be
+    linked to a DirtyList. The ID to state lookup is an open-addressed hash table with linear probing, which keeps lookups
+    within one or two cache lines. Erased states are recycled, so in steady state inserting and erasing do not allocate memory.
+
+    T must be default-constructible and assignable, and have a u32-compatible member @c id, which the table manages:
+    an ID of 0 marks an unused slot. Erasing a state resets it to a default-constructed one.
+    @sa DirtyList */
+template<typename T>
+class SyncStateTable
+{
+public:
+    /// Number of states per storage chunk.
+    static const u32 cChunkSize = 256;
+
+    SyncStateTable() : size_(0), shift_(32) {}
+    ~SyncStateTable() { Clear(); }
+
+    /// Iterates over the states in storage order.
+    class Iterator
+    {
+    public:
+        Iterator() : table_(0), slot_(0) {}
+        T &operator *() const { return *table_->SlotAt(slot_); }
+        T *operator ->() const { return table_->SlotAt(slot_); }
+        Iterator &operator ++() { slot_ = table_->NextUsedSlot(slot_ + 1); return *this; }
+        bool operator ==(const Iterator &rhs) const { return slot_ == rhs.slot_; }
+        bool operator !=(const Iterator &rhs) const { return slot_ != rhs.slot_; }
+
+    private:
+        friend class SyncStateTable;
+        Iterator(const SyncStateTable *table, u32 slot) : table_(table), slot_(slot) {}
+        const SyncStateTable *table_;
+        u32 slot_;
+    };
+
+    Iterator Begin() const { return Iterator(this, NextUsedSlot(0)); }
+    Iterator End() const { return Iterator(this, SlotCount()); }
+
+    /// Returns the number of states in the table.
+    size_t Size() const { return size_; }
+    /// Returns whether the table is empty.
+    bool Empty() const { return size_ == 0; }
+
+    /// Returns the state with the ID, or null if it does not exist.
+    T *Find(u32 id) const
+    {
+        if (!id || buckets_.empty())
+            return 0;
+        const u32 mask = (u32)buckets_.size() - 1;
+        for(u32 i = Hash(id); ; i = (i + 1) & mask)
+        {
+            const Bucket &b = buckets_[i];
+            if (b.id == id)
+                return SlotAt(b.slot);
+            if (!b.id)
+                return 0;
+        }
+    }
+
+    /// Returns the state with the ID, creating it if it does not exist.
+    T &operator [](u32 id)
+    {
+        assert(id);
+        T *existing = Find(id);
+        if (existing)
+            return *existing;
+
+        if ((size_ + 1) * 2 > buckets_.size())
+            Rehash(buckets_.empty() ? 16 : (u32)buckets_.size() * 2);
+
+        u32 slot = AllocateSlot();
+        T *item = SlotAt(slot);
+        item->id = id;
+
+        const u32 mask = (u32)buckets_.size() - 1;
+        u32 i = Hash(id);
+        while(buckets_[i].id)
+            i = (i + 1) & mask;
+        buckets_[i].id = id;
+        buckets_[i].slot = slot;
+        ++size_;
+        return *item;
+    }
+
+    /// Erases the state with the ID. Returns false if it did not exist.
+    /** @note If the state is linked to a DirtyList, it must be removed from the list first. */
+    bool Erase(u32 id)
+    {
+        if (!id || buckets_.empty())
+            return false;
+        const u32 mask = (u32)buckets_.size() - 1;
+        u32 i = Hash(id);
+        while(buckets_[i].id != id)
+        {
+            if (!buckets_[i].id)
+                return false;
+            i = (i + 1) & mask;
+        }
+
+        const u32 slot = buckets_[i].slot;
+        *SlotAt(slot) = T(); // Resets the ID to 0, marking the slot unused.
+        freeSlots_.push_back(slot);
+
+        // Backward shift deletion: move following entries of the probe sequence into the hole, so no tombstones are needed.
+        for(u32 j = (i + 1) & mask; buckets_[j].id; j = (j + 1) & mask)
+        {
+            const u32 home = Hash(buckets_[j].id);
+            // The entry at j can fill the hole at i only if its home bucket is not cyclically within (i, j].
+            const bool stays = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+            if (!stays)
+            {
+                buckets_[i] = buckets_[j];
+                i = j;
+            }
+        }
+        buckets_[i].id = 0;
+        --size_;
+        return true;
+    }
+
+    /// Erases all states and releases the memory.
+    void Clear()
+    {
+        for(size_t i = 0; i < chunks_.size(); ++i)
+            delete[] chunks_[i];
+        chunks_.clear();
+        buckets_.clear();
+        freeSlots_.clear();
+        size_ = 0;
+        shift_ = 32;
+    }
+
+private:
+    struct Bucket
+    {
+        Bucket() : id(0), slot(0) {}
+        u32 id; ///< ID of the state, 0 if the bucket is empty.
+        u32 slot; ///< Storage slot of the state.
+    };
+
+    /// Fibonacci hashing, spreads sequential IDs evenly over the buckets.
+    u32 Hash(u32 id) const { return shift_ < 32 ? (u32)(id * 2654435769u) >> shift_ : 0; }
+
+    u32 SlotCount() const { return (u32)chunks_.size() * cChunkSize; }
+    T *SlotAt(u32 slot) const { return &chunks_[slot / cChunkSize][slot % cChunkSize]; }
+
+    u32 NextUsedSlot(u32 slot) const
+    {
+        const u32 count = SlotCount();
+        while(slot < count && !SlotAt(slot)->id)
+            ++slot;
+        return slot;
+    }
+
+    u32 AllocateSlot()
+    {
+        if (freeSlots_.empty())
+        {
+            const u32 firstSlot = SlotCount();
+            chunks_.push_back(new T[cChunkSize]);
+            // Push in reverse so that the slots are handed out in storage order.
+            for(u32 i = cChunkSize; i > 0; --i)
+                freeSlots_.push_back(firstSlot + i - 1);
+        }
+        const u32 slot = freeSlots_.back();
+        freeSlots_.pop_back();
+        return slot;
+    }
+
+    void Rehash(u32 bucketCount)
+    {
+        std::vector<Bucket> old;
+        old.swap(buckets_);
+        buckets_.resize(bucketCount);
+        shift_ = 32;
+        for(u32 n = bucketCount; n > 1; n >>= 1)
+            --shift_;
+        const u32 mask = bucketCount - 1;
+        for(size_t k = 0; k < old.size(); ++k)
+        {
+            if (!old[k].id)
+                continue;
+            u32 i = Hash(old[k].id);
+            while(buckets_[i].id)
+                i = (i + 1) & mask;
+            buckets_[i] = old[k];
+        }
+    }
+
+    std::vector<T*> chunks_;
+    std::vector<Bucket> buckets_;
+    std::vector<u32> freeSlots_;
+    size_t size_;
+    u32 shift_; ///< 32 - log2(bucket count)
+
+    SyncStateTable(const SyncStateTable &);
+    void operator =(const SyncStateTable &);
+};
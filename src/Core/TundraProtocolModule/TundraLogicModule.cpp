@@ -9,6 +9,7 @@
 #include "OgreSceneImporter.h"
 #include "SyncManager.h"
 #include "KristalliProtocolModule.h"
+#include "NetworkTrafficReplay.h"
 
 #include "Profiler.h"
 #include "SceneAPI.h"
@@ -158,6 +159,7 @@ void TundraLogicModule::Initialize()
 void TundraLogicModule::Uninitialize()
 {
     kristalliModule_ = 0;
+    trafficReplay_.reset();
     syncManager_.reset();
     client_.reset();
     server_.reset();
@@ -171,6 +173,9 @@ void TundraLogicModule::Update(f64 frametime)
         client_->Update(frametime);
     if (server_)
         server_->Update(frametime);
+    // Feed the recorded network traffic to the server
+    if (trafficReplay_)
+        trafficReplay_->Update(frametime);
     // Run scene sync
     if (syncManager_)
         syncManager_->Update(frametime);
@@ -281,6 +286,22 @@ void TundraLogicModule::ReadStartupParameters()
     if (framework_->HasCommandLineParameter("--file")) // Load startup scene here (if we have one)
         LoadStartupScene();
 
+    const QStringList replayParam = framework_->CommandLineParameters("--replayNetworkTraffic");
+    if (!replayParam.empty())
+    {
+        if (!server_->IsRunning())
+            LogError("TundraLogicModule::ReadStartupParameters: --replayNetworkTraffic requires --server.");
+        else
+        {
+            trafficReplay_ = MAKE_SHARED(NetworkTrafficReplay, this);
+            const QStringList speedParam = framework_->CommandLineParameters("--replaySpeed");
+            if (!speedParam.empty())
+                trafficReplay_->SetSpeed(speedParam.last().toFloat());
+            if (!trafficReplay_->Open(replayParam.last()))
+                trafficReplay_.reset();
+        }
+    }
+
     // Web login handling, if we are on a server the request will be ignored down the chain.
     QStringList cmdLineParams = framework_->CommandLineParameters("--login");
     if (cmdLineParams.size() > 0)
@@ -92,6 +92,7 @@ private:
     shared_ptr<SyncManager> syncManager_; ///< Sync manager
     shared_ptr<Client> client_; ///< Client
     shared_ptr<Server> server_; ///< Server
+    shared_ptr<NetworkTrafficReplay> trafficReplay_; ///< Network traffic replay, if the --replayNetworkTraffic command line parameter is given
     KristalliProtocolModule *kristalliModule_; ///< KristalliProtocolModule pointer
 };
 
@@ -39,6 +39,18 @@ const unsigned long cRegisterComponentTypeMessage = 123;
 // Entity parenting
 const unsigned long cSetEntityParentMessage = 124;
 
+// Initial scene state for joining clients, a compressed stream of CreateEntity messages. Server->client only
+const unsigned long cSceneSnapshotMessage = 125;
+
+// Several reliable in-order scene sync messages packed into one, each as (VLE message ID, VLE size, payload)
+const unsigned long cBatchedSceneMessage = 126;
+
+// A whole WebSocket frame, including its message ID, compressed with qCompress (u32 big-endian uncompressed size followed by a zlib stream). Server->WebSocket client only
+const unsigned long cCompressedMessage = 127;
+
+// New entries of the sender's string table as (first ID, count, strings), see StringTable
+const unsigned long cStringTableMessage = 128;
+
 // In case of network message structs are regenerated and descriptions get deleted., saving their descriptions here.
 // MsgAssetDeleted: Network message informing that asset has been deleted from storage.
 // MsgAssetDiscovery: Network message informing that new asset has been discovered in storage.
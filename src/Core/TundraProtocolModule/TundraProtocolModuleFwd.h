@@ -20,6 +20,8 @@ namespace TundraLogic
     class Client;
     class Server;
     class SyncManager;
+    class NetworkTrafficRecorder;
+    class NetworkTrafficReplay;
 }
 
 using TundraLogic::TundraLogicModule;
@@ -88,6 +88,18 @@ void KNetUserConnection::Send(kNet::message_id_t id, const char* data, size_t nu
     connection->EndAndQueueMessage(msg);
 }
 
+UserConnectionStats KNetUserConnection::Statistics() const
+{
+    UserConnectionStats stats;
+    if (connection)
+    {
+        stats.roundTripTime = connection->RoundTripTime() / 1000.f;
+        stats.packetLossRate = connection->PacketLossRate();
+        stats.queuedMessages = connection->NumOutboundMessagesPending();
+    }
+    return stats;
+}
+
 void KNetUserConnection::Disconnect()
 {
     if (connection)
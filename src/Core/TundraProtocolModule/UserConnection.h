@@ -5,6 +5,7 @@
 #include "CoreTypes.h"
 #include "TundraProtocolModuleApi.h"
 #include "TundraProtocolModuleFwd.h"
+#include "StringTable.h"
 
 #include <kNet/SharedPtr.h>
 #include <kNet/MessageConnection.h>
@@ -20,11 +21,28 @@ enum NetworkProtocolVersion
     ProtocolOriginal = 0x1,         // Original
     ProtocolCustomComponents = 0x2, // Adds support for transmitting new static-structured component types without actual C++ implementation, using EC_PlaceholderComponent
     ProtocolHierarchicScene = 0x3,  // Adds support for hierarchic scene, ie. entities having child entities
-    ProtocolWebClientRigidBodyMessage = 0x4 // WebSocket client that supports the rigid body optimization message
+    ProtocolWebClientRigidBodyMessage = 0x4, // WebSocket client that supports the rigid body optimization message
+    ProtocolAttributeDeltas = 0x5, // Attribute values in the EditAttributes message are delta-encoded against the previously sent values, see AttributeDelta
+    ProtocolSceneSnapshot = 0x6, // Joining clients receive the initial scene as a single compressed SceneSnapshot message
+    ProtocolBatchedMessages = 0x7, // Scene sync messages are packed into BatchedSceneMessages, see SyncContext
+    ProtocolGatheredFrames = 0x8, // WebSocket clients receive all messages of a server frame as one BatchedSceneMessage, which may then contain any messages
+    ProtocolCompressedFrames = 0x9, // WebSocket clients may receive frames wrapped in CompressedMessages
+    ProtocolStringTable = 0xA // Names in the CreateComponents, CreateAttributes, RegisterComponentType and EntityAction messages are interned per connection, see StringTable
 };
 
 /// Highest supported protocol version in the build. Update this when a new protocol version is added
-const NetworkProtocolVersion cHighestSupportedProtocolVersion = ProtocolWebClientRigidBodyMessage;
+const NetworkProtocolVersion cHighestSupportedProtocolVersion = ProtocolStringTable;
+
+/// Link statistics of a user connection. Used by SyncManager to adapt the update rate of the connection.
+struct UserConnectionStats
+{
+    UserConnectionStats() : roundTripTime(0.f), packetLossRate(0.f), queuedMessages(0), queuedBytes(0) {}
+
+    float roundTripTime; ///< Round trip time in seconds, 0 if not known.
+    float packetLossRate; ///< Fraction of packets lost, [0, 1].
+    size_t queuedMessages; ///< Number of messages waiting to be sent, 0 if not known.
+    size_t queuedBytes; ///< Number of bytes waiting to be sent, 0 if not known.
+};
 
 /// Represents a client connection on the server side. Subclassed by networking implementations.
 class TUNDRAPROTOCOL_MODULE_API UserConnection : public QObject, public enable_shared_from_this<UserConnection>
@@ -62,6 +80,10 @@ public:
     NetworkProtocolVersion protocolVersion;
     /// Map of the unacked entity IDs a user has sent, and the real entity IDs they have been assigned
     std::map<u32, u32> unackedIdsToRealIds;
+    /// Strings interned for sending to the peer, used by the SyncManager with protocol version ProtocolStringTable and newer
+    TundraLogic::StringTable sentStrings;
+    /// Strings interned by the peer
+    TundraLogic::StringTable receivedStrings;
 
     /// Queue a network message to be sent to the client. All implementations may not use the reliable, inOrder, priority and contentID parameters.
     virtual void Send(kNet::message_id_t id, const char* data, size_t numBytes, bool reliable, bool inOrder, unsigned long priority = 100, unsigned long contentID = 0) = 0;
@@ -77,6 +99,9 @@ public:
         Send(SerializableMessage::messageID, data.reliable, data.inOrder, ds);
     }
 
+    /// Returns the current link statistics of the connection. The default implementation has no statistics.
+    virtual UserConnectionStats Statistics() const { return UserConnectionStats(); }
+
     /// Trigger a network message signal. Called by the networking implementation.
     void EmitNetworkMessageReceived(kNet::packet_id_t packetId, kNet::message_id_t messageId, const char* data, size_t numBytes);
 
@@ -134,6 +159,9 @@ public:
     /// Queue a network message to be sent to the client. 
     virtual void Send(kNet::message_id_t id, const char* data, size_t numBytes, bool reliable, bool inOrder, unsigned long priority = 100, unsigned long contentID = 0);
 
+    /// Returns the round trip time, packet loss rate and outbound message queue length of the message connection.
+    virtual UserConnectionStats Statistics() const;
+
 public slots:
     /// Starts a benign disconnect procedure (one which waits for the peer acknowledge procedure).
     virtual void Disconnect();
@@ -51,24 +51,36 @@ void EC_ProximityTrigger::Update(float /*timeStep*/)
 
     float3 pos = placeable->WorldPosition();
 
-    EntityList otherTriggers = scene->EntitiesWithComponent<EC_ProximityTrigger>();
-    for(EntityList::iterator i = otherTriggers.begin(); i != otherTriggers.end(); ++i)
+    // Collect the triggered entities first, as the signal handlers may add or remove triggers, which reorders the per-type
+    // component list of the scene.
+    std::vector<std::pair<EntityWeakPtr, float> > triggeredEntities;
+    const u32 typeId = EC_ProximityTrigger::ComponentTypeId;
+    const uint numTriggers = scene->NumComponentsOfType(typeId);
+    for(uint i = 0; i < numTriggers; ++i)
     {
-        Entity* otherEntity = (*i).get();
-        if (otherEntity != entity)
-        {
-            EC_Placeable* otherPlaceable = otherEntity->Component<EC_Placeable>().get();
-            if (!otherPlaceable)
-                continue;
+        IComponent* otherTrigger = scene->ComponentOfType(typeId, i);
+        Entity* otherEntity = otherTrigger->ParentEntity();
+        // Each entity only once, through its first trigger
+        if (!otherEntity || otherEntity == entity || otherEntity->Component(typeId).get() != otherTrigger)
+            continue;
+        EC_Placeable* otherPlaceable = otherEntity->Component<EC_Placeable>().get();
+        if (!otherPlaceable)
+            continue;
 
-            float3 offset = pos - otherPlaceable->WorldPosition();
-            float distance = offset.Length();
-            if (threshold <= 0.0f || distance <= threshold)
-            {
-                emit Triggered(otherEntity, distance);
-                emit triggered(otherEntity, distance);
-            }
-        }
+        float3 offset = pos - otherPlaceable->WorldPosition();
+        float distance = offset.Length();
+        if (threshold <= 0.0f || distance <= threshold)
+            triggeredEntities.push_back(std::make_pair(otherEntity->shared_from_this(), distance));
+    }
+
+    for(size_t i = 0; i < triggeredEntities.size(); ++i)
+    {
+        // Skip the entities removed by the handlers of the earlier signals
+        EntityPtr otherEntity = triggeredEntities[i].first.lock();
+        if (!otherEntity)
+            continue;
+        emit Triggered(otherEntity.get(), triggeredEntities[i].second);
+        emit triggered(otherEntity.get(), triggeredEntities[i].second);
     }
 }
 